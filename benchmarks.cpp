@@ -0,0 +1,2046 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "benchmarks.h"
+#include "qqbenchmark.h"
+#include "mainwindow.h"
+#include "qqlogging.h"
+#include "main.h"
+#include "qqnativesemaphore.h"
+#include "qqshutdown.h"
+#include "qqshortcutregistry.h"
+#include "qqprewarmpool.h"
+#include "qqnotifyprofiler.h"
+#include "qqeventrecorder.h"
+#include "qwidgetstyleselector.h"
+
+#include <QApplication>
+#include <QContextMenuEvent>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QKeyEvent>
+#include <QKeySequence>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMenu>
+#include <QActionGroup>
+#include <QMenuBar>
+#include <QMouseEvent>
+#include <QEventLoop>
+#include <QHash>
+#include <QMap>
+#include <QPointer>
+#include <QSet>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QStyle>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QDebug>
+#include <qpa/qwindowsysteminterface.h>
+
+#include <functional>
+
+namespace {
+
+// the far end of the contended semaphore benchmark: answers each ping with a pong
+class SemaphoreEcho : public QThread
+{
+public:
+    SemaphoreEcho(QQNativeSemaphore *ping, QQNativeSemaphore *pong, int iterations)
+        : m_ping(ping)
+        , m_pong(pong)
+        , m_iterations(iterations)
+    {}
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        for (int i = 0; i < m_iterations; ++i) {
+            m_ping->wait();
+            m_pong->trigger(QQNativeSemaphore::Payload(i));
+        }
+    }
+
+private:
+    QQNativeSemaphore *m_ping, *m_pong;
+    int m_iterations;
+};
+
+// Records when the next QMenu is shown, and closes it again from the event
+// loop that QMenu::exec() runs so that exec() returns.
+class MenuShowProbe : public QObject
+{
+public:
+    MenuShowProbe()
+        : shownAt(-1)
+    {
+        qApp->installEventFilter(this);
+    }
+    ~MenuShowProbe()
+    {
+        qApp->removeEventFilter(this);
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE
+    {
+        if (event->type() == QEvent::Show) {
+            if (QMenu *menu = qobject_cast<QMenu*>(watched)) {
+                shownAt = QQBenchmark::now();
+                QTimer::singleShot(0, menu, SLOT(close()));
+            }
+        }
+        return false;
+    }
+
+    qint64 shownAt;
+};
+
+// Records when all of a set of windows have painted (any of their widgets) at least once.
+class PaintProbe : public QObject
+{
+public:
+    explicit PaintProbe(QWidget *window)
+        : PaintProbe(QList<QWidget*>() << window)
+    {}
+    explicit PaintProbe(const QList<QWidget*> &windows)
+        : m_windows(windows)
+    {
+        reset();
+        qApp->installEventFilter(this);
+    }
+    ~PaintProbe()
+    {
+        qApp->removeEventFilter(this);
+    }
+
+    void reset()
+    {
+        paintedAt = -1;
+        // not QList::toSet(), which is deprecated since Qt 5.14
+        m_pending.clear();
+        foreach (QWidget *w, m_windows) {
+            m_pending.insert(w);
+        }
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE
+    {
+        if (event->type() == QEvent::Paint && paintedAt < 0) {
+            QWidget *w = qobject_cast<QWidget*>(watched);
+            if (w && m_pending.remove(w->window()) && m_pending.isEmpty()) {
+                paintedAt = QQBenchmark::now();
+            }
+        }
+        return false;
+    }
+
+    // process events until the windows have painted; returns the time of the last paint or -1
+    qint64 waitForPaint(int timeOut = 2000)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        while (paintedAt < 0 && timer.elapsed() < timeOut) {
+            QApplication::processEvents(QEventLoop::AllEvents, 10);
+        }
+        return paintedAt;
+    }
+
+    qint64 paintedAt;
+
+private:
+    QList<QWidget*> m_windows;
+    QSet<QWidget*> m_pending;
+};
+
+// counts the QEvent::ActionChanged events that reach the widgets it filters
+class ActionChangeCounter : public QObject
+{
+public:
+    ActionChangeCounter()
+        : count(0)
+    {}
+
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE
+    {
+        if (event->type() == QEvent::ActionChanged) {
+            count += 1;
+        }
+        return QObject::eventFilter(watched, event);
+    }
+
+    int count;
+};
+
+typedef QVector<QPair<QString,qint64> > PhaseList;
+
+// the per-phase medians of several profiled runs, in order of first appearance
+class PhaseMedians
+{
+public:
+    void add(const PhaseList &phases)
+    {
+        foreach (const auto &phase, phases) {
+            if (!m_stats.contains(phase.first)) {
+                m_order.append(phase.first);
+                m_stats.insert(phase.first, QQLatencyStats(phase.first));
+            }
+            m_stats[phase.first].addSample(phase.second);
+        }
+    }
+
+    PhaseList medians() const
+    {
+        PhaseList result;
+        foreach (const QString &path, m_order) {
+            result.append(qMakePair(path, m_stats.value(path).median()));
+        }
+        return result;
+    }
+
+    QJsonArray toJson() const
+    {
+        QJsonArray result;
+        foreach (const QString &path, m_order) {
+            result.append(m_stats.value(path).toJson());
+        }
+        return result;
+    }
+
+private:
+    QStringList m_order;
+    QHash<QString,QQLatencyStats> m_stats;
+};
+
+// the profiled part of the startup that happens after main() set up the application
+MainWindow *profileWindow(const Benchmarks::Options &options, qint64 *paintedAt)
+{
+    QQPhaseProfiler *profiler = QQPhaseProfiler::instance();
+    profiler->begin("MainWindow");
+    MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+    profiler->end();
+    PaintProbe probe(window);
+    profiler->begin("show");
+    window->show();
+    profiler->end();
+    profiler->begin("first paint");
+    *paintedAt = probe.waitForPaint(10000);
+    profiler->end();
+    return window;
+}
+
+// collects the latencies (QQLatencyStats::toJson() objects) in @p value by their path in the report
+void collectLatencies(const QJsonValue &value, const QString &path, QMap<QString,QJsonObject> *latencies)
+{
+    if (value.isObject()) {
+        const QJsonObject object = value.toObject();
+        if (object.contains(QStringLiteral("count")) && object.contains(QStringLiteral("mean_ns"))
+                && object.contains(QStringLiteral("stddev_ns"))) {
+            latencies->insert(path, object);
+            return;
+        }
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+            collectLatencies(it.value(), path.isEmpty() ? it.key() : path + QLatin1Char('/') + it.key(), latencies);
+        }
+    } else if (value.isArray()) {
+        const QJsonArray array = value.toArray();
+        for (int i = 0; i < array.count(); ++i) {
+            // key the elements by name where possible, so the paths don't depend on their order
+            const QJsonObject element = array.at(i).toObject();
+            QString key = element.value(QStringLiteral("name")).toString();
+            if (key.isEmpty()) {
+                key = element.value(QStringLiteral("style")).toString();
+            }
+            if (key.isEmpty()) {
+                key = QString::number(i);
+            }
+            collectLatencies(array.at(i), path + QLatin1Char('/') + key, latencies);
+        }
+    }
+}
+
+// compares the latencies in @p results with those in @p baseline and prints a line for each;
+// returns the comparison as JSON and the number of significant regressions in @p regressions
+QJsonObject compareReports(const QJsonObject &results, const QJsonObject &baseline, double threshold, int *regressions)
+{
+    const double alpha = 0.01;
+    QMap<QString,QJsonObject> current, reference;
+    collectLatencies(results, QString(), &current);
+    collectLatencies(baseline, QString(), &reference);
+
+    QQBenchmark::print(QStringLiteral("Comparison with the baseline (threshold %1%, significance level %2)")
+        .arg(threshold).arg(alpha));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5")
+        .arg(QStringLiteral("latency"), -60).arg(QStringLiteral("baseline"), 10).arg(QStringLiteral("mean"), 10)
+        .arg(QStringLiteral("change"), 8).arg(QStringLiteral("p"), 8));
+    QJsonArray comparisons;
+    QStringList missing;
+    int improvements = 0;
+    *regressions = 0;
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        if (!reference.contains(it.key())) {
+            continue;
+        }
+        const QJsonObject &now = it.value();
+        const QJsonObject then = reference.value(it.key());
+        const double mean = now.value(QStringLiteral("mean_ns")).toDouble();
+        const double stddev = now.value(QStringLiteral("stddev_ns")).toDouble();
+        const int n = now.value(QStringLiteral("count")).toInt();
+        const double baseMean = then.value(QStringLiteral("mean_ns")).toDouble();
+        const double baseStddev = then.value(QStringLiteral("stddev_ns")).toDouble();
+        const int baseN = then.value(QStringLiteral("count")).toInt();
+        const double change = baseMean > 0 ? (mean - baseMean) * 100 / baseMean : 0;
+        QString verdict;
+        double p = 1;
+        if (n < 2 || baseN < 2) {
+            verdict = QStringLiteral("too few samples");
+        } else if (change > threshold) {
+            p = QQBenchmark::welchTest(baseMean, baseStddev, baseN, mean, stddev, n);
+            if (p < alpha) {
+                verdict = QStringLiteral("REGRESSION");
+                *regressions += 1;
+            }
+        } else if (change < -threshold) {
+            p = QQBenchmark::welchTest(mean, stddev, n, baseMean, baseStddev, baseN);
+            if (p < alpha) {
+                verdict = QStringLiteral("improved");
+                improvements += 1;
+            }
+        }
+        QQBenchmark::print(QStringLiteral("%1 %2 %3 %4% %5 %6")
+            .arg(it.key(), -60).arg(QQBenchmark::formatNsecs(qint64(baseMean)), 10)
+            .arg(QQBenchmark::formatNsecs(qint64(mean)), 10)
+            .arg(change, 7, 'f', 1).arg(p, 8, 'g', 2).arg(verdict));
+        QJsonObject comparison;
+        comparison.insert(QStringLiteral("latency"), it.key());
+        comparison.insert(QStringLiteral("baselineMean"), baseMean);
+        comparison.insert(QStringLiteral("baselineCount"), baseN);
+        comparison.insert(QStringLiteral("mean"), mean);
+        comparison.insert(QStringLiteral("n"), n);
+        comparison.insert(QStringLiteral("changePercent"), change);
+        comparison.insert(QStringLiteral("p"), p);
+        comparison.insert(QStringLiteral("verdict"), verdict);
+        comparisons.append(comparison);
+    }
+    for (auto it = reference.constBegin(); it != reference.constEnd(); ++it) {
+        if (!current.contains(it.key())) {
+            missing.append(it.key());
+        }
+    }
+    foreach (const QString &path, missing) {
+        QQBenchmark::print(QStringLiteral("%1 (not in the results)").arg(path, -60));
+    }
+    QQBenchmark::print(QStringLiteral("%1 latencies compared: %2 regressed, %3 improved, %4 missing")
+        .arg(comparisons.count()).arg(*regressions).arg(improvements).arg(missing.count()));
+
+    QJsonObject report;
+    report.insert(QStringLiteral("benchmark"), QStringLiteral("compare"));
+    report.insert(QStringLiteral("thresholdPercent"), threshold);
+    report.insert(QStringLiteral("alpha"), alpha);
+    report.insert(QStringLiteral("regressions"), *regressions);
+    report.insert(QStringLiteral("improvements"), improvements);
+    report.insert(QStringLiteral("missing"), QJsonArray::fromStringList(missing));
+    report.insert(QStringLiteral("comparisons"), comparisons);
+    return report;
+}
+
+}
+
+bool Benchmarks::showAndActivate(QWidget *w, int timeOut)
+{
+    w->show();
+    w->raise();
+    w->activateWindow();
+    QApplication::setActiveWindow(w);
+    QElapsedTimer timer;
+    timer.start();
+    while (!w->isActiveWindow() && timer.elapsed() < timeOut) {
+        QApplication::processEvents(QEventLoop::AllEvents, 50);
+    }
+    QApplication::processEvents();
+    return w->isActiveWindow();
+}
+
+void Benchmarks::sendKeySequence(QWidget *target, const QKeySequence &seq)
+{
+    for (int i = 0; i < seq.count(); ++i) {
+        const int key = seq[i] & ~Qt::KeyboardModifierMask;
+        const Qt::KeyboardModifiers mods = Qt::KeyboardModifiers(QFlag(seq[i] & Qt::KeyboardModifierMask));
+        QKeyEvent press(QEvent::KeyPress, key, mods);
+        QApplication::sendEvent(target, &press);
+        QKeyEvent release(QEvent::KeyRelease, key, mods);
+        QApplication::sendEvent(target, &release);
+    }
+}
+
+int Benchmarks::shortcutDispatch(int iterations, const Options &options)
+{
+    static const struct {
+        int flags;
+        const char *name;
+    } placements[] = {
+        { 1, "menubar" },
+        { 2, "contextmenu" },
+        { 3, "menubar+contextmenu" },
+        { 4, "window" },
+    };
+    const QKeySequence seq(options.shortCut);
+    if (seq.isEmpty()) {
+        qWarning() << "Invalid shortcut" << options.shortCut;
+        return 1;
+    }
+    const int warmup = qMin(100, iterations / 10);
+    int ret = 0;
+
+    QJsonObject results;
+    QQBenchmark::print(QStringLiteral("Shortcut dispatch latency for \"%1\" (%2 iterations, %3 warmup)")
+        .arg(seq.toString(QKeySequence::PortableText)).arg(iterations).arg(warmup));
+    for (const auto &placement : placements) {
+        MainWindow window(placement.flags, options.shortCut, options.nativeMenuBar);
+        if (!showAndActivate(&window)) {
+            qWarning() << "window could not be activated; shortcuts may not fire";
+        }
+        QWidget *target = window.focusWidget() ? window.focusWidget() : &window;
+        QQLatencyStats stats(QString::fromLatin1(placement.name), iterations);
+        int missed = 0;
+        for (int i = -warmup; i < iterations; ++i) {
+            const int before = window.shortCutDispatchCount();
+            const qint64 t0 = QQBenchmark::now();
+            sendKeySequence(target, seq);
+            if (window.shortCutDispatchCount() == before) {
+                missed += 1;
+            } else if (i >= 0) {
+                stats.addSample(window.lastShortCutDispatch() - t0);
+            }
+        }
+        QString line = stats.summary();
+        if (missed) {
+            line += QStringLiteral(" MISSED=%1").arg(missed);
+            ret = 2;
+        }
+        QQBenchmark::print(line);
+        QJsonObject result = stats.toJson();
+        result.insert(QStringLiteral("flags"), placement.flags);
+        result.insert(QStringLiteral("missed"), missed);
+        results.insert(stats.name(), result);
+        window.close();
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("shortcut-dispatch"));
+        report.insert(QStringLiteral("shortcut"), seq.toString(QKeySequence::PortableText));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("nativeMenuBar"), options.nativeMenuBar);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::menuAncestry(int depth, int iterations, const Options &options)
+{
+    // time batches of lookups; a single one is too close to the clock resolution
+    const int batch = 1000;
+    const int samples = qMax(1, iterations / batch);
+    int ret = 0;
+
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    QVector<const QMenu*> chain;
+    chain.reserve(depth);
+    QMenu *menu = window.menuBar()->addMenu(QStringLiteral("Nested 1"));
+    chain.append(menu);
+    for (int level = 2; level <= depth; ++level) {
+        menu = menu->addMenu(QStringLiteral("Nested %1").arg(level));
+        chain.append(menu);
+    }
+    const QQMenuAncestry *index = window.menuAncestry();
+
+    QQBenchmark::print(QStringLiteral("isMenubarMenu() cost per lookup, walk vs. index (%1 lookups per level)")
+        .arg(samples * batch));
+    QJsonArray results;
+    volatile bool sink = false;
+    for (int level = 1; level <= chain.count(); ++level) {
+        const QMenu *m = chain.at(level - 1);
+        if (QQMenuAncestry::walkIsMenubarMenu(m, false) != index->isMenubarMenu(m, false)) {
+            qWarning() << "walk and index disagree for" << m << "at level" << level;
+            ret = 2;
+        }
+        QQLatencyStats walk(QStringLiteral("walk   level %1").arg(level), samples);
+        QQLatencyStats indexed(QStringLiteral("index  level %1").arg(level), samples);
+        for (int s = 0; s < samples; ++s) {
+            qint64 t0 = QQBenchmark::now();
+            for (int i = 0; i < batch; ++i) {
+                sink = QQMenuAncestry::walkIsMenubarMenu(m, false);
+            }
+            walk.addSample((QQBenchmark::now() - t0) / batch);
+            t0 = QQBenchmark::now();
+            for (int i = 0; i < batch; ++i) {
+                sink = index->isMenubarMenu(m, false);
+            }
+            indexed.addSample((QQBenchmark::now() - t0) / batch);
+        }
+        QQBenchmark::print(walk.summary());
+        QQBenchmark::print(indexed.summary());
+        QJsonObject result;
+        result.insert(QStringLiteral("level"), level);
+        result.insert(QStringLiteral("walk"), walk.toJson());
+        result.insert(QStringLiteral("index"), indexed.toJson());
+        results.append(result);
+    }
+    Q_UNUSED(sink);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("menu-ancestry"));
+        report.insert(QStringLiteral("depth"), depth);
+        report.insert(QStringLiteral("lookupsPerLevel"), samples * batch);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::contextMenuSoak(int iterations, const Options &options)
+{
+    const int checkpoints = 10;
+    const int perCheckpoint = qMax(1, iterations / checkpoints);
+    int ret = 0;
+
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    const QPoint pos = window.rect().center();
+    MenuShowProbe probe;
+
+    QQBenchmark::print(QStringLiteral("Context menu soak test: %1 right-clicks").arg(perCheckpoint * checkpoints));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5")
+        .arg(QStringLiteral("clicks"), 10).arg(QStringLiteral("p50"), 10).arg(QStringLiteral("p99"), 10)
+        .arg(QStringLiteral("RSS (kB)"), 10).arg(QStringLiteral("objects"), 8));
+    QJsonArray results;
+    QQLatencyStats all(QStringLiteral("context menu open"), perCheckpoint * checkpoints);
+    QQLatencyStats slice(QString(), perCheckpoint);
+    qint64 firstRSS = -1, lastRSS = -1;
+    int firstObjects = -1, lastObjects = -1;
+    for (int c = 1; c <= checkpoints; ++c) {
+        slice.clear();
+        for (int i = 0; i < perCheckpoint; ++i) {
+            QContextMenuEvent event(QContextMenuEvent::Mouse, pos, window.mapToGlobal(pos));
+            probe.shownAt = -1;
+            const qint64 t0 = QQBenchmark::now();
+            QApplication::sendEvent(&window, &event);
+            if (probe.shownAt >= 0) {
+                slice.addSample(probe.shownAt - t0);
+                all.addSample(probe.shownAt - t0);
+            }
+        }
+        // let deferred deletes happen before measuring
+        QApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        lastRSS = QQBenchmark::residentSetSize();
+        lastObjects = window.findChildren<QObject*>().count();
+        if (c == 1) {
+            firstRSS = lastRSS;
+            firstObjects = lastObjects;
+        }
+        QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5")
+            .arg(c * perCheckpoint, 10)
+            .arg(QQBenchmark::formatNsecs(slice.median()), 10)
+            .arg(QQBenchmark::formatNsecs(slice.percentile(99)), 10)
+            .arg(lastRSS / 1024, 10)
+            .arg(lastObjects, 8));
+        QJsonObject result = slice.toJson();
+        result.insert(QStringLiteral("clicks"), c * perCheckpoint);
+        result.insert(QStringLiteral("rss_bytes"), double(lastRSS));
+        result.insert(QStringLiteral("objects"), lastObjects);
+        results.append(result);
+    }
+    QQBenchmark::print(all.summary());
+    QQBenchmark::print(QStringLiteral("RSS growth after the first checkpoint: %1 kB; QObject growth: %2")
+        .arg((lastRSS - firstRSS) / 1024).arg(lastObjects - firstObjects));
+    if (all.count() < perCheckpoint * checkpoints) {
+        qWarning() << "the context menu did not open" << perCheckpoint * checkpoints - all.count() << "times";
+        ret = 2;
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("context-menu-soak"));
+        report.insert(QStringLiteral("iterations"), perCheckpoint * checkpoints);
+        report.insert(QStringLiteral("overall"), all.toJson());
+        report.insert(QStringLiteral("checkpoints"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::logging(int iterations, const Options &options)
+{
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    QMenu *menu = window.menuBar()->actions().value(0) ? window.menuBar()->actions().value(0)->menu() : nullptr;
+    if (!menu) {
+        qWarning() << "no menu to open";
+        return 1;
+    }
+    const QPoint pos = window.rect().center();
+    const QPoint globalPos = window.mapToGlobal(pos);
+
+    if (!qqCategoryLoggingAvailable()) {
+        QQBenchmark::print(QStringLiteral("(category logging was compiled out with QQ_NO_CATEGORY_LOGGING)"));
+    }
+    QQBenchmark::print(QStringLiteral("Menu open and click latency with category logging off and on (%1 iterations)")
+        .arg(iterations));
+    QJsonObject results;
+    for (int enabled = 0; enabled <= 1; ++enabled) {
+        const QString mode = enabled ? QStringLiteral("on") : QStringLiteral("off");
+        qqSetCategoryLogging(enabled);
+        QQLatencyStats open(QStringLiteral("menu open, logging %1").arg(mode), iterations);
+        QQLatencyStats click(QStringLiteral("click, logging %1").arg(mode), iterations);
+        for (int i = 0; i < iterations; ++i) {
+            qint64 t0 = QQBenchmark::now();
+            menu->popup(globalPos);
+            open.addSample(QQBenchmark::now() - t0);
+            menu->hide();
+
+            QMouseEvent press(QEvent::MouseButtonPress, pos, globalPos, Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+            QMouseEvent release(QEvent::MouseButtonRelease, pos, globalPos, Qt::LeftButton, Qt::NoButton, Qt::NoModifier);
+            t0 = QQBenchmark::now();
+            QApplication::sendEvent(&window, &press);
+            click.addSample(QQBenchmark::now() - t0);
+            QApplication::sendEvent(&window, &release);
+        }
+        QQBenchmark::print(open.summary());
+        QQBenchmark::print(click.summary());
+        QJsonObject result;
+        result.insert(QStringLiteral("menuOpen"), open.toJson());
+        result.insert(QStringLiteral("click"), click.toJson());
+        results.insert(mode, result);
+    }
+    qqSetCategoryLogging(false);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("logging"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("categoriesCompiledIn"), qqCategoryLoggingAvailable());
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return 0;
+}
+
+int Benchmarks::notifyOverhead(QQApplication *app, int iterations, const Options &options)
+{
+    const int batch = 1000;
+    const int batches = qMax(1, iterations / batch);
+    const bool wasProfiling = app->notifyProfiler() != nullptr;
+    QObject receiver;
+    QEvent event(QEvent::User);
+
+    QQBenchmark::print(QStringLiteral("QQApplication::notify() cost per event (%1 batches of %2)")
+        .arg(batches).arg(batch));
+    QJsonObject results;
+    for (int profiling = 0; profiling <= 1; ++profiling) {
+        app->setNotifyProfiling(profiling);
+        QQLatencyStats stats(profiling ? QStringLiteral("profiler on") : QStringLiteral("profiler off"), batches);
+        for (int i = 0; i < batches; ++i) {
+            const qint64 t0 = QQBenchmark::now();
+            for (int j = 0; j < batch; ++j) {
+                QCoreApplication::sendEvent(&receiver, &event);
+            }
+            stats.addSample((QQBenchmark::now() - t0) / batch);
+        }
+        QQBenchmark::print(stats.summary());
+        results.insert(profiling ? QStringLiteral("on") : QStringLiteral("off"), stats.toJson());
+    }
+    app->setNotifyProfiling(wasProfiling);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("notify-overhead"));
+        report.insert(QStringLiteral("events"), batches * batch);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return 0;
+}
+
+int Benchmarks::signalDelivery(QQApplication *app, int iterations, int baselineThreads, int baselineFds,
+                               const Options &options)
+{
+    const QString backend = QQApplication::signalBackendName(app->signalBackend());
+    if (!app->catchInterruptSignal(SIGUSR1, false)) {
+        qWarning() << "cannot catch SIGUSR1 through the" << backend << "backend";
+        return 1;
+    }
+    qint64 receivedAt = -1;
+    const QMetaObject::Connection connection = QObject::connect(app, &QQApplication::interruptSignalReceived,
+        [&receivedAt](int sig) {
+            if (sig == SIGUSR1) {
+                receivedAt = QQBenchmark::now();
+            }
+        });
+
+    // the semaphore backend swallows the first signal(s) by design; measure
+    // without that countdown and leave it as it was for SIGINT afterwards.
+    const int countdown = app->signalCountdown();
+    app->setSignalCountdown(0);
+
+    QQBenchmark::print(QStringLiteral("Signal delivery latency through the %1 backend (%2 signals)")
+        .arg(backend).arg(iterations));
+    QQLatencyStats latency(QStringLiteral("kill() to slot, %1").arg(backend), iterations);
+    int missed = 0;
+    QElapsedTimer timeout;
+    for (int i = 0; i < iterations; ++i) {
+        receivedAt = -1;
+        const qint64 t0 = QQBenchmark::now();
+        kill(getpid(), SIGUSR1);
+        timeout.start();
+        while (receivedAt < 0 && timeout.elapsed() < 1000) {
+            QApplication::processEvents(QEventLoop::AllEvents);
+        }
+        if (receivedAt >= 0) {
+            latency.addSample(receivedAt - t0);
+        } else {
+            ++missed;
+        }
+    }
+    QObject::disconnect(connection);
+    app->setSignalCountdown(countdown);
+    const int threads = QQBenchmark::threadCount();
+    const int fds = QQBenchmark::openFileDescriptors();
+
+    QQBenchmark::print(latency.summary());
+    QQBenchmark::print(QStringLiteral("threads: %1 (+%2), open file descriptors: %3 (+%4), missed signals: %5")
+        .arg(threads).arg(threads - baselineThreads).arg(fds).arg(fds - baselineFds).arg(missed));
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("signal-delivery"));
+        report.insert(QStringLiteral("backend"), backend);
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("latency"), latency.toJson());
+        report.insert(QStringLiteral("missed"), missed);
+        report.insert(QStringLiteral("threads"), threads - baselineThreads);
+        report.insert(QStringLiteral("fileDescriptors"), fds - baselineFds);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return missed ? 2 : 0;
+}
+
+int Benchmarks::semaphore(int iterations, const Options &options)
+{
+    const QQNativeSemaphore::WaitBackend backends[] = { QQNativeSemaphore::SemaphoreWait, QQNativeSemaphore::FutexWait };
+    const QQNativeSemaphore::WaitBackend defaultBackend = QQNativeSemaphore::defaultWaitBackend();
+    QQBenchmark::print(QStringLiteral("QQNativeSemaphore trigger/wait latency (%1 iterations)").arg(iterations));
+    QJsonObject results;
+    for (QQNativeSemaphore::WaitBackend backend : backends) {
+        if (!QQNativeSemaphore::isWaitBackendAvailable(backend)) {
+            continue;
+        }
+        const QString name = backend == QQNativeSemaphore::FutexWait ? QStringLiteral("futex") : QStringLiteral("sem_t");
+        QQNativeSemaphore::setDefaultWaitBackend(backend);
+
+        QQLatencyStats uncontended(QStringLiteral("%1 uncontended pair").arg(name), iterations);
+        {
+            QQNativeSemaphore sem(true, true);
+            for (int i = 0; i < iterations; ++i) {
+                const qint64 t0 = QQBenchmark::now();
+                sem.trigger(QQNativeSemaphore::Payload(i));
+                sem.wait();
+                uncontended.addSample(QQBenchmark::now() - t0);
+            }
+        }
+
+        QQLatencyStats contended(QStringLiteral("%1 contended round trip").arg(name), iterations);
+        {
+            QQNativeSemaphore ping(true, true), pong(true, true);
+            SemaphoreEcho echo(&ping, &pong, iterations);
+            echo.start();
+            for (int i = 0; i < iterations; ++i) {
+                const qint64 t0 = QQBenchmark::now();
+                ping.trigger(QQNativeSemaphore::Payload(i));
+                pong.wait();
+                contended.addSample(QQBenchmark::now() - t0);
+            }
+            echo.wait();
+        }
+
+        QQBenchmark::print(uncontended.summary());
+        QQBenchmark::print(contended.summary());
+        QJsonObject result;
+        result.insert(QStringLiteral("uncontended"), uncontended.toJson());
+        result.insert(QStringLiteral("contended"), contended.toJson());
+        results.insert(name, result);
+    }
+    QQNativeSemaphore::setDefaultWaitBackend(defaultBackend);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("semaphore"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return 0;
+}
+
+int Benchmarks::semaphoreScaling(int maxInstances, int iterations, const Options &options)
+{
+    const QQNativeSemaphore::MonitorMode modes[] = { QQNativeSemaphore::DedicatedMonitor, QQNativeSemaphore::SharedMonitor };
+    const QQNativeSemaphore::MonitorMode defaultMode = QQNativeSemaphore::defaultMonitorMode();
+    int ret = 0;
+    QQBenchmark::print(QStringLiteral("QQNativeSemaphore monitor scaling (%1 triggers per run)").arg(iterations));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5 %6 %7")
+        .arg(QStringLiteral("monitor"), -10).arg(QStringLiteral("instances"), 10).arg(QStringLiteral("threads"), 8)
+        .arg(QStringLiteral("fds"), 6).arg(QStringLiteral("RSS (kB)"), 10)
+        .arg(QStringLiteral("p50"), 10).arg(QStringLiteral("p99"), 10));
+    QJsonArray results;
+    for (QQNativeSemaphore::MonitorMode mode : modes) {
+        const QString modeName = mode == QQNativeSemaphore::SharedMonitor ? QStringLiteral("shared") : QStringLiteral("dedicated");
+        QQNativeSemaphore::setDefaultMonitorMode(mode);
+        for (int count = 1; count <= maxInstances; count *= 10) {
+            const int threads0 = QQBenchmark::threadCount();
+            const int fds0 = QQBenchmark::openFileDescriptors();
+            const qint64 rss0 = QQBenchmark::residentSetSize();
+
+            std::atomic<qint64> receivedAt(-1);
+            QVector<QQNativeSemaphore*> sems;
+            sems.reserve(count);
+            int failed = 0;
+            for (int i = 0; i < count; ++i) {
+                QQNativeSemaphore *sem = new QQNativeSemaphore;
+                QObject::connect(sem, &QQNativeSemaphore::triggered, [&receivedAt](QVariant) {
+                    receivedAt = QQBenchmark::now();
+                });
+                if (!sem->setEnabled(true)) {
+                    ++failed;
+                }
+                sems.append(sem);
+            }
+            const int threads = QQBenchmark::threadCount() - threads0;
+            const int fds = QQBenchmark::openFileDescriptors() - fds0;
+            const qint64 rss = QQBenchmark::residentSetSize() - rss0;
+
+            QQLatencyStats latency(QStringLiteral("%1, %2 instances").arg(modeName).arg(count), iterations);
+            int missed = 0;
+            QElapsedTimer timeout;
+            for (int i = 0; i < iterations; ++i) {
+                QQNativeSemaphore *sem = sems.at(i % count);
+                receivedAt = -1;
+                const qint64 t0 = QQBenchmark::now();
+                if (!sem->trigger(QQNativeSemaphore::Payload(i))) {
+                    ++missed;
+                    continue;
+                }
+                timeout.start();
+                while (receivedAt < 0 && timeout.elapsed() < 1000) {
+                    QThread::yieldCurrentThread();
+                }
+                if (receivedAt >= 0) {
+                    latency.addSample(receivedAt - t0);
+                } else {
+                    ++missed;
+                }
+            }
+            qDeleteAll(sems);
+
+            QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5 %6 %7")
+                .arg(modeName, -10).arg(count, 10).arg(threads, 8).arg(fds, 6).arg(rss / 1024, 10)
+                .arg(QQBenchmark::formatNsecs(latency.median()), 10)
+                .arg(QQBenchmark::formatNsecs(latency.percentile(99)), 10));
+            if (failed || missed) {
+                qWarning() << modeName << count << "instances:" << failed << "failed to enable," << missed << "triggers were lost";
+                ret = 2;
+            }
+            QJsonObject result = latency.toJson();
+            result.insert(QStringLiteral("monitor"), modeName);
+            result.insert(QStringLiteral("instances"), count);
+            result.insert(QStringLiteral("threads"), threads);
+            result.insert(QStringLiteral("fileDescriptors"), fds);
+            result.insert(QStringLiteral("rss_bytes"), double(rss));
+            result.insert(QStringLiteral("failed"), failed);
+            result.insert(QStringLiteral("missed"), missed);
+            results.append(result);
+        }
+    }
+    QQNativeSemaphore::setDefaultMonitorMode(defaultMode);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("semaphore-scaling"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::shutdown(QQApplication *app, int windows, int iterations, const Options &options)
+{
+    QQShutdownSequence *sequence = app->shutdownSequence();
+    // run the sequence without terminating
+    QObject::disconnect(sequence, &QQShutdownSequence::finished, app, nullptr);
+
+    QQBenchmark::print(QStringLiteral("Shutdown sequence with %1 windows, deadline %2ms (%3 runs)")
+        .arg(windows).arg(sequence->deadline()).arg(iterations));
+    QMap<QString, QQLatencyStats*> stages;
+    QQLatencyStats total(QStringLiteral("total"), iterations);
+    QQLatencyStats stall(QStringLiteral("longest event loop stall"), iterations);
+    int expired = 0;
+    for (int i = 0; i < iterations; ++i) {
+        QVector<QPointer<MainWindow> > mainWindows;
+        for (int w = 0; w < windows; ++w) {
+            MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+            window->show();
+            mainWindows.append(window);
+        }
+        if (!mainWindows.isEmpty()) {
+            showAndActivate(mainWindows.last());
+        }
+
+        // a 1ms timer that records the longest gap between its ticks
+        qint64 lastTick = QQBenchmark::now(), longestGap = 0;
+        QTimer ticker;
+        ticker.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&ticker, &QTimer::timeout, [&lastTick, &longestGap]() {
+            const qint64 t = QQBenchmark::now();
+            longestGap = qMax(longestGap, t - lastTick);
+            lastTick = t;
+        });
+        QEventLoop loop;
+        bool runExpired = false;
+        const QMetaObject::Connection done = QObject::connect(sequence, &QQShutdownSequence::finished,
+            [&loop, &runExpired](int, bool hasExpired) {
+                runExpired = hasExpired;
+                loop.quit();
+            });
+        ticker.start(1);
+        lastTick = QQBenchmark::now();
+        sequence->start(SIGTERM);
+        if (sequence->isRunning()) {
+            loop.exec();
+        }
+        ticker.stop();
+        QObject::disconnect(done);
+
+        const QJsonObject timings = sequence->timings();
+        foreach (const QJsonValue &value, timings.value(QStringLiteral("stages")).toArray()) {
+            const QJsonObject stage = value.toObject();
+            const QString name = stage.value(QStringLiteral("stage")).toString();
+            if (!stages.contains(name)) {
+                stages.insert(name, new QQLatencyStats(name, iterations));
+            }
+            stages.value(name)->addSample(qint64(stage.value(QStringLiteral("ns")).toDouble()));
+        }
+        total.addSample(qint64(timings.value(QStringLiteral("total_ns")).toDouble()));
+        stall.addSample(longestGap);
+        if (runExpired) {
+            ++expired;
+        }
+        foreach (const QPointer<MainWindow> &window, mainWindows) {
+            delete window.data();
+        }
+        QApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    }
+
+    QJsonObject results;
+    foreach (QQLatencyStats *stage, stages) {
+        QQBenchmark::print(stage->summary());
+        results.insert(stage->name(), stage->toJson());
+    }
+    QQBenchmark::print(total.summary());
+    QQBenchmark::print(stall.summary());
+    QQBenchmark::print(QStringLiteral("deadline expired in %1 of %2 runs").arg(expired).arg(iterations));
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("shutdown"));
+        report.insert(QStringLiteral("windows"), windows);
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("deadline_ms"), sequence->deadline());
+        report.insert(QStringLiteral("stages"), results);
+        report.insert(QStringLiteral("total"), total.toJson());
+        report.insert(QStringLiteral("eventLoopStall"), stall.toJson());
+        report.insert(QStringLiteral("expired"), expired);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    qDeleteAll(stages);
+    return expired ? 2 : 0;
+}
+
+int Benchmarks::styleSwitch(int iterations, const Options &options)
+{
+    QWidgetStyleCache *cache = QWidgetStyleCache::instance();
+    const bool wasEnabled = cache->isEnabled();
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    if (cache->isPreloading()) {
+        QEventLoop loop;
+        QObject::connect(cache, &QWidgetStyleCache::preloadFinished, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    const QStringList styles = cache->styleKeys();
+    const QString home = QApplication::style()->objectName();
+    PaintProbe probe(&window);
+    // activate @p style and return the delay until the first paint, or -1
+    auto switchTo = [&](const QString &style) -> qint64 {
+        probe.reset();
+        const qint64 t0 = QQBenchmark::now();
+        cache->activate(style);
+        const qint64 t1 = probe.waitForPaint();
+        return t1 < 0 ? -1 : t1 - t0;
+    };
+
+    QQBenchmark::print(QStringLiteral("Style switch to first paint (%1 switches per style and mode)").arg(iterations));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4")
+        .arg(QStringLiteral("style"), -16).arg(QStringLiteral("first"), 10)
+        .arg(QStringLiteral("uncached"), 10).arg(QStringLiteral("cached"), 10));
+    QJsonArray results;
+    int ret = 0;
+    foreach (const QString &style, styles) {
+        if (style.compare(home, Qt::CaseInsensitive) == 0) {
+            continue;
+        }
+        const bool preloaded = cache->contains(style);
+        QQLatencyStats uncached(QStringLiteral("%1 uncached").arg(style), iterations);
+        QQLatencyStats cached(QStringLiteral("%1 cached").arg(style), iterations);
+        qint64 first = -1;
+        for (int mode = 0; mode <= 1; ++mode) {
+            cache->setEnabled(mode == 1);
+            QQLatencyStats &stats = mode ? cached : uncached;
+            for (int i = 0; i < iterations; ++i) {
+                const qint64 t = switchTo(style);
+                if (first < 0 && mode == 0 && i == 0) {
+                    first = t;
+                }
+                if (t >= 0) {
+                    stats.addSample(t);
+                } else {
+                    ret = 2;
+                }
+                switchTo(home);
+            }
+        }
+        QQBenchmark::print(QStringLiteral("%1 %2 %3 %4")
+            .arg(style, -16).arg(QQBenchmark::formatNsecs(first), 10)
+            .arg(QQBenchmark::formatNsecs(uncached.median()), 10)
+            .arg(QQBenchmark::formatNsecs(cached.median()), 10));
+        QJsonObject result;
+        result.insert(QStringLiteral("style"), style);
+        result.insert(QStringLiteral("preloaded"), preloaded);
+        result.insert(QStringLiteral("first_ns"), double(first));
+        result.insert(QStringLiteral("uncached"), uncached.toJson());
+        result.insert(QStringLiteral("cached"), cached.toJson());
+        results.append(result);
+    }
+    cache->setEnabled(wasEnabled);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("style-switch"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("homeStyle"), home);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::startupProbe(const Options &options)
+{
+    const qint64 t0 = QQBenchmark::now();
+    MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+    PaintProbe probe(window);
+    window->show();
+    const qint64 painted = probe.waitForPaint(10000);
+    qint64 styleMenu = -1;
+    if (QMenu *menu = window->findChild<QMenu*>(QStringLiteral("widgetStyleMenu"))) {
+        // what the first aboutToShow of the Widget Style menu does
+        const qint64 t = QQBenchmark::now();
+        QQMenuSections::sections(menu)->update();
+        styleMenu = QQBenchmark::now() - t;
+    }
+    QJsonObject result;
+    result.insert(QStringLiteral("main_to_paint_ns"), double(painted));
+    result.insert(QStringLiteral("window_to_paint_ns"), double(painted < 0 ? -1 : painted - t0));
+    result.insert(QStringLiteral("style_menu_ns"), double(styleMenu));
+    QQBenchmark::print(QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact)));
+    delete window;
+    return painted < 0 ? 2 : 0;
+}
+
+int Benchmarks::startupProfile(int runs, bool child, const Options &options)
+{
+    QQPhaseProfiler *profiler = QQPhaseProfiler::instance();
+    qint64 painted;
+    delete profileWindow(options, &painted);
+    const PhaseList firstRun = profiler->phases();
+
+    if (child) {
+        QJsonArray phases;
+        foreach (const auto &phase, firstRun) {
+            QJsonObject obj;
+            obj.insert(QStringLiteral("path"), phase.first);
+            obj.insert(QStringLiteral("ns"), double(phase.second));
+            phases.append(obj);
+        }
+        QJsonObject result;
+        result.insert(QStringLiteral("main_to_paint_ns"), double(painted));
+        result.insert(QStringLiteral("phases"), phases);
+        QQBenchmark::print(QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact)));
+        return painted < 0 ? 2 : 0;
+    }
+
+    if (runs <= 1) {
+        QQBenchmark::print(QStringLiteral("Startup profile"));
+        QQPhaseProfiler::printTree(firstRun);
+        QQBenchmark::print(QStringLiteral("main() to first paint: %1").arg(QQBenchmark::formatNsecs(painted)));
+        if (!options.jsonFile.isEmpty()) {
+            QJsonObject report = profiler->toJson();
+            report.insert(QStringLiteral("benchmark"), QStringLiteral("startup-profile"));
+            report.insert(QStringLiteral("main_to_paint_ns"), double(painted));
+            QQBenchmark::writeJson(options.jsonFile, report);
+        }
+        return painted < 0 ? 2 : 0;
+    }
+
+    int ret = painted < 0 ? 2 : 0;
+    // cold: a fresh process for every run, of which this is the first
+    PhaseMedians cold;
+    QQLatencyStats coldTotal(QStringLiteral("main() to first paint, cold"), runs);
+    cold.add(firstRun);
+    coldTotal.addSample(painted);
+    QStringList arguments;
+    arguments << QStringLiteral("--startup-profile") << QStringLiteral("--startup-profile-child");
+    if (!options.nativeMenuBar) {
+        arguments << QStringLiteral("--no-native-menubar");
+    }
+    for (int i = 1; i < runs; ++i) {
+        QProcess process;
+        process.setStandardErrorFile(QProcess::nullDevice());
+        process.start(QCoreApplication::applicationFilePath(), arguments);
+        if (!process.waitForFinished(30000) || process.exitCode() != 0) {
+            qWarning() << "startup profile run failed:" << process.errorString();
+            ret = 2;
+            continue;
+        }
+        const QList<QByteArray> lines = process.readAllStandardOutput().trimmed().split('\n');
+        const QJsonObject result = QJsonDocument::fromJson(lines.last()).object();
+        PhaseList phases;
+        foreach (const QJsonValue &v, result.value(QStringLiteral("phases")).toArray()) {
+            const QJsonObject obj = v.toObject();
+            phases.append(qMakePair(obj.value(QStringLiteral("path")).toString(),
+                                    qint64(obj.value(QStringLiteral("ns")).toDouble())));
+        }
+        cold.add(phases);
+        coldTotal.addSample(qint64(result.value(QStringLiteral("main_to_paint_ns")).toDouble()));
+    }
+
+    // warm: the window phases again in this process, with everything loaded and initialised
+    PhaseMedians warm;
+    QQLatencyStats warmTotal(QStringLiteral("window to first paint, warm"), runs);
+    for (int i = 0; i < runs; ++i) {
+        profiler->clear();
+        const qint64 t0 = QQBenchmark::now();
+        delete profileWindow(options, &painted);
+        if (painted < 0) {
+            ret = 2;
+            continue;
+        }
+        warm.add(profiler->phases());
+        warmTotal.addSample(painted - t0);
+    }
+    profiler->clear();
+
+    QQBenchmark::print(QStringLiteral("Startup profile, median of %1 cold runs").arg(runs));
+    QQPhaseProfiler::printTree(cold.medians());
+    QQBenchmark::print(coldTotal.summary());
+    QQBenchmark::print(QStringLiteral("Startup profile, median of %1 warm runs").arg(runs));
+    QQPhaseProfiler::printTree(warm.medians());
+    QQBenchmark::print(warmTotal.summary());
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("startup-profile"));
+        report.insert(QStringLiteral("runs"), runs);
+        report.insert(QStringLiteral("cold"), cold.toJson());
+        report.insert(QStringLiteral("coldTotal"), coldTotal.toJson());
+        report.insert(QStringLiteral("warm"), warm.toJson());
+        report.insert(QStringLiteral("warmTotal"), warmTotal.toJson());
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::actionCreation(int windows, const Options &options)
+{
+    struct Mode {
+        QString name;
+        bool lazy;
+    };
+    const Mode modes[] = {
+        { QStringLiteral("all actions"), false },
+        { QStringLiteral("lazy actions"), true }
+    };
+    QQBenchmark::print(QStringLiteral("Action creation over %1 windows").arg(windows));
+    QQPhaseProfiler *profiler = QQPhaseProfiler::instance();
+    const bool wasProfiling = profiler->isEnabled();
+    const bool wasLazy = MainWindow::lazyActions();
+    profiler->setEnabled(true);
+    QJsonObject results;
+    for (const Mode &mode : modes) {
+        MainWindow::setLazyActions(mode.lazy);
+        QQLatencyStats construct(QStringLiteral("construct, %1").arg(mode.name), windows);
+        QQLatencyStats createActions(QStringLiteral("createActions, %1").arg(mode.name), windows);
+        QList<MainWindow*> opened;
+        opened.reserve(windows);
+        qint64 first = -1;
+        int created = 0;
+        for (int i = 0; i < windows; ++i) {
+            profiler->clear();
+            const qint64 t0 = QQBenchmark::now();
+            MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+            const qint64 elapsed = QQBenchmark::now() - t0;
+            opened.append(window);
+            created = window->createdActionCount();
+            foreach (const auto &phase, profiler->phases()) {
+                if (phase.first == QLatin1String("createActions")) {
+                    createActions.addSample(phase.second);
+                }
+            }
+            // the first window of the process also resolves the shared texts and key bindings
+            if (first < 0) {
+                first = elapsed;
+            } else {
+                construct.addSample(elapsed);
+            }
+        }
+        qDeleteAll(opened);
+        QQBenchmark::print(QStringLiteral("%1: %2 of %3 actions per window, first window %4")
+            .arg(mode.name, -24).arg(created).arg(int(MainWindow::ActionCount))
+            .arg(QQBenchmark::formatNsecs(first)));
+        QQBenchmark::print(construct.summary());
+        QQBenchmark::print(createActions.summary());
+        QJsonObject result;
+        result.insert(QStringLiteral("actions"), created);
+        result.insert(QStringLiteral("first_ns"), double(first));
+        result.insert(QStringLiteral("construct"), construct.toJson());
+        result.insert(QStringLiteral("createActions"), createActions.toJson());
+        results.insert(mode.name, result);
+    }
+    profiler->clear();
+    profiler->setEnabled(wasProfiling);
+    MainWindow::setLazyActions(wasLazy);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("action-creation"));
+        report.insert(QStringLiteral("windows"), windows);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return 0;
+}
+
+int Benchmarks::stressActions(int maxActions, int depth, int iterations, const Options &options)
+{
+    // lookups are timed in batches; a single one is too close to the clock resolution
+    const int batch = 1000;
+    QQBenchmark::print(QStringLiteral("Scaling with 100 to %1 actions in menus %2 deep (%3 samples per count)")
+        .arg(maxActions).arg(depth).arg(iterations));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5 %6 %7 %8")
+        .arg(QStringLiteral("actions"), 8).arg(QStringLiteral("build"), 10)
+        .arg(QStringLiteral("dispatch"), 10).arg(QStringLiteral("p99"), 10)
+        .arg(QStringLiteral("open"), 10).arg(QStringLiteral("index"), 10)
+        .arg(QStringLiteral("walk"), 10).arg(QStringLiteral("RSS MB"), 8));
+    QJsonArray results;
+    int ret = 0;
+    for (int count = qMin(100, maxActions); ; count = qMin(count * 10, maxActions)) {
+        const qint64 rss0 = QQBenchmark::residentSetSize();
+        MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+        QList<QMenu*> leaves;
+        qint64 t0 = QQBenchmark::now();
+        const QList<QAction*> actions = window->addStressActions(count, depth, &leaves);
+        const qint64 build = QQBenchmark::now() - t0;
+        if (!showAndActivate(window)) {
+            qWarning() << "window could not be activated; shortcuts may not fire";
+        }
+        QWidget *target = window->focusWidget() ? window->focusWidget() : window;
+
+        // dispatch: trigger actions spread evenly over the whole set
+        QQLatencyStats dispatch(QStringLiteral("dispatch"), iterations);
+        int missed = 0;
+        qint64 firedAt = -1;
+        for (int i = 0; i < iterations && !actions.isEmpty(); ++i) {
+            QAction *action = actions.at(int(qint64(i) * actions.count() / iterations));
+            const QMetaObject::Connection c = QObject::connect(action, &QAction::triggered, [&firedAt]() {
+                firedAt = QQBenchmark::now();
+            });
+            firedAt = -1;
+            t0 = QQBenchmark::now();
+            sendKeySequence(target, action->shortcut());
+            if (firedAt < 0) {
+                missed += 1;
+            } else {
+                dispatch.addSample(firedAt - t0);
+            }
+            QObject::disconnect(c);
+        }
+
+        // open: popup() of the menus holding the actions, closed again right away
+        const QPoint globalPos = window->mapToGlobal(window->rect().center());
+        QQLatencyStats open(QStringLiteral("open"), iterations);
+        for (int i = 0; i < iterations; ++i) {
+            QMenu *menu = leaves.at(i % leaves.count());
+            t0 = QQBenchmark::now();
+            menu->popup(globalPos);
+            open.addSample(QQBenchmark::now() - t0);
+            menu->hide();
+        }
+
+        // isMenubarMenu(): the index and the reference walk, on the deepest menu
+        const QMenu *deepest = leaves.last();
+        QQLatencyStats indexed(QStringLiteral("index"), iterations), walk(QStringLiteral("walk"), iterations);
+        volatile bool sink = false;
+        for (int i = 0; i < iterations; ++i) {
+            t0 = QQBenchmark::now();
+            for (int j = 0; j < batch; ++j) {
+                sink = window->isMenubarMenu(deepest, false);
+            }
+            indexed.addSample((QQBenchmark::now() - t0) / batch);
+            t0 = QQBenchmark::now();
+            for (int j = 0; j < batch; ++j) {
+                sink = QQMenuAncestry::walkIsMenubarMenu(deepest, false);
+            }
+            walk.addSample((QQBenchmark::now() - t0) / batch);
+        }
+        Q_UNUSED(sink);
+        const qint64 rss = QQBenchmark::residentSetSize();
+
+        // the generated shortcuts are unique, so this only finds the conflicts of the window itself
+        QQShortcutRegistry *registry = QQShortcutRegistry::instance();
+        t0 = QQBenchmark::now();
+        const int conflicts = registry->isEnabled() ? registry->conflicts().count() : -1;
+        const qint64 conflictScan = QQBenchmark::now() - t0;
+
+        QString line = QStringLiteral("%1 %2 %3 %4 %5 %6 %7 %8")
+            .arg(count, 8).arg(QQBenchmark::formatNsecs(build), 10)
+            .arg(QQBenchmark::formatNsecs(dispatch.median()), 10)
+            .arg(QQBenchmark::formatNsecs(dispatch.percentile(99)), 10)
+            .arg(QQBenchmark::formatNsecs(open.median()), 10)
+            .arg(QQBenchmark::formatNsecs(indexed.median()), 10)
+            .arg(QQBenchmark::formatNsecs(walk.median()), 10)
+            .arg(rss < 0 ? -1.0 : rss / 1048576.0, 8, 'f', 1);
+        if (missed) {
+            line += QStringLiteral(" MISSED=%1").arg(missed);
+            ret = 2;
+        }
+        QQBenchmark::print(line);
+        QJsonObject result;
+        result.insert(QStringLiteral("actions"), count);
+        result.insert(QStringLiteral("menus"), leaves.count());
+        result.insert(QStringLiteral("build_ns"), double(build));
+        result.insert(QStringLiteral("dispatch"), dispatch.toJson());
+        result.insert(QStringLiteral("missed"), missed);
+        result.insert(QStringLiteral("open"), open.toJson());
+        result.insert(QStringLiteral("isMenubarMenuIndex"), indexed.toJson());
+        result.insert(QStringLiteral("isMenubarMenuWalk"), walk.toJson());
+        result.insert(QStringLiteral("rss_bytes"), double(rss));
+        result.insert(QStringLiteral("rss_delta_bytes"), double(rss < 0 || rss0 < 0 ? -1 : rss - rss0));
+        result.insert(QStringLiteral("registeredActions"), registry->isEnabled() ? registry->actionCount() : -1);
+        result.insert(QStringLiteral("conflicts"), conflicts);
+        result.insert(QStringLiteral("conflictScan_ns"), double(conflictScan));
+        results.append(result);
+
+        delete window;
+        if (count >= maxActions) {
+            break;
+        }
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("stress-actions"));
+        report.insert(QStringLiteral("depth"), depth);
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::windowScaling(int maxWindows, bool child, const Options &options)
+{
+    if (child) {
+        const int steps[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+        QList<MainWindow*> windows;
+        QJsonArray results;
+        const qint64 rss0 = QQBenchmark::residentSetSize();
+        for (int count : steps) {
+            count = qMin(count, maxWindows);
+            QQLatencyStats create(QString(), count - windows.count());
+            while (windows.count() < count) {
+                const qint64 t0 = QQBenchmark::now();
+                MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+                window->show();
+                create.addSample(QQBenchmark::now() - t0);
+                windows.append(window);
+            }
+            QApplication::processEvents();
+            const qint64 rss = QQBenchmark::residentSetSize();
+            int actions = qApp->findChildren<QAction*>().count();
+            foreach (const MainWindow *window, windows) {
+                actions += window->findChildren<QAction*>().count();
+            }
+            QJsonObject result;
+            result.insert(QStringLiteral("windows"), count);
+            result.insert(QStringLiteral("create"), create.toJson());
+            result.insert(QStringLiteral("rss_per_window_bytes"), double(rss < 0 || rss0 < 0 ? -1 : (rss - rss0) / count));
+            result.insert(QStringLiteral("actions"), actions);
+            results.append(result);
+            if (count >= maxWindows) {
+                break;
+            }
+        }
+        qDeleteAll(windows);
+        QJsonObject report;
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::print(QString::fromUtf8(QJsonDocument(report).toJson(QJsonDocument::Compact)));
+        return 0;
+    }
+
+    struct Mode {
+        QString name;
+        QStringList arguments;
+    };
+    const Mode modes[] = {
+        { QStringLiteral("per-window actions"), QStringList() },
+        { QStringLiteral("shared actions"), QStringList(QStringLiteral("--shared-actions")) }
+    };
+    QStringList common;
+    common << QStringLiteral("--bench-windows") << QString::number(maxWindows) << QStringLiteral("--bench-windows-child");
+    if (!options.nativeMenuBar) {
+        common << QStringLiteral("--no-native-menubar");
+    }
+    QQBenchmark::print(QStringLiteral("Memory and creation time per window, 1 to %1 windows").arg(maxWindows));
+    QJsonObject results;
+    int ret = 0;
+    for (const Mode &mode : modes) {
+        QProcess process;
+        process.setStandardErrorFile(QProcess::nullDevice());
+        process.start(QCoreApplication::applicationFilePath(), common + mode.arguments);
+        if (!process.waitForFinished(-1) || process.exitCode() != 0) {
+            qWarning() << "window scaling run failed:" << process.errorString();
+            ret = 2;
+            continue;
+        }
+        const QList<QByteArray> lines = process.readAllStandardOutput().trimmed().split('\n');
+        const QJsonArray steps = QJsonDocument::fromJson(lines.last()).object().value(QStringLiteral("results")).toArray();
+        QQBenchmark::print(mode.name);
+        QQBenchmark::print(QStringLiteral("%1 %2 %3 %4")
+            .arg(QStringLiteral("windows"), 8).arg(QStringLiteral("create"), 10)
+            .arg(QStringLiteral("KB/window"), 10).arg(QStringLiteral("actions"), 8));
+        foreach (const QJsonValue &v, steps) {
+            const QJsonObject step = v.toObject();
+            const double rss = step.value(QStringLiteral("rss_per_window_bytes")).toDouble();
+            QQBenchmark::print(QStringLiteral("%1 %2 %3 %4")
+                .arg(step.value(QStringLiteral("windows")).toInt(), 8)
+                .arg(QQBenchmark::formatNsecs(qint64(step.value(QStringLiteral("create")).toObject()
+                                                      .value(QStringLiteral("p50_ns")).toDouble())), 10)
+                .arg(rss < 0 ? -1.0 : rss / 1024.0, 10, 'f', 1)
+                .arg(step.value(QStringLiteral("actions")).toInt(), 8));
+        }
+        results.insert(mode.name, steps);
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("window-scaling"));
+        report.insert(QStringLiteral("maxWindows"), maxWindows);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::actionUpdates(int items, int rounds, const Options &options)
+{
+    const int groupSize = 10;
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    // the same actions in two menus, as with a menubar menu and a context menu
+    QQMenu *menu = new QQMenu(QStringLiteral("Batch"), window.menuBar());
+    QQMenu *mirror = new QQMenu(QStringLiteral("Batch mirror"), window.menuBar());
+    window.menuBar()->addMenu(menu);
+    window.menuBar()->addMenu(mirror);
+    QList<QAction*> actions;
+    QList<QActionGroup*> groups;
+    for (int i = 0; i < items; ++i) {
+        if (i % groupSize == 0) {
+            groups.append(new QActionGroup(menu));
+        }
+        QAction *action = new QAction(QStringLiteral("Batched action %1").arg(i), menu);
+        action->setCheckable(true);
+        groups.last()->addAction(action);
+        actions.append(action);
+    }
+    menu->addActions(actions);
+    mirror->addActions(actions);
+    ActionChangeCounter counter;
+    menu->installEventFilter(&counter);
+    mirror->installEventFilter(&counter);
+
+    static const char *workloadNames[] = { "font reset", "group toggles" };
+    const std::function<void()> workloads[] = {
+        [&actions]() {
+            foreach (QAction *action, actions) {
+                QFont f = action->font();
+                f.setBold(!f.bold());
+                action->setFont(f);
+                f.setBold(!f.bold());
+                action->setFont(f);
+            }
+        },
+        [&groups]() {
+            foreach (QActionGroup *group, groups) {
+                foreach (QAction *action, group->actions()) {
+                    action->setChecked(true);
+                }
+            }
+        }
+    };
+
+    QQBenchmark::print(QStringLiteral("Action updates: %1 items in %2 exclusive groups, shown in 2 menus, %3 rounds")
+        .arg(items).arg(groups.count()).arg(rounds));
+    QJsonArray results;
+    for (int open = 0; open <= 1; ++open) {
+        if (open) {
+            menu->popup(window.mapToGlobal(window.rect().center()));
+            QElapsedTimer timer;
+            timer.start();
+            while (!menu->isVisible() && timer.elapsed() < 2000) {
+                QApplication::processEvents(QEventLoop::AllEvents, 50);
+            }
+        }
+        for (int w = 0; w < 2; ++w) {
+            for (int batched = 0; batched <= 1; ++batched) {
+                const QString name = QStringLiteral("%1, %2, %3").arg(QLatin1String(workloadNames[w]))
+                    .arg(open ? QStringLiteral("menu open") : QStringLiteral("menus closed"))
+                    .arg(batched ? QStringLiteral("batched") : QStringLiteral("unbatched"));
+                QQLatencyStats stats(name, rounds);
+                int events = 0;
+                for (int r = 0; r < rounds; ++r) {
+                    counter.count = 0;
+                    const qint64 t0 = QQBenchmark::now();
+                    if (batched) {
+                        QQActionUpdateBatch batch;
+                        workloads[w]();
+                    } else {
+                        workloads[w]();
+                    }
+                    stats.addSample(QQBenchmark::now() - t0);
+                    events = counter.count;
+                    // let an open menu repaint between rounds
+                    QApplication::processEvents();
+                }
+                QQBenchmark::print(stats.summary() + QStringLiteral(" ActionChanged=%1").arg(events));
+                QJsonObject result = stats.toJson();
+                result.insert(QStringLiteral("workload"), QLatin1String(workloadNames[w]));
+                result.insert(QStringLiteral("menuOpen"), bool(open));
+                result.insert(QStringLiteral("batched"), bool(batched));
+                result.insert(QStringLiteral("actionChangedEvents"), events);
+                results.append(result);
+            }
+        }
+    }
+    menu->close();
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("action-updates"));
+        report.insert(QStringLiteral("items"), items);
+        report.insert(QStringLiteral("rounds"), rounds);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return 0;
+}
+
+int Benchmarks::newWindow(int iterations, int poolSize, const Options &options)
+{
+    MainWindow base(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&base);
+    QQPrewarmPool *pool = MainWindow::windowPool();
+    pool->setFactory([&options]() -> QWidget* {
+        return new MainWindow(3, options.shortCut, options.nativeMenuBar);
+    });
+
+    QQBenchmark::print(QStringLiteral("New Window time-to-visible (%1 iterations, pool size %2)")
+        .arg(iterations).arg(poolSize));
+    QJsonObject results;
+    int ret = 0;
+    for (int prewarm = 0; prewarm <= 1; ++prewarm) {
+        const QString mode = prewarm ? QStringLiteral("prewarmed") : QStringLiteral("not prewarmed");
+        pool->setSize(prewarm ? poolSize : 0);
+        QQLatencyStats slot(QStringLiteral("newWindow(), %1").arg(mode), iterations);
+        QQLatencyStats visible(QStringLiteral("to first paint, %1").arg(mode), iterations);
+        int fromPool = 0;
+        for (int i = 0; i < iterations; ++i) {
+            // the idle time between two clicks
+            QElapsedTimer idle;
+            idle.start();
+            while (pool->available() < pool->size() && idle.elapsed() < 5000) {
+                QApplication::processEvents(QEventLoop::AllEvents, 10);
+            }
+            const bool ready = pool->available() > 0;
+            const QList<MainWindow*> before = base.findChildren<MainWindow*>(QString(), Qt::FindDirectChildrenOnly);
+            const qint64 t0 = QQBenchmark::now();
+            QMetaObject::invokeMethod(&base, "newWindow");
+            const qint64 t1 = QQBenchmark::now();
+            MainWindow *window = nullptr;
+            foreach (MainWindow *w, base.findChildren<MainWindow*>(QString(), Qt::FindDirectChildrenOnly)) {
+                if (!before.contains(w)) {
+                    window = w;
+                }
+            }
+            if (!window) {
+                qWarning() << "newWindow() did not open a window";
+                ret = 2;
+                break;
+            }
+            fromPool += ready ? 1 : 0;
+            PaintProbe probe(window);
+            const qint64 painted = probe.waitForPaint(10000);
+            slot.addSample(t1 - t0);
+            if (painted < 0) {
+                ret = 2;
+            } else {
+                visible.addSample(painted - t0);
+            }
+            delete window;
+        }
+        QQBenchmark::print(slot.summary());
+        QQBenchmark::print(visible.summary() + QStringLiteral(" from pool=%1").arg(fromPool));
+        QJsonObject result;
+        result.insert(QStringLiteral("poolSize"), prewarm ? poolSize : 0);
+        result.insert(QStringLiteral("fromPool"), fromPool);
+        result.insert(QStringLiteral("slot"), slot.toJson());
+        result.insert(QStringLiteral("timeToVisible"), visible.toJson());
+        results.insert(mode, result);
+    }
+    pool->setSize(0);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("new-window"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::startup(int iterations, const Options &options)
+{
+    struct Mode {
+        QString name;
+        QStringList arguments;
+        bool warmUp;
+    };
+    const QStringList common = options.nativeMenuBar ? QStringList() : QStringList(QStringLiteral("--no-native-menubar"));
+    const Mode modes[] = {
+        { QStringLiteral("without key cache"), QStringList(QStringLiteral("--no-style-key-cache")), false },
+        // the first run (re)writes the cache
+        { QStringLiteral("with key cache"), QStringList(), true }
+    };
+
+    QQBenchmark::print(QStringLiteral("Startup time over %1 runs (key cache: %2)")
+        .arg(iterations).arg(QWidgetStyleCache::keyCacheFile()));
+    QJsonObject results;
+    int ret = 0;
+    for (const Mode &mode : modes) {
+        QQLatencyStats process(QStringLiteral("process, %1").arg(mode.name), iterations);
+        QQLatencyStats mainToPaint(QStringLiteral("main() to paint, %1").arg(mode.name), iterations);
+        QQLatencyStats styleMenu(QStringLiteral("style menu, %1").arg(mode.name), iterations);
+        const QStringList arguments = QStringList(QStringLiteral("--startup-probe")) + common + mode.arguments;
+        for (int i = mode.warmUp ? -1 : 0; i < iterations; ++i) {
+            QProcess child;
+            child.setStandardErrorFile(QProcess::nullDevice());
+            QElapsedTimer timer;
+            timer.start();
+            child.start(QCoreApplication::applicationFilePath(), arguments);
+            if (!child.waitForFinished(30000) || child.exitCode() != 0) {
+                qWarning() << "startup probe failed:" << child.errorString();
+                ret = 2;
+                continue;
+            }
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (i < 0) {
+                continue;
+            }
+            const QList<QByteArray> lines = child.readAllStandardOutput().trimmed().split('\n');
+            const QJsonObject probe = QJsonDocument::fromJson(lines.last()).object();
+            process.addSample(elapsed);
+            mainToPaint.addSample(qint64(probe.value(QStringLiteral("main_to_paint_ns")).toDouble()));
+            styleMenu.addSample(qint64(probe.value(QStringLiteral("style_menu_ns")).toDouble()));
+        }
+        QQBenchmark::print(process.summary());
+        QQBenchmark::print(mainToPaint.summary());
+        QQBenchmark::print(styleMenu.summary());
+        QJsonObject result;
+        result.insert(QStringLiteral("process"), process.toJson());
+        result.insert(QStringLiteral("mainToPaint"), mainToPaint.toJson());
+        result.insert(QStringLiteral("styleMenu"), styleMenu.toJson());
+        results.insert(mode.name, result);
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("startup"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::styleScaling(int maxWindows, int iterations, const Options &options)
+{
+    QWidgetStyleCache *cache = QWidgetStyleCache::instance();
+    const QStringList styles = cache->styleKeys();
+    const QString home = QApplication::style()->objectName();
+    QQBenchmark::print(QStringLiteral("Style switch cost with 1 to %1 windows (%2 cycles through %3 styles)")
+        .arg(maxWindows).arg(iterations).arg(styles.count()));
+    QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5 %6")
+        .arg(QStringLiteral("windows"), 8).arg(QStringLiteral("style"), -16).arg(QStringLiteral("construct"), 10)
+        .arg(QStringLiteral("apply"), 10).arg(QStringLiteral("paint"), 10).arg(QStringLiteral("total"), 10));
+    QJsonArray results;
+    int ret = 0;
+    QList<QWidget*> windows;
+    for (int count = 1; ; count = qMin(count * 2, maxWindows)) {
+        while (windows.count() < count) {
+            MainWindow *window = new MainWindow(3, options.shortCut, options.nativeMenuBar);
+            window->show();
+            windows.append(window);
+        }
+        PaintProbe probe(windows);
+        probe.waitForPaint(10000);
+
+        foreach (const QString &style, styles) {
+            // the style to switch to between iterations, so that each one is a real switch
+            QString away = home;
+            if (style.compare(home, Qt::CaseInsensitive) == 0) {
+                away = style.compare(styles.first(), Qt::CaseInsensitive) ? styles.first() : styles.value(1);
+            }
+            if (away.isEmpty()) {
+                continue;
+            }
+            // constructing the style is a one-time cost with the cache
+            qint64 t0 = QQBenchmark::now();
+            const bool wasCached = cache->contains(style);
+            cache->style(style);
+            const qint64 construct = wasCached ? 0 : QQBenchmark::now() - t0;
+
+            QQLatencyStats apply(QString(), iterations), paint(QString(), iterations), total(QString(), iterations);
+            for (int i = 0; i < iterations; ++i) {
+                probe.reset();
+                t0 = QQBenchmark::now();
+                // setStyle() polishes all widgets and sends their StyleChange events synchronously
+                cache->activate(style);
+                const qint64 t1 = QQBenchmark::now();
+                const qint64 t2 = probe.waitForPaint(10000);
+                if (t2 < 0) {
+                    ret = 2;
+                } else {
+                    apply.addSample(t1 - t0);
+                    paint.addSample(t2 - t1);
+                    total.addSample(t2 - t0);
+                }
+                cache->activate(away);
+                probe.reset();
+                probe.waitForPaint(10000);
+            }
+            QQBenchmark::print(QStringLiteral("%1 %2 %3 %4 %5 %6")
+                .arg(count, 8).arg(style, -16).arg(QQBenchmark::formatNsecs(construct), 10)
+                .arg(QQBenchmark::formatNsecs(apply.median()), 10)
+                .arg(QQBenchmark::formatNsecs(paint.median()), 10)
+                .arg(QQBenchmark::formatNsecs(total.median()), 10));
+            QJsonObject result;
+            result.insert(QStringLiteral("windows"), count);
+            result.insert(QStringLiteral("style"), style);
+            result.insert(QStringLiteral("construct_ns"), double(construct));
+            result.insert(QStringLiteral("apply"), apply.toJson());
+            result.insert(QStringLiteral("paint"), paint.toJson());
+            result.insert(QStringLiteral("total"), total.toJson());
+            results.append(result);
+        }
+        if (count >= maxWindows) {
+            break;
+        }
+    }
+    cache->activate(home);
+    qDeleteAll(windows);
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("style-scaling"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::recordReplay(const Options &options)
+{
+    const QKeySequence seq(options.shortCut);
+    if (seq.count() != 1) {
+        qWarning() << "The recorder cannot capture multi-key shortcuts; use a single key combination instead of"
+            << options.shortCut;
+        return 1;
+    }
+    QTemporaryDir scratch;
+    const QString fileName = scratch.filePath(QStringLiteral("shortcut.qqev"));
+    const int key = seq[0] & ~Qt::KeyboardModifierMask;
+    const Qt::KeyboardModifiers modifiers = Qt::KeyboardModifiers(QFlag(seq[0] & Qt::KeyboardModifierMask));
+
+    QQEventRecorder recorder("MainWindow");
+    if (!scratch.isValid() || !recorder.start(fileName)) {
+        return 1;
+    }
+    int recordedFired;
+    {
+        MainWindow window(3, options.shortCut, options.nativeMenuBar);
+        showAndActivate(&window);
+        // as the platform plugin delivers a key: spontaneously, and through the shortcut map
+        QWindowSystemInterface::setSynchronousWindowSystemEvents(true);
+        QWindowSystemInterface::handleKeyEvent(window.windowHandle(), QEvent::KeyPress, key, modifiers);
+        QWindowSystemInterface::handleKeyEvent(window.windowHandle(), QEvent::KeyRelease, key, modifiers);
+        QWindowSystemInterface::setSynchronousWindowSystemEvents(false);
+        recordedFired = window.shortCutDispatchCount();
+    }
+    const quint64 recorded = recorder.count();
+    recorder.stop();
+
+    QQEventReplayer replayer("MainWindow");
+    if (!replayer.open(fileName)) {
+        return 1;
+    }
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    QEventLoop loop;
+    QObject::connect(&replayer, &QQEventReplayer::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    replayer.start(0);
+    loop.exec();
+    const int replayedFired = window.shortCutDispatchCount();
+
+    QQBenchmark::print(QStringLiteral("\"%1\": fired %2 time(s) while recording %3 event(s), %4 time(s) on replay")
+        .arg(seq.toString(QKeySequence::PortableText)).arg(recordedFired).arg(recorded).arg(replayedFired));
+    foreach (const QString &line, replayer.report()) {
+        QQBenchmark::print(line);
+    }
+    const bool passed = recordedFired == 1 && replayedFired == 1;
+    QQBenchmark::print(passed ? QStringLiteral("PASS") : QStringLiteral("FAIL"));
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report = replayer.toJson();
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("record-replay"));
+        report.insert(QStringLiteral("shortcut"), seq.toString(QKeySequence::PortableText));
+        report.insert(QStringLiteral("recorded"), double(recorded));
+        report.insert(QStringLiteral("firedWhileRecording"), recordedFired);
+        report.insert(QStringLiteral("firedOnReplay"), replayedFired);
+        report.insert(QStringLiteral("passed"), passed);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return passed ? 0 : 2;
+}
+
+int Benchmarks::menuOpen(int iterations, const Options &options)
+{
+    MainWindow window(3, options.shortCut, options.nativeMenuBar);
+    showAndActivate(&window);
+    QMenuBar *menuBar = window.menuBar();
+    QList<QAction*> menuActions;
+    foreach (QAction *action, menuBar->actions()) {
+        if (action->menu() && action->isVisible()) {
+            menuActions.append(action);
+        }
+    }
+    if (menuActions.isEmpty()) {
+        qWarning() << "no menus to open";
+        return 1;
+    }
+
+    QQBenchmark::print(QStringLiteral("Menubar menu open latency (%1 iterations per menu)").arg(iterations));
+    QJsonObject results;
+    int ret = 0;
+    foreach (QAction *action, menuActions) {
+        QMenu *menu = action->menu();
+        const QString title = action->text().remove(QLatin1Char('&'));
+        const QPoint globalPos = menuBar->mapToGlobal(menuBar->actionGeometry(action).bottomLeft());
+        PaintProbe probe(menu);
+        QQLatencyStats popup(QStringLiteral("%1 popup()").arg(title), iterations);
+        QQLatencyStats painted(QStringLiteral("%1 to first paint").arg(title), iterations);
+        qint64 first = -1;
+        // the first opening (which lays out and polishes the menu) is reported separately
+        for (int i = -1; i < iterations; ++i) {
+            probe.reset();
+            const qint64 t0 = QQBenchmark::now();
+            menu->popup(globalPos);
+            const qint64 t1 = QQBenchmark::now();
+            const qint64 t2 = probe.waitForPaint();
+            menu->hide();
+            QApplication::processEvents();
+            if (t2 < 0) {
+                ret = 2;
+            } else if (i < 0) {
+                first = t2 - t0;
+            } else {
+                popup.addSample(t1 - t0);
+                painted.addSample(t2 - t0);
+            }
+        }
+        QQBenchmark::print(popup.summary());
+        QQBenchmark::print(painted.summary() + QStringLiteral(" first=%1").arg(QQBenchmark::formatNsecs(first)));
+        QJsonObject result;
+        result.insert(QStringLiteral("items"), menu->actions().count());
+        result.insert(QStringLiteral("first_ns"), double(first));
+        result.insert(QStringLiteral("popup"), popup.toJson());
+        result.insert(QStringLiteral("paint"), painted.toJson());
+        results.insert(title, result);
+    }
+
+    if (!options.jsonFile.isEmpty()) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("menu-open"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("results"), results);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return ret;
+}
+
+int Benchmarks::runAll(const QString &baselineFile, double threshold, const Options &options)
+{
+    struct Scenario {
+        QString name;
+        QStringList arguments;
+    };
+    // fixed iteration counts, so that results remain comparable with older baselines
+    const Scenario scenarios[] = {
+        { QStringLiteral("startup"), QStringList() << QStringLiteral("--bench-startup") << QStringLiteral("5") },
+        { QStringLiteral("menu-open"), QStringList() << QStringLiteral("--bench-menus") << QStringLiteral("20") },
+        { QStringLiteral("context-menu"), QStringList() << QStringLiteral("--soak-context-menu") << QStringLiteral("200") },
+        { QStringLiteral("shortcut-dispatch"), QStringList() << QStringLiteral("--bench-shortcut") << QStringLiteral("200") },
+        { QStringLiteral("style-switch"), QStringList() << QStringLiteral("--bench-style-switch") << QStringLiteral("10") },
+        { QStringLiteral("new-window"), QStringList() << QStringLiteral("--bench-new-window") << QStringLiteral("10") }
+    };
+    QStringList common = QStringList() << QStringLiteral("--shortcut") << options.shortCut;
+    if (!options.nativeMenuBar) {
+        common << QStringLiteral("--no-native-menubar");
+    }
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("QT_QPA_PLATFORM"), QStringLiteral("offscreen"));
+    QTemporaryDir scratch;
+    if (!scratch.isValid()) {
+        qWarning() << "cannot create a directory for the scenario results";
+        return 1;
+    }
+
+    QQBenchmark::print(QStringLiteral("Running %1 scenarios on the offscreen platform")
+        .arg(int(sizeof(scenarios) / sizeof(scenarios[0]))));
+    QJsonObject results;
+    int ret = 0;
+    for (const Scenario &scenario : scenarios) {
+        const QString jsonFile = scratch.filePath(scenario.name + QStringLiteral(".json"));
+        const QStringList arguments = scenario.arguments + common
+            + (QStringList() << QStringLiteral("--bench-json") << jsonFile);
+        QQBenchmark::print(QStringLiteral("== %1: %2").arg(scenario.name, arguments.join(QLatin1Char(' '))));
+        QProcess child;
+        child.setProcessEnvironment(environment);
+        // the scenario reports are part of ours
+        child.setProcessChannelMode(QProcess::ForwardedChannels);
+        QElapsedTimer timer;
+        timer.start();
+        child.start(QCoreApplication::applicationFilePath(), arguments);
+        const bool finished = child.waitForFinished(600000);
+        const qint64 elapsed = timer.nsecsElapsed();
+        const int exitCode = finished && child.exitStatus() == QProcess::NormalExit ? child.exitCode() : -1;
+        if (exitCode != 0) {
+            qWarning() << "scenario" << scenario.name << "failed:" << (finished ? QString::number(exitCode) : child.errorString());
+            ret = 2;
+        }
+        QJsonObject result;
+        result.insert(QStringLiteral("arguments"), QJsonArray::fromStringList(scenario.arguments));
+        result.insert(QStringLiteral("exitCode"), exitCode);
+        result.insert(QStringLiteral("wall_ns"), double(elapsed));
+        if (QFile::exists(jsonFile)) {
+            result.insert(QStringLiteral("results"), QQBenchmark::readJson(jsonFile));
+        }
+        results.insert(scenario.name, result);
+    }
+
+    QJsonObject report;
+    report.insert(QStringLiteral("benchmark"), QStringLiteral("all"));
+    report.insert(QStringLiteral("qtVersion"), QString::fromLatin1(qVersion()));
+    report.insert(QStringLiteral("platform"), QStringLiteral("offscreen"));
+    report.insert(QStringLiteral("nativeMenuBar"), options.nativeMenuBar);
+    report.insert(QStringLiteral("scenarios"), results);
+    const QString resultFile = options.jsonFile.isEmpty() ? QStringLiteral("benchmark-all.json") : options.jsonFile;
+    QQBenchmark::writeJson(resultFile, report);
+    if (resultFile != QStringLiteral("-")) {
+        QQBenchmark::print(QStringLiteral("Results written to %1").arg(resultFile));
+    }
+
+    if (!baselineFile.isEmpty()) {
+        const QJsonObject baseline = QQBenchmark::readJson(baselineFile);
+        if (baseline.isEmpty()) {
+            return 1;
+        }
+        int regressions = 0;
+        compareReports(report, baseline, threshold, &regressions);
+        if (regressions) {
+            ret = 3;
+        }
+    }
+    return ret;
+}
+
+int Benchmarks::compare(const QString &resultFile, const QString &baselineFile, double threshold,
+                        const Options &options)
+{
+    const QJsonObject results = QQBenchmark::readJson(resultFile);
+    const QJsonObject baseline = QQBenchmark::readJson(baselineFile);
+    if (results.isEmpty() || baseline.isEmpty()) {
+        return 1;
+    }
+    int regressions = 0;
+    QJsonObject report = compareReports(results, baseline, threshold, &regressions);
+    if (!options.jsonFile.isEmpty()) {
+        report.insert(QStringLiteral("results"), resultFile);
+        report.insert(QStringLiteral("baseline"), baselineFile);
+        QQBenchmark::writeJson(options.jsonFile, report);
+    }
+    return regressions ? 3 : 0;
+}
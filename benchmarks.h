@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QString>
+
+QT_BEGIN_NAMESPACE
+class QKeySequence;
+class QWidget;
+QT_END_NAMESPACE
+
+class QQApplication;
+
+/**
+ * The benchmark modes of the menus application. Each of them runs
+ * to completion from main() (no app.exec()), prints a report to stdout,
+ * optionally writes JSON and returns the process exit code.
+ */
+namespace Benchmarks
+{
+    struct Options {
+        QString shortCut;
+        bool nativeMenuBar;
+        // write the results as JSON to this file ("-" for stdout)
+        QString jsonFile;
+    };
+
+    /**
+     * Injects @p iterations synthetic key events for Options::shortCut into
+     * a MainWindow and measures the delay until MainWindow::shortCutActHandler()
+     * runs, for each placement of the shortcut test action.
+     */
+    int shortcutDispatch(int iterations, const Options &options);
+
+    /**
+     * Compares the QQMenuAncestry index lookup with the recursive
+     * associatedWidgets() walk, for menus nested 1 to @p depth levels
+     * below the menubar.
+     */
+    int menuAncestry(int depth, int iterations, const Options &options);
+
+    /**
+     * Opens and closes the window's context menu @p iterations times through
+     * QContextMenuEvents and reports the open latency and the resident set
+     * size over the course of the run, which should both remain flat.
+     */
+    int contextMenuSoak(int iterations, const Options &options);
+
+    /**
+     * Measures menu-open and mouse-click latency with the shortcuttest.*
+     * logging categories disabled and enabled.
+     */
+    int logging(int iterations, const Options &options);
+
+    /**
+     * Sends SIGUSR1 to the process @p iterations times and measures the delay
+     * until QQApplication::interruptSignalReceived() is emitted in the GUI thread,
+     * using the signal backend @p app was configured with. The thread and file
+     * descriptor counts are reported relative to @p baselineThreads and
+     * @p baselineFds, taken before any signal was caught.
+     */
+    int signalDelivery(QQApplication *app, int iterations, int baselineThreads, int baselineFds,
+                       const Options &options);
+
+    /**
+     * Measures the cost per event of QQApplication::notify() with the notify
+     * profiler off and on, by sending @p iterations events to a plain QObject
+     * in batches of 1000.
+     */
+    int notifyOverhead(QQApplication *app, int iterations, const Options &options);
+
+    /**
+     * Compares the sem_t and futex wait backends of QQNativeSemaphore (in native
+     * mode) over @p iterations uncontended trigger/wait pairs in a single thread
+     * and @p iterations contended ping-pong round trips between two threads.
+     */
+    int semaphore(int iterations, const Options &options);
+
+    /**
+     * Enables 1, 10, 100, ... up to @p maxInstances non-native QQNativeSemaphores
+     * with dedicated and with shared monitors, and reports the thread count,
+     * memory use and trigger-to-emit latency over @p iterations triggers.
+     */
+    int semaphoreScaling(int maxInstances, int iterations, const Options &options);
+
+    /**
+     * Runs the shutdown sequence of @p app @p iterations times with @p windows
+     * open windows (without re-raising the signal) and reports the duration
+     * of each stage and the longest event loop stall during the sequence.
+     */
+    int shutdown(QQApplication *app, int windows, int iterations, const Options &options);
+
+    /**
+     * Measures the time from activating each available widget style to the
+     * first paint of the window, over @p iterations switches with the style
+     * cache disabled and enabled. The very first switch to each style is
+     * reported separately, as it includes loading the plugin (unless the
+     * styles were preloaded).
+     */
+    int styleSwitch(int iterations, const Options &options);
+
+    /**
+     * Starts this executable @p iterations times in --startup-probe mode,
+     * with and without the style key cache, and reports the process run
+     * time, the time from main() to the first paint and the time it takes
+     * to fill the Widget Style menu.
+     */
+    int startup(int iterations, const Options &options);
+
+    /**
+     * Opens 1, 2, 4, ... up to @p maxWindows windows and switches to each
+     * available style @p iterations times, timing the construction of the
+     * style, setStyle() with the polish of all widgets, and the repaint
+     * of all windows.
+     */
+    int styleScaling(int maxWindows, int iterations, const Options &options);
+    /**
+     * The child side of startup(): opens a MainWindow, waits for its first
+     * paint, fills the Widget Style menu and prints the timings as JSON.
+     */
+    int startupProbe(const Options &options);
+
+    /**
+     * Completes the startup profile begun in main(): opens a MainWindow and
+     * waits for its first paint, in profiled phases, and prints the tree of
+     * phase timings. With @p runs > 1 the median of @p runs cold starts (this
+     * process and fresh child processes) and of @p runs warm window openings
+     * in this process are reported. With @p child set the phases are only
+     * printed as JSON, for the parent process.
+     */
+    int startupProfile(int runs, bool child, const Options &options);
+
+    /**
+     * Constructs @p windows MainWindows with all actions created up front and
+     * with the actions without shortcuts created lazily, and reports the
+     * construction time, the time spent in createActions() and the number
+     * of QActions created per window.
+     */
+    int actionCreation(int windows, const Options &options);
+
+    /**
+     * Adds 100, 1000, ... up to @p maxActions generated actions with unique
+     * shortcuts in menus nested @p depth deep to a fresh MainWindow and reports,
+     * for each count, the shortcut dispatch latency and menu open time over
+     * @p iterations samples, the cost of an isMenubarMenu() lookup on the
+     * deepest menu and the resident set size.
+     */
+    int stressActions(int maxActions, int depth, int iterations, const Options &options);
+
+    /**
+     * Changes the properties of @p items actions shown in two menus, with and
+     * without a QQActionUpdateBatch, and reports the time and the number of
+     * ActionChanged events the menus received over @p rounds rounds. The
+     * workloads are the double setFont() of SET_MENUFONT and a walk through
+     * exclusive QActionGroups of 10; both run with the menus closed and with
+     * one of them open.
+     */
+    int actionUpdates(int items, int rounds, const Options &options);
+
+    /**
+     * Opens 1, 2, 5, 10, ... up to @p maxWindows windows and reports the memory
+     * use and creation time per window, and the number of QActions, with
+     * per-window and with shared actions. Each mode runs in a child process
+     * (with @p child set), so they don't share a heap.
+     */
+    int windowScaling(int maxWindows, bool child, const Options &options);
+
+    /**
+     * Invokes MainWindow::newWindow() @p iterations times without and with a
+     * prewarmed window pool of @p poolSize, and reports the time spent in the
+     * slot and the time until the new window has painted (time-to-visible).
+     * With prewarming, the pool is given time to refill between iterations,
+     * as it would between clicks.
+     */
+    int newWindow(int iterations, int poolSize, const Options &options);
+
+    /**
+     * Checks that a shortcut survives a recording: records Options::shortCut
+     * pressed in a MainWindow through the platform's input path, replays the
+     * recording into a new MainWindow and verifies that the shortcut fired
+     * its action once in each. Returns 2 when it did not.
+     */
+    int recordReplay(const Options &options);
+
+    /**
+     * Opens each menu of the menubar @p iterations times with QMenu::popup()
+     * and reports the time spent in popup() and the time until the menu
+     * has painted.
+     */
+    int menuOpen(int iterations, const Options &options);
+
+    /**
+     * Runs the regression suite: startup, opening each menubar menu, opening
+     * the context menu, shortcut dispatch, style switching and New Window,
+     * each in a child process on the offscreen platform. The combined results
+     * are written to Options::jsonFile (benchmark-all.json by default). When
+     * @p baselineFile is given, they are then compared with it as by compare().
+     */
+    int runAll(const QString &baselineFile, double threshold, const Options &options);
+
+    /**
+     * Compares each latency in the results in @p resultFile (any object with
+     * count, mean_ns and stddev_ns) with the latency at the same place in
+     * @p baselineFile, using Welch's t-test. A latency has regressed when its
+     * mean grew by more than @p threshold percent and the growth is significant
+     * at the 1% level. Returns 3 if any latency regressed.
+     */
+    int compare(const QString &resultFile, const QString &baselineFile, double threshold,
+                const Options &options);
+
+    /**
+     * Shows @p w, makes it the active window and waits (for at most @p timeOut ms)
+     * until the window system agrees. Returns true when the window is active.
+     */
+    bool showAndActivate(QWidget *w, int timeOut = 2000);
+    /**
+     * Delivers @p seq to @p target as synthetic (non-spontaneous) key press/release
+     * pairs, which QApplication routes through the shortcut map first.
+     */
+    void sendKeySequence(QWidget *target, const QKeySequence &seq);
+}
+
+#endif
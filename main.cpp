@@ -49,148 +49,473 @@
 ****************************************************************************/
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+#include <QSocketNotifier>
 #include <QString>
-#ifndef USE_QSOCKETNOTIFIER
 #include "qqnativesemaphore.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
 #endif
 
 #include <QDebug>
 
 #include "main.h"
 #include "mainwindow.h"
+#include "benchmarks.h"
+#include "qqbenchmark.h"
+#include "qqlogging.h"
+#include "qqshutdown.h"
+#include "qqshortcutregistry.h"
+#include "qqprewarmpool.h"
+#include "qqeventrecorder.h"
+#include "qqstallwatchdog.h"
+#include "qqnotifyprofiler.h"
+#include "qwidgetstyleselector.h"
 
 QQApplication *QQApplication::theApp = nullptr;
+sigset_t QQApplication::preBlockedSignals;
 
 QQApplication::QQApplication(int &argc, char **argv)
     : QApplication(argc, argv)
+    , m_signalBackend(SemaphoreBackend)
+    , m_signalBackendReady(false)
+    , m_signalReadFd(-1)
+    , m_signalWriteFd(-1)
+    , m_signalNotifier(nullptr)
+    , m_sem(nullptr)
+    , m_shutdown(new QQShutdownSequence(this))
+    , m_notifyProfiler(nullptr)
+    , m_notifyProfilerData(nullptr)
     , m_signalReceived(0)
 {
 //         A "proper" exit-on-sigHUP approach:
-//         Open a pipe or an eventfd, then install your signal handler. In that signal 
-//         handler, write anything to the writing end or write uint64_t(1) the eventfd. 
-//         Create a QSocketNotifier on the reading end of the pipe or on the eventfd, 
+//         Open a pipe or an eventfd, then install your signal handler. In that signal 
+//         handler, write anything to the writing end or write uint64_t(1) the eventfd. 
+//         Create a QSocketNotifier on the reading end of the pipe or on the eventfd, 
 //         connect its activation signal to a slot that does what you want.
+//         On Linux a signalfd does away with the signal handler altogether.
+    sigemptyset(&m_signalFdSet);
+    sigemptyset(&m_terminatingSignals);
+    for (int i = 0; i < NSIG; ++i) {
+        m_pendingSignal[i] = false;
+    }
+    connect(m_shutdown, &QQShutdownSequence::finished, this, &QQApplication::terminateWithSignal);
+}
+
+QString QQApplication::signalBackendName(SignalBackend backend)
+{
+    switch (backend) {
+        case PipeBackend:
+            return QStringLiteral("pipe");
+        case SemaphoreBackend:
+            return QStringLiteral("semaphore");
+        case SignalFdBackend:
+            return QStringLiteral("signalfd");
+        case EventFdBackend:
+            return QStringLiteral("eventfd");
+    }
+    return QString();
+}
+
+QQApplication::SignalBackend QQApplication::signalBackendFromName(const QString &name, bool *ok)
+{
+    const SignalBackend backends[] = { PipeBackend, SemaphoreBackend, SignalFdBackend, EventFdBackend };
+    for (SignalBackend backend : backends) {
+        if (name.compare(signalBackendName(backend), Qt::CaseInsensitive) == 0) {
+            if (ok) {
+                *ok = true;
+            }
+            return backend;
+        }
+    }
+    if (ok) {
+        *ok = false;
+    }
+    return SemaphoreBackend;
+}
 
-#ifdef USE_QSOCKETNOTIFIER
-    if (!theApp) {
-        int pp[2];
-        if (pipe(pp)) {
-            qErrnoWarning("Error opening SIGHUP handler pipe");
-        } else {
-            theApp = this;
-            sigHUPPipeRead = pp[0];
-            sigHUPPipeWrite = pp[1];
-            sigHUPNotifier = new QSocketNotifier(sigHUPPipeRead, QSocketNotifier::Read);
-            connect(sigHUPNotifier, &QSocketNotifier::activated, this, &QQApplication::handleHUP_int);
-            qWarning() << Q_FUNC_INFO << sigHUPNotifier << "calls handleHUP via pipe" << sigHUPPipeRead;
-            signal(SIGHUP, signalhandler);
-            signal(SIGINT, signalhandler);
-            signal(SIGTERM, signalhandler);
+QQApplication::SignalBackend QQApplication::signalBackendFromArguments(int argc, char **argv)
+{
+    // QCommandLineParser needs the application instance, which we cannot
+    // wait for, so do a minimal scan of our own.
+    const QByteArray option("-signal-backend");
+    QByteArray value;
+    for (int i = 1; i < argc; ++i) {
+        QByteArray arg(argv[i]);
+        if (arg.startsWith("--")) {
+            arg.remove(0, 1);
+        }
+        if (arg == option && i + 1 < argc) {
+            value = argv[i + 1];
+        } else if (arg.startsWith(option + '=')) {
+            value = arg.mid(option.size() + 1);
         }
     }
+    if (value.isEmpty()) {
+        return SemaphoreBackend;
+    }
+    bool ok;
+    const SignalBackend backend = signalBackendFromName(QString::fromLocal8Bit(value), &ok);
+    if (!ok) {
+        qWarning() << "Unknown signal backend" << value << "; using" << signalBackendName(backend);
+    }
+    return backend;
+}
+
+void QQApplication::prepareSignalBackend(SignalBackend backend)
+{
+    sigemptyset(&preBlockedSignals);
+#ifdef Q_OS_LINUX
+    if (backend == SignalFdBackend) {
+#ifdef SIGHUP
+        sigaddset(&preBlockedSignals, SIGHUP);
+#endif
+        sigaddset(&preBlockedSignals, SIGINT);
+        sigaddset(&preBlockedSignals, SIGTERM);
+        sigaddset(&preBlockedSignals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &preBlockedSignals, nullptr);
+    }
 #else
-    m_sem = nullptr;
+    Q_UNUSED(backend);
 #endif
 }
 
-#ifndef USE_QSOCKETNOTIFIER
+void QQApplication::setSignalBackend(SignalBackend backend)
+{
+    if (m_signalBackendReady) {
+        qWarning() << Q_FUNC_INFO << "the signal backend is already set up as" << signalBackendName(m_signalBackend);
+        return;
+    }
+    m_signalBackend = backend;
+}
 
-QQApplication::InterruptSignalHandler QQApplication::catchInterruptSignal(int sig)
+bool QQApplication::setupSignalBackend()
 {
-   if (!theApp) {
-      theApp = this;
-   }
-   if (!m_sem) {
-       m_sem = new QQNativeSemaphore(false, false, 1);
-       m_sem->setObjectName(QStringLiteral("signal monitor"));
-       connect(m_sem, &QQNativeSemaphore::triggered, this, &QQApplication::handleHUP_qvar, Qt::BlockingQueuedConnection);
-       m_sem->setEnabled(true);
-   }
-   if (m_sem->isEnabled()) {
-      return signal(sig, signalhandler);
-   } else {
-      return nullptr;
-   }
+    if (m_signalBackendReady) {
+        return true;
+    }
+    if (theApp && theApp != this) {
+        qWarning() << Q_FUNC_INFO << "signals are already handled by" << theApp;
+        return false;
+    }
+    theApp = this;
+    switch (m_signalBackend) {
+        case SignalFdBackend:
+#ifdef Q_OS_LINUX
+            m_signalReadFd = signalfd(-1, &m_signalFdSet, SFD_NONBLOCK | SFD_CLOEXEC);
+            if (m_signalReadFd != -1) {
+                break;
+            }
+            qErrnoWarning("Error creating a signalfd, falling back to eventfd");
+#endif
+            // the fallback uses a signal handler, which needs the signals unblocked
+            pthread_sigmask(SIG_UNBLOCK, &preBlockedSignals, nullptr);
+            m_signalBackend = EventFdBackend;
+            // fall through
+        case EventFdBackend:
+#ifdef Q_OS_LINUX
+            m_signalReadFd = m_signalWriteFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_signalReadFd != -1) {
+                break;
+            }
+            qErrnoWarning("Error creating an eventfd, falling back to a pipe");
+#endif
+            m_signalBackend = PipeBackend;
+            // fall through
+        case PipeBackend: {
+            int pp[2];
+            if (pipe(pp)) {
+                qErrnoWarning("Error opening SIGHUP handler pipe");
+                return false;
+            }
+            m_signalReadFd = pp[0];
+            m_signalWriteFd = pp[1];
+            // neither the reader nor the signal handler should ever block
+            fcntl(m_signalReadFd, F_SETFL, fcntl(m_signalReadFd, F_GETFL) | O_NONBLOCK);
+            fcntl(m_signalWriteFd, F_SETFL, fcntl(m_signalWriteFd, F_GETFL) | O_NONBLOCK);
+            break;
+        }
+        case SemaphoreBackend:
+            m_sem = new QQNativeSemaphore(false, false, 1);
+            m_sem->setObjectName(QStringLiteral("signal monitor"));
+            connect(m_sem, &QQNativeSemaphore::triggered, this, &QQApplication::handleHUP_qvar, Qt::BlockingQueuedConnection);
+            m_sem->setEnabled(true);
+            break;
+    }
+    if (m_signalReadFd != -1) {
+        m_signalNotifier = new QSocketNotifier(m_signalReadFd, QSocketNotifier::Read, this);
+        connect(m_signalNotifier, &QSocketNotifier::activated, this, &QQApplication::readSignalNotifier);
+    }
+    qqCDebug(lcSignals) << Q_FUNC_INFO << "signals are delivered via" << signalBackendName(m_signalBackend)
+        << "fd=" << m_signalReadFd;
+    m_signalBackendReady = true;
+    return true;
+}
+
+void QQApplication::shutdownSignalBackend()
+{
+    if (m_sem && m_sem->isEnabled()) {
+        qWarning() << "\tdeactivating signal monitor";
+        m_sem->setEnabled(false);
+    }
+    if (m_signalNotifier) {
+        m_signalNotifier->setEnabled(false);
+    }
+    if (m_signalReadFd != -1) {
+        close(m_signalReadFd);
+    }
+    if (m_signalWriteFd != -1 && m_signalWriteFd != m_signalReadFd) {
+        close(m_signalWriteFd);
+    }
+    m_signalReadFd = m_signalWriteFd = -1;
 }
+
+QQApplication::InterruptSignalHandler QQApplication::catchInterruptSignal(int sig, bool terminate)
+{
+    if (sig <= 0 || sig >= NSIG || !setupSignalBackend()) {
+        return nullptr;
+    }
+    if (terminate) {
+        sigaddset(&m_terminatingSignals, sig);
+    } else {
+        sigdelset(&m_terminatingSignals, sig);
+    }
+    switch (m_signalBackend) {
+#ifdef Q_OS_LINUX
+        case SignalFdBackend: {
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, sig);
+            pthread_sigmask(SIG_BLOCK, &set, nullptr);
+            sigaddset(&m_signalFdSet, sig);
+            if (signalfd(m_signalReadFd, &m_signalFdSet, 0) == -1) {
+                qErrnoWarning("Error adding signal %d to the signalfd", sig);
+                return nullptr;
+            }
+            return SIG_DFL;
+        }
 #endif
+        case SemaphoreBackend:
+            if (!m_sem->isEnabled()) {
+                return nullptr;
+            }
+            // fall through
+        default:
+            return signal(sig, signalhandler);
+    }
+}
+
+int QQApplication::signalCountdown() const
+{
+    return m_sem ? m_sem->value() : 0;
+}
+
+void QQApplication::setSignalCountdown(int count)
+{
+    if (m_sem) {
+        m_sem->setValue(count);
+    }
+}
 
 QQApplication::~QQApplication()
 {
    qWarning() << Q_FUNC_INFO;
-#ifdef USE_QSOCKETNOTIFIER
-   if (sigHUPPipeRead != -1) {
-      close(sigHUPPipeRead);
-   }
-   if (sigHUPPipeWrite != -1) {
-      close(sigHUPPipeWrite);
-   }
-   delete sigHUPNotifier;
-#else
+   shutdownSignalBackend();
+   delete m_signalNotifier;
    delete m_sem;
-#endif
+   if (theApp == this) {
+       theApp = nullptr;
+   }
+   // stop new measurements first. Events in other threads (which can outlive
+   // us, up to ~QApplication()) may still be inside one, so the profiler is
+   // deliberately leaked rather than deleted under them.
+   m_notifyProfiler = nullptr;
+   m_notifyProfilerData = nullptr;
+}
+
+void QQApplication::setNotifyProfiling(bool enabled)
+{
+    if (enabled && !m_notifyProfilerData) {
+        m_notifyProfilerData = new QQNotifyProfiler;
+    }
+    m_notifyProfiler = enabled ? m_notifyProfilerData : nullptr;
+}
+
+bool QQApplication::notify(QObject *receiver, QEvent *event)
+{
+    QQNotifyProfiler *profiler = m_notifyProfiler.load(std::memory_order_relaxed);
+    if (Q_LIKELY(!profiler)) {
+        return QApplication::notify(receiver, event);
+    }
+    QQNotifyProfiler::Measurement measurement(profiler, receiver, event);
+    return QApplication::notify(receiver, event);
 }
 
 void QQApplication::signalhandler(int sig)
 {
    theApp->m_signalReceived = sig;
-#ifdef USE_QSOCKETNOTIFIER
-   if (theApp->sigHUPPipeWrite != -1) {
-      qCritical() << Q_FUNC_INFO << "signal" << sig << "received";
-      write(theApp->sigHUPPipeWrite, &sig, sizeof(sig));
-      qCritical() << Q_FUNC_INFO << "trigger sent.";
-   }
-#else
-   qCritical() << Q_FUNC_INFO << "signal" << sig << "received";
-   if (theApp->m_sem) {
-      if (theApp->m_sem->trigger(sig)) {
-          qCritical() << Q_FUNC_INFO << "trigger sent.";
-      } else {
-          qCritical() << Q_FUNC_INFO << "please send another interrupt/signal";
-      }
+   qqCDebug(lcSignals) << Q_FUNC_INFO << "signal" << sig << "received";
+   switch (theApp->m_signalBackend) {
+      case PipeBackend:
+         if (theApp->m_signalWriteFd != -1) {
+            if (write(theApp->m_signalWriteFd, &sig, sizeof(sig)) == sizeof(sig)) {
+               qqCDebug(lcSignals) << Q_FUNC_INFO << "trigger sent.";
+            }
+         }
+         break;
+      case EventFdBackend:
+         if (theApp->m_signalWriteFd != -1) {
+            const uint64_t one = 1;
+            theApp->m_pendingSignal[sig] = true;
+            if (write(theApp->m_signalWriteFd, &one, sizeof(one)) == sizeof(one)) {
+               qqCDebug(lcSignals) << Q_FUNC_INFO << "trigger sent.";
+            }
+         }
+         break;
+      case SemaphoreBackend:
+         if (theApp->m_sem) {
+            if (theApp->m_sem->trigger(sig)) {
+                qqCDebug(lcSignals) << Q_FUNC_INFO << "trigger sent.";
+            } else {
+                qCritical() << Q_FUNC_INFO << "please send another interrupt/signal";
+            }
+         }
+         break;
+      case SignalFdBackend:
+         // not reached: the signals are blocked
+         break;
    }
-#endif
 }
 
-void QQApplication::handleHUP_int(int sckt)
+void QQApplication::readSignalNotifier()
 {
-#ifdef USE_QSOCKETNOTIFIER
-   qCritical() << Q_FUNC_INFO << "called for pipe" << sckt;
-   qWarning() << "\tsignal" << m_signalReceived;
+    switch (m_signalBackend) {
+        case PipeBackend: {
+            int sig;
+            while (m_signalReadFd != -1 && read(m_signalReadFd, &sig, sizeof(sig)) == sizeof(sig)) {
+                dispatchSignal(sig);
+            }
+            break;
+        }
+        case EventFdBackend: {
+            uint64_t count;
+            if (read(m_signalReadFd, &count, sizeof(count)) == sizeof(count)) {
+                for (int sig = 1; sig < NSIG; ++sig) {
+                    if (m_pendingSignal[sig].exchange(false)) {
+                        dispatchSignal(sig);
+                    }
+                }
+            }
+            break;
+        }
+#ifdef Q_OS_LINUX
+        case SignalFdBackend: {
+            struct signalfd_siginfo info;
+            while (m_signalReadFd != -1 && read(m_signalReadFd, &info, sizeof(info)) == sizeof(info)) {
+                m_signalReceived = int(info.ssi_signo);
+                dispatchSignal(int(info.ssi_signo));
+            }
+            break;
+        }
 #endif
-   sleep(3);
-   qCritical() << Q_FUNC_INFO << "done.";
-#ifdef USE_QSOCKETNOTIFIER
-   close(sigHUPPipeRead);
-   close(sigHUPPipeWrite);
-   sigHUPPipeRead = sigHUPPipeWrite = -1;
-   //     _exit(0);
-   // re-raise signal with default handler and trigger program termination
-   signal(m_signalReceived, SIG_DFL);
-   raise(m_signalReceived);
-#else
-    sckt = m_signalReceived;
-    m_signalReceived = 0;
-    if (m_sem->isEnabled()) {
-        qWarning() << "\tdeactivating signal monitor";
-        m_sem->setEnabled(false);
+        default:
+            break;
     }
-    // re-raise signal with default handler and trigger program termination
-    signal(sckt, SIG_DFL);
-    raise(sckt);
-#endif
+}
+
+void QQApplication::dispatchSignal(int sig)
+{
+    emit interruptSignalReceived(sig);
+    if (sig > 0 && sig < NSIG && sigismember(&m_terminatingSignals, sig)) {
+        handleHUP_int(sig);
+    }
+}
+
+void QQApplication::handleHUP_int(int sig)
+{
+   qCritical() << Q_FUNC_INFO << "called for signal" << sig << "via" << signalBackendName(m_signalBackend);
+   if (m_shutdown->isRunning()) {
+       qCritical() << Q_FUNC_INFO << "shutdown already in progress, terminating now";
+       terminateWithSignal(sig);
+       return;
+   }
+   // returns immediately; the sequence runs from the event loop
+   m_shutdown->start(sig);
+}
+
+void QQApplication::terminateWithSignal(int sig)
+{
+   const QJsonObject timings = m_shutdown->timings();
+   QStringList stages;
+   foreach (const QJsonValue &stage, timings.value(QStringLiteral("stages")).toArray()) {
+       const QJsonObject obj = stage.toObject();
+       stages << QStringLiteral("%1=%2ms").arg(obj.value(QStringLiteral("stage")).toString())
+           .arg(obj.value(QStringLiteral("ns")).toDouble() / 1e6, 0, 'f', 2);
+   }
+   qCritical() << Q_FUNC_INFO << "shutdown stages:" << qPrintable(stages.join(QLatin1Char(' ')))
+       << (timings.value(QStringLiteral("expired")).toBool() ? "(deadline expired)" : "");
+   m_signalReceived = 0;
+   shutdownSignalBackend();
+   // re-raise signal with default handler and trigger program termination
+   signal(sig, SIG_DFL);
+   sigset_t set;
+   sigemptyset(&set);
+   sigaddset(&set, sig);
+   pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+   raise(sig);
 }
 
 void QQApplication::handleHUP_qvar(QVariant sig)
 {
     qCritical() << Q_FUNC_INFO << "called for signal" << sig;
-    handleHUP_int(sig.toInt());
+    dispatchSignal(sig.toInt());
+}
+
+// QCommandLineParser needs the application instance, but the startup
+// profile has to be enabled before it is constructed.
+static bool startupProfileRequested(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        QByteArray arg(argv[i]);
+        if (arg.startsWith("--")) {
+            arg.remove(0, 1);
+        }
+        if (arg.startsWith("-startup-profile")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the benchmark suite runs without a display
+static bool offscreenRequested(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        QByteArray arg(argv[i]);
+        if (arg.startsWith("--")) {
+            arg.remove(0, 1);
+        }
+        if (arg == "-benchmark-all") {
+            return true;
+        }
+    }
+    return false;
 }
 
 int main(int argc, char *argv[])
 {
+    // starts the benchmark clock
+    QQBenchmark::now();
     bool nativeMenuBar = true;
     int shortCutActFlags = 3;
     QString shortCut = "Ctrl+<";
@@ -204,26 +529,231 @@ int main(int argc, char *argv[])
                                                 QStringLiteral("do not add the shortcut test action to the menubar"));
     const QCommandLineOption shortCutTestNoContext(QStringLiteral("no-shortcut-test-in-contextmenu"),
                                                    QStringLiteral("do not add the shortcut test action to the context menu"));
+    const QCommandLineOption shortCutTestInWindow(QStringLiteral("shortcut-test-in-window"),
+                                                  QStringLiteral("add the shortcut test action to the window itself"));
     const QCommandLineOption shortCutOption(QStringLiteral("shortcut"),
                                                 QStringLiteral("the shortcut to test (read Ctrl for Command on Mac)"),
                                                 "shortcut", shortCut);
+    const QCommandLineOption benchShortCutOption(QStringLiteral("bench-shortcut"),
+                                                QStringLiteral("measure the dispatch latency of <N> synthetic presses of the test shortcut, for each placement of its action"),
+                                                "N");
+    const QCommandLineOption benchAncestryOption(QStringLiteral("bench-menu-ancestry"),
+                                                QStringLiteral("compare the cost of isMenubarMenu() lookups for menus nested up to <depth> levels deep"),
+                                                "depth");
+    const QCommandLineOption soakContextMenuOption(QStringLiteral("soak-context-menu"),
+                                                QStringLiteral("open and close the context menu <N> times and report RSS and open latency"),
+                                                "N");
+    const QCommandLineOption verboseOption(QStringLiteral("verbose"),
+                                                QStringLiteral("enable the debug output of the menus, shortcuts, signals and styles logging categories"));
+    const QCommandLineOption benchLoggingOption(QStringLiteral("bench-logging"),
+                                                QStringLiteral("measure <N> menu opens and clicks with category logging off and on"),
+                                                "N");
+    const QCommandLineOption benchJsonOption(QStringLiteral("bench-json"),
+                                                QStringLiteral("write benchmark results as JSON to <file> (- for stdout)"),
+                                                "file");
+    const QCommandLineOption signalBackendOption(QStringLiteral("signal-backend"),
+                                                QStringLiteral("how caught signals reach the event loop: pipe, semaphore (default), signalfd or eventfd"),
+                                                "backend", QQApplication::signalBackendName(QQApplication::SemaphoreBackend));
+    const QCommandLineOption benchSignalOption(QStringLiteral("bench-signal"),
+                                                QStringLiteral("measure the delivery latency of <N> SIGUSR1 signals through the selected signal backend"),
+                                                "N");
+    const QCommandLineOption benchSemaphoreOption(QStringLiteral("bench-semaphore"),
+                                                QStringLiteral("compare <N> trigger/wait pairs of the sem_t and futex QQNativeSemaphore backends"),
+                                                "N");
+    const QCommandLineOption benchSemaphoreScalingOption(QStringLiteral("bench-semaphore-scaling"),
+                                                QStringLiteral("compare dedicated and shared QQNativeSemaphore monitors for 1 up to <N> instances"),
+                                                "N");
+    const QCommandLineOption shutdownDeadlineOption(QStringLiteral("shutdown-deadline"),
+                                                QStringLiteral("the time (in ms) a terminating signal leaves the application to shut down"),
+                                                "ms", QString::number(3000));
+    const QCommandLineOption benchShutdownOption(QStringLiteral("bench-shutdown"),
+                                                QStringLiteral("time the stages of the shutdown sequence with <N> open windows"),
+                                                "N");
+    const QCommandLineOption noStyleCacheOption(QStringLiteral("no-style-cache"),
+                                                QStringLiteral("construct a new widget style on every style switch"));
+    const QCommandLineOption preloadStylesOption(QStringLiteral("preload-styles"),
+                                                QStringLiteral("prepare all widget styles in the background at startup"));
+    const QCommandLineOption benchStyleSwitchOption(QStringLiteral("bench-style-switch"),
+                                                QStringLiteral("measure <N> switches to each widget style, until the first paint, without and with the style cache"),
+                                                "N");
+    const QCommandLineOption noStyleKeyCacheOption(QStringLiteral("no-style-key-cache"),
+                                                QStringLiteral("scan the style plugins instead of using the on-disk list of style keys"));
+    const QCommandLineOption benchStartupOption(QStringLiteral("bench-startup"),
+                                                QStringLiteral("measure <N> application startups with and without the style key cache"),
+                                                "N");
+    const QCommandLineOption startupProbeOption(QStringLiteral("startup-probe"),
+                                                QStringLiteral("(internal) open a window, print startup timings and exit"));
+    const QCommandLineOption benchStyleScalingOption(QStringLiteral("bench-style-scaling"),
+                                                QStringLiteral("measure switching through all widget styles with 1 up to <N> open windows"),
+                                                "N");
+    const QCommandLineOption startupProfileOption(QStringLiteral("startup-profile"),
+                                                QStringLiteral("print a tree of the timings of each phase from main() to the first paint, and exit"));
+    const QCommandLineOption startupProfileRunsOption(QStringLiteral("startup-profile-runs"),
+                                                QStringLiteral("report the median startup profile of <N> cold and <N> warm runs"),
+                                                "N");
+    const QCommandLineOption startupProfileChildOption(QStringLiteral("startup-profile-child"),
+                                                QStringLiteral("(internal) print the startup profile as JSON and exit"));
+    const QCommandLineOption benchActionsOption(QStringLiteral("bench-actions"),
+                                                QStringLiteral("measure the construction of <N> windows with all actions created up front and created lazily"),
+                                                "N");
+    const QCommandLineOption stressActionsOption(QStringLiteral("stress-actions"),
+                                                QStringLiteral("measure shortcut dispatch, menu opening, isMenubarMenu() and RSS with 100 up to <N> generated actions"),
+                                                "N");
+    const QCommandLineOption stressDepthOption(QStringLiteral("stress-depth"),
+                                                QStringLiteral("the nesting depth of the menus holding the --stress-actions actions"),
+                                                "D", QString::number(3));
+    const QCommandLineOption noShortcutRegistryOption(QStringLiteral("no-shortcut-registry"),
+                                                QStringLiteral("do not index the shortcuts to detect conflicts and ambiguities"));
+    const QCommandLineOption shortcutRegistryOption(QStringLiteral("shortcut-registry"),
+                                                QStringLiteral("index the shortcuts in the benchmark modes too, where it is off by default"));
+    const QCommandLineOption sharedActionsOption(QStringLiteral("shared-actions"),
+                                                QStringLiteral("let all windows share one set of actions"));
+    const QCommandLineOption benchWindowsOption(QStringLiteral("bench-windows"),
+                                                QStringLiteral("measure memory and creation time per window for 1 up to <N> windows, with per-window and with shared actions"),
+                                                "N");
+    const QCommandLineOption benchWindowsChildOption(QStringLiteral("bench-windows-child"),
+                                                QStringLiteral("(internal) run --bench-windows in the current mode only and print JSON"));
+    const QCommandLineOption prewarmWindowsOption(QStringLiteral("prewarm-windows"),
+                                                QStringLiteral("keep <N> hidden windows ready for File|New Window (default 0: off; the pool size for --bench-new-window, at least 1)"),
+                                                "N", QString::number(0));
+    const QCommandLineOption benchNewWindowOption(QStringLiteral("bench-new-window"),
+                                                QStringLiteral("measure the time-to-visible of <N> new windows without and with prewarming"),
+                                                "N");
+    const QCommandLineOption recordOption(QStringLiteral("record"),
+                                                QStringLiteral("record the key, mouse and context menu events of the session to <file>"),
+                                                "file");
+    const QCommandLineOption replayOption(QStringLiteral("replay"),
+                                                QStringLiteral("replay the events recorded in <file>, report the dispatch times and quit"),
+                                                "file");
+    const QCommandLineOption speedOption(QStringLiteral("speed"),
+                                                QStringLiteral("replay at <S> times the recorded pace, or \"max\" for as fast as possible"),
+                                                "S", QStringLiteral("1"));
+    const QCommandLineOption checkRecordReplayOption(QStringLiteral("check-record-replay"),
+                                                QStringLiteral("record the test shortcut pressed in a window, replay it into another and check that it fires both times"));
+    const QCommandLineOption watchdogOption(QStringLiteral("watchdog"),
+                                                QStringLiteral("watch the GUI thread for event loop stalls, and report them at exit"));
+    const QCommandLineOption watchdogIntervalOption(QStringLiteral("watchdog-interval"),
+                                                QStringLiteral("ping the event loop every <ms> milliseconds"),
+                                                "ms", QString::number(100));
+    const QCommandLineOption watchdogThresholdOption(QStringLiteral("watchdog-threshold"),
+                                                QStringLiteral("count an event loop lag of <ms> milliseconds or more as a stall"),
+                                                "ms", QString::number(250));
+    const QCommandLineOption watchdogJsonOption(QStringLiteral("watchdog-json"),
+                                                QStringLiteral("write the watchdog results as JSON to <file> at exit"),
+                                                "file");
+    const QCommandLineOption profileEventsOption(QStringLiteral("profile-events"),
+                                                QStringLiteral("count and time the events dispatched through QApplication::notify() per type and receiver class"));
+    const QCommandLineOption profileEventsJsonOption(QStringLiteral("profile-events-json"),
+                                                QStringLiteral("write the event dispatch profile as JSON to <file> (implies --profile-events)"),
+                                                "file");
+    const QCommandLineOption benchNotifyOption(QStringLiteral("bench-notify"),
+                                                QStringLiteral("measure the cost of QApplication::notify() over <N> events with the event profiler off and on"),
+                                                "N");
+    const QCommandLineOption benchActionUpdatesOption(QStringLiteral("bench-action-updates"),
+                                                QStringLiteral("measure action property updates on menus with <N> items, with and without batching"),
+                                                "N");
+    const QCommandLineOption benchMenusOption(QStringLiteral("bench-menus"),
+                                                QStringLiteral("measure <N> openings of each menubar menu"),
+                                                "N");
+    const QCommandLineOption benchmarkAllOption(QStringLiteral("benchmark-all"),
+                                                QStringLiteral("run the benchmark suite on the offscreen platform and write the results to the --bench-json file (default benchmark-all.json)"));
+    const QCommandLineOption compareOption(QStringLiteral("compare"),
+                                                QStringLiteral("compare the benchmark results in <file> with the --baseline results, exit with 3 on a regression"),
+                                                "file");
+    const QCommandLineOption baselineOption(QStringLiteral("baseline"),
+                                                QStringLiteral("the benchmark results to compare with (after --benchmark-all, or with --compare)"),
+                                                "file");
+    const QCommandLineOption regressionThresholdOption(QStringLiteral("regression-threshold"),
+                                                QStringLiteral("count a significant slowdown of more than <pct> percent as a regression"),
+                                                "pct", QString::number(5));
     commandLineParser.addOption(noNativeMenuOption);
     commandLineParser.addOption(r2LOption);
     commandLineParser.addOption(shortCutTestNoMenu);
     commandLineParser.addOption(shortCutTestNoContext);
+    commandLineParser.addOption(shortCutTestInWindow);
     commandLineParser.addOption(shortCutOption);
+    commandLineParser.addOption(benchShortCutOption);
+    commandLineParser.addOption(benchAncestryOption);
+    commandLineParser.addOption(soakContextMenuOption);
+    commandLineParser.addOption(verboseOption);
+    commandLineParser.addOption(benchLoggingOption);
+    commandLineParser.addOption(benchJsonOption);
+    commandLineParser.addOption(signalBackendOption);
+    commandLineParser.addOption(benchSignalOption);
+    commandLineParser.addOption(benchSemaphoreOption);
+    commandLineParser.addOption(benchSemaphoreScalingOption);
+    commandLineParser.addOption(shutdownDeadlineOption);
+    commandLineParser.addOption(benchShutdownOption);
+    commandLineParser.addOption(noStyleCacheOption);
+    commandLineParser.addOption(preloadStylesOption);
+    commandLineParser.addOption(benchStyleSwitchOption);
+    commandLineParser.addOption(noStyleKeyCacheOption);
+    commandLineParser.addOption(benchStartupOption);
+    commandLineParser.addOption(startupProbeOption);
+    commandLineParser.addOption(benchStyleScalingOption);
+    commandLineParser.addOption(startupProfileOption);
+    commandLineParser.addOption(startupProfileRunsOption);
+    commandLineParser.addOption(startupProfileChildOption);
+    commandLineParser.addOption(benchActionsOption);
+    commandLineParser.addOption(stressActionsOption);
+    commandLineParser.addOption(stressDepthOption);
+    commandLineParser.addOption(noShortcutRegistryOption);
+    commandLineParser.addOption(shortcutRegistryOption);
+    commandLineParser.addOption(sharedActionsOption);
+    commandLineParser.addOption(benchWindowsOption);
+    commandLineParser.addOption(benchWindowsChildOption);
+    commandLineParser.addOption(prewarmWindowsOption);
+    commandLineParser.addOption(benchNewWindowOption);
+    commandLineParser.addOption(recordOption);
+    commandLineParser.addOption(replayOption);
+    commandLineParser.addOption(speedOption);
+    commandLineParser.addOption(checkRecordReplayOption);
+    commandLineParser.addOption(watchdogOption);
+    commandLineParser.addOption(watchdogIntervalOption);
+    commandLineParser.addOption(watchdogThresholdOption);
+    commandLineParser.addOption(watchdogJsonOption);
+    commandLineParser.addOption(profileEventsOption);
+    commandLineParser.addOption(profileEventsJsonOption);
+    commandLineParser.addOption(benchNotifyOption);
+    commandLineParser.addOption(benchActionUpdatesOption);
+    commandLineParser.addOption(benchMenusOption);
+    commandLineParser.addOption(benchmarkAllOption);
+    commandLineParser.addOption(compareOption);
+    commandLineParser.addOption(baselineOption);
+    commandLineParser.addOption(regressionThresholdOption);
     commandLineParser.addHelpOption();
 
+    QQPhaseProfiler *profiler = QQPhaseProfiler::instance();
+    profiler->setEnabled(startupProfileRequested(argc, argv));
+
+    // this has to happen before QApplication starts any threads
+    profiler->begin("prepareSignalBackend");
+    const QQApplication::SignalBackend signalBackend = QQApplication::signalBackendFromArguments(argc, argv);
+    QQApplication::prepareSignalBackend(signalBackend);
+    profiler->end();
+
+    if (offscreenRequested(argc, argv)) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    profiler->begin("QQApplication");
     QQApplication app(argc, argv);
-#ifndef USE_QSOCKETNOTIFIER
+    profiler->end();
+    const int baselineThreads = QQBenchmark::threadCount();
+    const int baselineFds = QQBenchmark::openFileDescriptors();
+    profiler->begin("catchInterruptSignal");
+    app.setSignalBackend(signalBackend);
 #ifdef SIGHUP
    app.catchInterruptSignal(SIGHUP);
 #endif
    app.catchInterruptSignal(SIGINT);
    app.catchInterruptSignal(SIGTERM);
-#endif
+    profiler->end();
 
+    profiler->begin("command line");
     commandLineParser.process(app);
+    if (commandLineParser.isSet(verboseOption)) {
+        qqSetCategoryLogging(true);
+    }
     if (commandLineParser.isSet(noNativeMenuOption)) {
         qWarning() << "Using non-native menubar";
         QCoreApplication::setAttribute(Qt::AA_DontUseNativeMenuBar);
@@ -237,16 +767,220 @@ int main(int argc, char *argv[])
     if (commandLineParser.isSet(shortCutTestNoContext)) {
         shortCutActFlags &= ~2;
     }
+    if (commandLineParser.isSet(shortCutTestInWindow)) {
+        shortCutActFlags |= 4;
+    }
     if (commandLineParser.isSet(shortCutOption)) {
         shortCut = commandLineParser.value(shortCutOption);
     }
     if (commandLineParser.isSet(r2LOption)) {
         app.setLayoutDirection(Qt::RightToLeft);
     }
+    app.shutdownSequence()->setDeadline(commandLineParser.value(shutdownDeadlineOption).toInt());
+    if (commandLineParser.isSet(noStyleCacheOption)) {
+        QWidgetStyleCache::instance()->setEnabled(false);
+    }
+    if (commandLineParser.isSet(noStyleKeyCacheOption)) {
+        QWidgetStyleCache::instance()->setKeyCacheEnabled(false);
+    }
+    if (commandLineParser.isSet(preloadStylesOption)) {
+        QWidgetStyleCache::instance()->preload();
+    }
+    // the registry's application event filter would weigh on every measurement,
+    // and differently depending on the mode; benchmarks only get it on request
+    bool benchmarkMode = profiler->isEnabled();
+    const QCommandLineOption *benchmarkOptions[] = {
+        &benchShortCutOption, &benchAncestryOption, &benchLoggingOption, &benchSignalOption,
+        &benchSemaphoreOption, &benchSemaphoreScalingOption, &benchShutdownOption, &benchStyleSwitchOption,
+        &startupProbeOption, &benchStartupOption, &benchStyleScalingOption, &benchActionsOption,
+        &stressActionsOption, &benchWindowsOption, &benchNewWindowOption, &benchNotifyOption,
+        &benchActionUpdatesOption, &checkRecordReplayOption, &benchMenusOption, &benchmarkAllOption,
+        &compareOption, &soakContextMenuOption, &replayOption
+    };
+    for (const QCommandLineOption *option : benchmarkOptions) {
+        benchmarkMode |= commandLineParser.isSet(*option);
+    }
+    QQShortcutRegistry::instance()->setEnabled(commandLineParser.isSet(shortcutRegistryOption)
+        || (!benchmarkMode && !commandLineParser.isSet(noShortcutRegistryOption)));
+    MainWindow::setSharedActions(commandLineParser.isSet(sharedActionsOption));
+    profiler->end();
+
+    // the event profile is reported when main() returns, whichever mode ran
+    struct NotifyProfileReport {
+        QQApplication &app;
+        const QString jsonFile;
+        ~NotifyProfileReport()
+        {
+            if (const QQNotifyProfiler *notifyProfiler = app.notifyProfiler()) {
+                foreach (const QString &line, notifyProfiler->report()) {
+                    QQBenchmark::print(line);
+                }
+                if (!jsonFile.isEmpty()) {
+                    QQBenchmark::writeJson(jsonFile, notifyProfiler->toJson());
+                }
+            }
+        }
+    } notifyProfileReport = { app, commandLineParser.value(profileEventsJsonOption) };
+    if (commandLineParser.isSet(profileEventsOption) || commandLineParser.isSet(profileEventsJsonOption)) {
+        app.setNotifyProfiling(true);
+    }
+
+    // a terminating signal never returns from main(), so the shutdown sequence
+    // does the work that would otherwise happen there: dismiss popups and
+    // prewarmed windows before the windows are closed, and write the requested
+    // reports while flushing.
+    QObject::connect(app.shutdownSequence(), &QQShutdownSequence::aboutToShutdown, [](int) {
+        QWidget *popup;
+        while ((popup = QApplication::activePopupWidget()) && popup->close()) {
+        }
+        MainWindow::windowPool()->setSize(0);
+    });
+    const QString profileEventsJson = commandLineParser.value(profileEventsJsonOption);
+    const QString watchdogJson = commandLineParser.value(watchdogJsonOption);
+    QObject::connect(app.shutdownSequence(), &QQShutdownSequence::flushRequested, [&app, profileEventsJson, watchdogJson](int) {
+        const QQNotifyProfiler *notifyProfiler = app.notifyProfiler();
+        if (notifyProfiler && !profileEventsJson.isEmpty()) {
+            QQBenchmark::writeJson(profileEventsJson, notifyProfiler->toJson());
+        }
+        if (!watchdogJson.isEmpty()) {
+            QQBenchmark::writeJson(watchdogJson, QQStallWatchdog::instance()->toJson());
+        }
+    });
+
+    Benchmarks::Options benchOptions;
+    benchOptions.shortCut = shortCut;
+    benchOptions.nativeMenuBar = nativeMenuBar;
+    benchOptions.jsonFile = commandLineParser.value(benchJsonOption);
+    if (profiler->isEnabled()) {
+        return Benchmarks::startupProfile(commandLineParser.value(startupProfileRunsOption).toInt(),
+                                          commandLineParser.isSet(startupProfileChildOption), benchOptions);
+    }
+    if (commandLineParser.isSet(benchShortCutOption)) {
+        return Benchmarks::shortcutDispatch(commandLineParser.value(benchShortCutOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchAncestryOption)) {
+        return Benchmarks::menuAncestry(commandLineParser.value(benchAncestryOption).toInt(), 1000000, benchOptions);
+    }
+    if (commandLineParser.isSet(benchLoggingOption)) {
+        return Benchmarks::logging(commandLineParser.value(benchLoggingOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchSignalOption)) {
+        return Benchmarks::signalDelivery(&app, commandLineParser.value(benchSignalOption).toInt(),
+                                          baselineThreads, baselineFds, benchOptions);
+    }
+    if (commandLineParser.isSet(benchSemaphoreOption)) {
+        return Benchmarks::semaphore(commandLineParser.value(benchSemaphoreOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchSemaphoreScalingOption)) {
+        return Benchmarks::semaphoreScaling(commandLineParser.value(benchSemaphoreScalingOption).toInt(), 1000, benchOptions);
+    }
+    if (commandLineParser.isSet(benchShutdownOption)) {
+        return Benchmarks::shutdown(&app, commandLineParser.value(benchShutdownOption).toInt(), 10, benchOptions);
+    }
+    if (commandLineParser.isSet(benchStyleSwitchOption)) {
+        return Benchmarks::styleSwitch(commandLineParser.value(benchStyleSwitchOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(startupProbeOption)) {
+        return Benchmarks::startupProbe(benchOptions);
+    }
+    if (commandLineParser.isSet(benchStartupOption)) {
+        return Benchmarks::startup(commandLineParser.value(benchStartupOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchStyleScalingOption)) {
+        return Benchmarks::styleScaling(qMax(1, commandLineParser.value(benchStyleScalingOption).toInt()), 5, benchOptions);
+    }
+    if (commandLineParser.isSet(benchActionsOption)) {
+        return Benchmarks::actionCreation(qMax(2, commandLineParser.value(benchActionsOption).toInt()), benchOptions);
+    }
+    if (commandLineParser.isSet(stressActionsOption)) {
+        return Benchmarks::stressActions(qMax(1, commandLineParser.value(stressActionsOption).toInt()),
+                                         qMax(1, commandLineParser.value(stressDepthOption).toInt()), 200, benchOptions);
+    }
+    if (commandLineParser.isSet(benchWindowsOption)) {
+        return Benchmarks::windowScaling(qMax(1, commandLineParser.value(benchWindowsOption).toInt()),
+                                         commandLineParser.isSet(benchWindowsChildOption), benchOptions);
+    }
+    if (commandLineParser.isSet(benchNewWindowOption)) {
+        return Benchmarks::newWindow(commandLineParser.value(benchNewWindowOption).toInt(),
+                                     qMax(1, commandLineParser.value(prewarmWindowsOption).toInt()), benchOptions);
+    }
+    if (commandLineParser.isSet(benchNotifyOption)) {
+        return Benchmarks::notifyOverhead(&app, commandLineParser.value(benchNotifyOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchActionUpdatesOption)) {
+        return Benchmarks::actionUpdates(qMax(1, commandLineParser.value(benchActionUpdatesOption).toInt()), 5, benchOptions);
+    }
+    if (commandLineParser.isSet(checkRecordReplayOption)) {
+        return Benchmarks::recordReplay(benchOptions);
+    }
+    if (commandLineParser.isSet(benchMenusOption)) {
+        return Benchmarks::menuOpen(commandLineParser.value(benchMenusOption).toInt(), benchOptions);
+    }
+    if (commandLineParser.isSet(benchmarkAllOption)) {
+        return Benchmarks::runAll(commandLineParser.value(baselineOption),
+                                  commandLineParser.value(regressionThresholdOption).toDouble(), benchOptions);
+    }
+    if (commandLineParser.isSet(compareOption)) {
+        if (!commandLineParser.isSet(baselineOption)) {
+            qWarning() << "--compare needs a --baseline to compare with";
+            return 1;
+        }
+        return Benchmarks::compare(commandLineParser.value(compareOption), commandLineParser.value(baselineOption),
+                                   commandLineParser.value(regressionThresholdOption).toDouble(), benchOptions);
+    }
+    if (commandLineParser.isSet(soakContextMenuOption)) {
+        return Benchmarks::contextMenuSoak(commandLineParser.value(soakContextMenuOption).toInt(), benchOptions);
+    }
 
     qWarning() << "Shortcut test action flags:" << shortCutActFlags;
 
+    // both have to see the windows being shown, to number them in the same order
+    QQEventRecorder recorder("MainWindow");
+    if (commandLineParser.isSet(recordOption) && !recorder.start(commandLineParser.value(recordOption))) {
+        return 1;
+    }
+    QQEventReplayer replayer("MainWindow");
+    if (commandLineParser.isSet(replayOption) && !replayer.open(commandLineParser.value(replayOption))) {
+        return 1;
+    }
+
     MainWindow window(shortCutActFlags, shortCut, nativeMenuBar);
-    window.show();
-    return app.exec();
+    if (commandLineParser.isSet(replayOption)) {
+        // the recorded key events went to the active window
+        Benchmarks::showAndActivate(&window);
+        QObject::connect(&replayer, &QQEventReplayer::finished, [&]() {
+            foreach (const QString &line, replayer.report()) {
+                QQBenchmark::print(line);
+            }
+            if (!benchOptions.jsonFile.isEmpty()) {
+                QQBenchmark::writeJson(benchOptions.jsonFile, replayer.toJson());
+            }
+            app.exit(0);
+        });
+        const QString speed = commandLineParser.value(speedOption);
+        replayer.start(speed == QStringLiteral("max") ? 0 : speed.toDouble());
+    } else {
+        window.show();
+    }
+    // with --prewarm-windows, prepare the next window once the event loop is idle
+    MainWindow::windowPool()->setFactory([=]() -> QWidget* {
+        return new MainWindow(shortCutActFlags, shortCut, nativeMenuBar);
+    });
+    MainWindow::windowPool()->setSize(commandLineParser.value(prewarmWindowsOption).toInt());
+    if (QQShortcutRegistry::instance()->isEnabled()) {
+        foreach (const QString &line, QQShortcutRegistry::instance()->report()) {
+            qWarning() << qPrintable(line);
+        }
+    }
+    QQStallWatchdog *watchdog = QQStallWatchdog::instance();
+    if (commandLineParser.isSet(watchdogOption) || commandLineParser.isSet(watchdogJsonOption)) {
+        watchdog->setInterval(commandLineParser.value(watchdogIntervalOption).toInt());
+        watchdog->setThreshold(commandLineParser.value(watchdogThresholdOption).toInt());
+        watchdog->start();
+    }
+    const int ret = app.exec();
+    if (commandLineParser.isSet(watchdogJsonOption)) {
+        QQBenchmark::writeJson(commandLineParser.value(watchdogJsonOption), watchdog->toJson());
+    }
+    return ret;
 }
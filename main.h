@@ -56,13 +56,12 @@
 
 #include <QApplication>
 
-#undef USE_QSOCKETNOTIFIER
+#include <atomic>
 
-#ifdef USE_QSOCKETNOTIFIER
-#include <QSocketNotifier>
-#else
+class QSocketNotifier;
 class QQNativeSemaphore;
-#endif
+class QQShutdownSequence;
+class QQNotifyProfiler;
 
 class QQApplication : public QApplication
 {
@@ -75,34 +74,122 @@ class QQApplication : public QApplication
 #endif
 
 public:
+    /**
+     * The ways in which a caught signal can reach the event loop.
+     */
+    enum SignalBackend {
+        // the signal handler writes the signal number to a pipe watched by a QSocketNotifier
+        PipeBackend,
+        // the signal handler triggers a QQNativeSemaphore, whose monitor thread
+        // calls back through a BlockingQueuedConnection
+        SemaphoreBackend,
+        // Linux: the signals are blocked and read from a signalfd watched by a
+        // QSocketNotifier; falls back to EventFdBackend
+        SignalFdBackend,
+        // Linux: the signal handler writes to an eventfd watched by a QSocketNotifier;
+        // falls back to PipeBackend
+        EventFdBackend
+    };
+
     explicit QQApplication(int &argc, char **argv);
     ~QQApplication();
-#ifndef USE_QSOCKETNOTIFIER
-    InterruptSignalHandler catchInterruptSignal(int sig);
-#endif
+
+    /**
+     * Select the signal backend. This has to happen before the first call
+     * to catchInterruptSignal().
+     */
+    void setSignalBackend(SignalBackend backend);
+    SignalBackend signalBackend() const
+    {
+        return m_signalBackend;
+    }
+    /**
+     * Catch @p sig through the selected backend. When @p terminate is set,
+     * receiving the signal shuts the application down and re-raises it;
+     * otherwise only interruptSignalReceived() is emitted.
+     */
+    InterruptSignalHandler catchInterruptSignal(int sig, bool terminate = true);
+    /**
+     * The semaphore backend swallows this many signals before it starts
+     * delivering them (the "send another interrupt" protection); always 0
+     * with the other backends. Setting it is ignored by those.
+     */
+    int signalCountdown() const;
+    void setSignalCountdown(int count);
+
+    static QString signalBackendName(SignalBackend backend);
+    static SignalBackend signalBackendFromName(const QString &name, bool *ok = nullptr);
+    /**
+     * Returns the backend requested with --signal-backend in @p argv, or the
+     * default (SemaphoreBackend). This is meant to be called before the
+     * application object exists, see prepareSignalBackend().
+     */
+    static SignalBackend signalBackendFromArguments(int argc, char **argv);
+    /**
+     * The signalfd backend requires the signals to be blocked in every thread,
+     * so they have to be blocked before QApplication starts any: call this
+     * at the top of main() with the backend that will be used.
+     */
+    static void prepareSignalBackend(SignalBackend backend);
+
+    /**
+     * The staged shutdown that a terminating signal starts; the signal is
+     * re-raised when it has finished or its deadline has expired.
+     */
+    QQShutdownSequence *shutdownSequence() const
+    {
+        return m_shutdown;
+    }
+
+    /**
+     * Opt-in profiling of all event dispatch through notify(). While it is
+     * off, notify() only adds a relaxed load and a branch to QApplication's.
+     * The profiler is created when profiling is first enabled and kept (with
+     * its counts) for the lifetime of the application. It is never deleted,
+     * as other threads can still be dispatching events when the application
+     * object goes away.
+     */
+    void setNotifyProfiling(bool enabled);
+    QQNotifyProfiler *notifyProfiler() const
+    {
+        return m_notifyProfilerData;
+    }
+
+    bool notify(QObject *receiver, QEvent *event) Q_DECL_OVERRIDE;
 
 signals:
    void interruptSignalReceived(int sig);
 
 public slots:
-    void handleHUP_int(int sckt);
+    void handleHUP_int(int sig);
     void handleHUP_qvar(QVariant sig);
 
+private slots:
+    void readSignalNotifier();
+    void terminateWithSignal(int sig);
+
 private:
     static void signalhandler(int sig);
-#ifndef USE_QSOCKETNOTIFIER
-    void signalMonitor();
-    static void* signalMonitor(void*);
-#endif
+    bool setupSignalBackend();
+    void shutdownSignalBackend();
+    void dispatchSignal(int sig);
 
-#ifdef USE_QSOCKETNOTIFIER
-    int sigHUPPipeRead = -1, sigHUPPipeWrite = -1;
-    QSocketNotifier *sigHUPNotifier = nullptr;
-#else
+    SignalBackend m_signalBackend;
+    bool m_signalBackendReady;
+    int m_signalReadFd, m_signalWriteFd;
+    QSocketNotifier *m_signalNotifier;
     QQNativeSemaphore *m_sem;
-#endif
+    QQShutdownSequence *m_shutdown;
+    // the profiler notify() records into, null while profiling is off
+    std::atomic<QQNotifyProfiler*> m_notifyProfiler;
+    QQNotifyProfiler *m_notifyProfilerData;
+    sigset_t m_signalFdSet;
+    sigset_t m_terminatingSignals;
+    // signals received through the eventfd backend, which only carries a count
+    std::atomic_bool m_pendingSignal[NSIG];
     sig_atomic_t m_signalReceived;
     static QQApplication *theApp;
+    static sigset_t preBlockedSignals;
 };
 
 
@@ -62,48 +62,98 @@
 
 #include <QDebug>
 
+#include <cmath>
+#include <functional>
+
 #include "mainwindow.h"
 #include "qwidgetstyleselector.h"
+#include "qqbenchmark.h"
+#include "qqlogging.h"
+#include "qqshortcutregistry.h"
+#include "qqprewarmpool.h"
+#include "qqstallwatchdog.h"
 
 #ifdef Q_OS_MACOS
 #include <Carbon/Carbon.h>
 #endif
 
-static bool isMenubarMenu(const QMenu *m, bool checkIsNative=true)
-{   bool ret = false;
-        static int level = -1;
-    QSet<const QMenu*> checkList;
-    level += 1;
-    if (m && m->menuAction()) {
-        QAction *mAct = m->menuAction();
-        qWarning() << "##" << level << "isMenubarMenu(" << m << m->title() << ") menuAction=" << mAct << mAct->text();
-        foreach (const QWidget *w, mAct->associatedWidgets()) {
-            if (w == m) {
-                goto done;
-            }
-            qWarning() << "###" << level << "associated widget" << w << w->windowTitle() << "parent=" << w->parentWidget();
-            if (const QMenuBar *mb = qobject_cast<const QMenuBar*>(w)) {
-                qWarning() << "#### widget is QMenuBar" << mb << mb->windowTitle() << "with parent" << mb->parentWidget();
-                ret = checkIsNative? mb->isNativeMenuBar() : true;
-                goto done;
-            }
-            else if (const QMenu *mm = qobject_cast<const QMenu*>(w)) {
-                if (checkList.contains(mm)) {
-                    continue;
-                }
-                checkList += mm;
-                qWarning() << "####" << level << "widget is QMenu" << mm << mm->title() << "with parent" << mm->parentWidget();
-                if (isMenubarMenu(mm, checkIsNative)) {
-                    ret = true;
-                    goto done;
-                }
-            }
-        }
-    }
-done:;
-    level -= 1;
-    return ret;
-}
+#define TR(text) QT_TRANSLATE_NOOP("MainWindow", text)
+
+// the settings shared by all the actions; initializeAction() does the rest
+struct MainWindowActions
+{
+    static constexpr QQActionDescriptor<MainWindow> table[] = {
+        { MainWindow::NewAction, TR("&New"), QKeySequence::New, nullptr,
+          TR("Create a new file"), false, -1, &MainWindow::newFile },
+        { MainWindow::NewWindowAction, TR("New Window"), QKeySequence::UnknownKey, nullptr,
+          TR("Create a new window"), false, -1, &MainWindow::newWindow },
+        { MainWindow::OpenAction, TR("&Open..."), QKeySequence::Open, nullptr,
+          TR("Open an existing file"), false, -1, &MainWindow::open },
+        { MainWindow::SaveAction, TR("&Save"), QKeySequence::Save, nullptr,
+          TR("Save the document to disk"), false, -1, &MainWindow::save },
+        { MainWindow::PrintAction, TR("&Print..."), QKeySequence::Print, nullptr,
+          TR("Print the document"), false, -1, &MainWindow::print },
+        { MainWindow::ExitAction, TR("E&xit"), QKeySequence::Quit, nullptr,
+          TR("Exit the application"), false, -1, nullptr },
+        { MainWindow::UndoAction, TR("&Undo"), QKeySequence::Undo, nullptr,
+          TR("Undo the last operation"), false, -1, &MainWindow::undo },
+        { MainWindow::RedoAction, TR("&Redo"), QKeySequence::Redo, nullptr,
+          TR("Redo the last operation"), false, -1, &MainWindow::redo },
+        { MainWindow::CutAction, TR("Cu&t"), QKeySequence::Cut, nullptr,
+          TR("Cut the current selection's contents to the clipboard"), false, -1, &MainWindow::cut },
+        { MainWindow::CopyAction, TR("&Copy"), QKeySequence::Copy, nullptr,
+          TR("Copy the current selection's contents to the clipboard"), false, -1, &MainWindow::copy },
+        { MainWindow::PasteAction, TR("&Paste"), QKeySequence::Paste, nullptr,
+          TR("Paste the clipboard's contents into the current selection"), false, -1, &MainWindow::paste },
+        { MainWindow::SelectAllAction, TR("Select &All"), QKeySequence::SelectAll, nullptr,
+          nullptr, false, -1, &MainWindow::selectAll },
+        { MainWindow::BoldAction, TR("&Bold"), QKeySequence::Bold, nullptr,
+          TR("Make the text bold"), true, -1, &MainWindow::bold },
+        { MainWindow::ItalicAction, TR("&Italic"), QKeySequence::Italic, nullptr,
+          TR("Make the text italic"), true, -1, &MainWindow::italic },
+        { MainWindow::SetLineSpacingAction, TR("Set &Line Spacing..."), QKeySequence::UnknownKey, nullptr,
+          TR("Change the gap between the lines of a paragraph"), false, -1, &MainWindow::setLineSpacing },
+        { MainWindow::SetParagraphSpacingAction, TR("Set &Paragraph Spacing..."), QKeySequence::UnknownKey, nullptr,
+          TR("Change the gap between paragraphs"), false, -1, &MainWindow::setParagraphSpacing },
+        { MainWindow::AboutAction, TR("&About"), QKeySequence::UnknownKey, nullptr,
+          TR("Show the application's About box"), false, -1, &MainWindow::about },
+        { MainWindow::AboutQtAction, TR("About &Qt"), QKeySequence::UnknownKey, nullptr,
+          TR("Show the Qt library's About box"), false, -1, nullptr },
+        { MainWindow::LeftAlignAction, TR("&Left Align"), QKeySequence::UnknownKey, TR("Ctrl+L"),
+          TR("Left align the selected text"), true, MainWindow::AlignmentGroup, &MainWindow::leftAlign },
+        { MainWindow::RightAlignAction, TR("&Right Align"), QKeySequence::UnknownKey, TR("Ctrl+R"),
+          TR("Right align the selected text"), true, MainWindow::AlignmentGroup, &MainWindow::rightAlign },
+        { MainWindow::JustifyAction, TR("&Justify"), QKeySequence::UnknownKey, TR("Ctrl+J"),
+          TR("Justify the selected text"), true, MainWindow::AlignmentGroup, &MainWindow::justify },
+        { MainWindow::CenterAction, TR("&Center"), QKeySequence::UnknownKey, TR("Ctrl+E"),
+          TR("Center the selected text"), true, MainWindow::AlignmentGroup, &MainWindow::center },
+        { MainWindow::FullScreenAction, TR("&Fullscreen"), QKeySequence::UnknownKey, TR("F7"),
+          nullptr, true, -1, &MainWindow::toggleFullScreen },
+        // the shortcut is set by initializeAction()
+        { MainWindow::ShortCutTestAction, TR("shortcut test"), QKeySequence::UnknownKey, nullptr,
+          nullptr, false, -1, &MainWindow::shortCutActHandler },
+        { MainWindow::ContextQuitAction, TR("&Quit"), QKeySequence::UnknownKey, nullptr,
+          TR("Exit the application"), false, -1, nullptr },
+        { MainWindow::ShortcutReportAction, TR("Shortcut &Conflicts..."), QKeySequence::UnknownKey, nullptr,
+          TR("Show the conflicting and ambiguous shortcuts"), false, -1, &MainWindow::reportShortcuts },
+        { MainWindow::StallReportAction, TR("Event Loop &Stalls..."), QKeySequence::UnknownKey, nullptr,
+          TR("Show the event loop lag and the stalls the watchdog caught"), false, -1, &MainWindow::reportStalls }
+    };
+};
+constexpr QQActionDescriptor<MainWindow> MainWindowActions::table[];
+
+#undef TR
+
+static_assert(sizeof(MainWindowActions::table) / sizeof(MainWindowActions::table[0]) == MainWindow::ActionCount,
+              "the action table must describe every MainWindow::ActionId");
+static_assert(qqActionIdsAreIndices(MainWindowActions::table),
+              "the action table must be in MainWindow::ActionId order");
+
+static_assert(MainWindow::ActionCount <= 64, "MainWindow::checkedActionState() uses a 64-bit mask");
+
+static bool s_lazyActions = true;
+static bool s_sharedActions = false;
+static QPointer<MainWindow> s_contextWindow;
 
 //! [0]
 MainWindow::MainWindow(int shortCutActFlags, QString shortCut, bool nativeMenuBar, QWidget *parent)
@@ -111,25 +161,35 @@ MainWindow::MainWindow(int shortCutActFlags, QString shortCut, bool nativeMenuBa
     , m_nativeMenuBar(nativeMenuBar)
     , m_shortCutActFlags(shortCutActFlags)
     , m_shortCut(shortCut)
+    , m_pooledContextMenu(nullptr)
+    , m_pooledContextSections(nullptr)
+    , m_contextActionsSection(-1)
+    , m_shortCutDispatchCount(0)
+    , m_lastShortCutDispatch(-1)
+    , m_sharedActions(s_sharedActions)
+    , m_actions(nullptr)
+    , m_checkedActions(quint64(1) << LeftAlignAction)
 {
 #ifdef Q_OS_MACOS
     if (!nativeMenuBar) {
-        qWarning() << Q_FUNC_INFO << "menuBar" << menuBar() << "native=" << menuBar()->isNativeMenuBar();
+        qqCDebug(lcMenus) << Q_FUNC_INFO << "menuBar" << menuBar() << "native=" << menuBar()->isNativeMenuBar();
         QMenuBar *mB = new QMenuBar(this);
         mB->setNativeMenuBar(false);
         mB->setVisible(true);
-        qWarning() << "new menuBar:" << mB;
+        qqCDebug(lcMenus) << "new menuBar:" << mB;
         setMenuBar(mB);
     }
-    qWarning() << Q_FUNC_INFO << "menuBar" << menuBar() << "native=" << menuBar()->isNativeMenuBar();
-    qWarning() << "\tplatformName=" << QGuiApplication::platformName();
-    qWarning() << "\tQt::AA_MacDontSwapCtrlAndMeta=" << qApp->testAttribute(Qt::AA_MacDontSwapCtrlAndMeta);;
+    qqCDebug(lcMenus) << Q_FUNC_INFO << "menuBar" << menuBar() << "native=" << menuBar()->isNativeMenuBar();
+    qqCDebug(lcMenus) << "\tplatformName=" << QGuiApplication::platformName();
+    qqCDebug(lcMenus) << "\tQt::AA_MacDontSwapCtrlAndMeta=" << qApp->testAttribute(Qt::AA_MacDontSwapCtrlAndMeta);;
 #endif
 
 #ifdef Q_OS_MACOS
     setWindowFlags(windowFlags() & ~Qt::WindowFullscreenButtonHint);
 #endif
 
+    QQPhaseProfiler *profiler = QQPhaseProfiler::instance();
+    profiler->begin("layout");
     QWidget *widget = new QWidget;
     setCentralWidget(widget);
 //! [0]
@@ -152,11 +212,18 @@ MainWindow::MainWindow(int shortCutActFlags, QString shortCut, bool nativeMenuBa
     layout->addWidget(infoLabel);
     layout->addWidget(bottomFiller);
     widget->setLayout(layout);
+    profiler->end();
 //! [1]
 
 //! [2]
-    createActions();
-    createMenus();
+    m_menuAncestry = new QQMenuAncestry(this);
+    m_menuAncestry->track(menuBar());
+    {
+        // each menu item is updated once, however often the setup changes its action
+        QQActionUpdateBatch batch;
+        createActions();
+        createMenus();
+    }
 
     QString message = tr("A context menu is available by right-clicking");
     statusBar()->showMessage(message);
@@ -171,13 +238,24 @@ MainWindow::MainWindow(int shortCutActFlags, QString shortCut, bool nativeMenuBa
 #ifndef QT_NO_CONTEXTMENU
 void MainWindow::contextMenuEvent(QContextMenuEvent *event)
 {
-    qWarning() << Q_FUNC_INFO << event << "reason=" << event->reason();
-    QQMenu *menu = new QQMenu(tr("Dynamic contextMenu"), this);
-    menu->setTearOffEnabled(true);
-    menu->addActions(contextMenu->actions());
-    connect(menu, SIGNAL(aboutToShow()), this, SLOT(aboutToShowContextMenu()));
-    bool isMB = isMenubarMenu(menu);
-    qWarning() << "\tcreated menu" << menu << "isNativeMenubarMenu=" << isMB;
+    qqCDebug(lcMenus) << Q_FUNC_INFO << event << "reason=" << event->reason();
+    // the menu is built once and then reused; its dynamic sections are
+    // only repopulated when they have been invalidated.
+    QQMenu *menu = m_pooledContextMenu;
+    if (!menu) {
+        menu = m_pooledContextMenu = new QQMenu(tr("Dynamic contextMenu"), this);
+        menu->setTearOffEnabled(true);
+        m_pooledContextSections = QQMenuSections::sections(menu);
+        m_contextActionsSection = m_pooledContextSections->addSection([this]() {
+            return contextMenu->actions();
+        });
+        m_pooledContextSections->addSection([this]() {
+            return QList<QAction*>() << contextQuitAct;
+        });
+        connect(menu, SIGNAL(aboutToShow()), this, SLOT(aboutToShowContextMenu()));
+        m_menuAncestry->track(menu);
+        qqCDebug(lcMenus) << "\tcreated menu" << menu << "isNativeMenubarMenu=" << isMenubarMenu(menu);
+    }
     menu->exec(event->globalPos());
 }
 #endif // QT_NO_CONTEXTMENU
@@ -188,14 +266,27 @@ void MainWindow::aboutToShowContextMenu()
     QQMenu *menu = qobject_cast<QQMenu *>(sender());
 
     if (menu) {
-        bool isMB = isMenubarMenu(menu);
-        qWarning() << Q_FUNC_INFO << "About to show" << menu << "isNativeMenubarMenu=" << isMB;
-        QAction *extraAct = new QAction(tr("&Quit"), this);
-        extraAct->setStatusTip(tr("Exit the application"));
-        connect(extraAct, &QAction::triggered, this, &QWidget::close);
-        menu->addAction(extraAct);
+        qqCDebug(lcMenus) << Q_FUNC_INFO << "About to show" << menu << "isNativeMenubarMenu=" << isMenubarMenu(menu);
+    }
+#endif
+}
+
+void MainWindow::invalidateContextMenu()
+{
+    if (m_pooledContextSections) {
+        m_pooledContextSections->invalidate(m_contextActionsSection);
+    }
+}
+
+bool MainWindow::eventFilter(QObject *watched, QEvent *event)
+{
+#ifndef QT_NO_CONTEXTMENU
+    if (watched == contextMenu
+        && (event->type() == QEvent::ActionAdded || event->type() == QEvent::ActionRemoved)) {
+        invalidateContextMenu();
     }
 #endif
+    return QMainWindow::eventFilter(watched, event);
 }
 
 void MainWindow::aboutToShowMenu()
@@ -203,8 +294,8 @@ void MainWindow::aboutToShowMenu()
     QQMenu *menu = qobject_cast<QQMenu *>(sender());
 
     if (menu) {
-        bool isMB = isMenubarMenu(menu);
-        qWarning() << Q_FUNC_INFO << "About to show" << menu << "isNativeMenubarMenu=" << isMB;
+        // isMenubarMenu() is only evaluated when the category is enabled
+        qqCDebug(lcMenus) << Q_FUNC_INFO << "About to show" << menu << "isNativeMenubarMenu=" << isMenubarMenu(menu);
     }
 }
 
@@ -214,11 +305,11 @@ void MainWindow::mousePressEvent(QMouseEvent *e)
     switch (e->button()) {
         case Qt::LeftButton:
             e->accept();
-            qWarning() << Q_FUNC_INFO << "event" << e << "accepted";
+            qqCDebug(lcMenus) << Q_FUNC_INFO << "event" << e << "accepted";
             break;
         default:
             e->ignore();
-            qWarning() << Q_FUNC_INFO << "event" << e << "ignored";
+            qqCDebug(lcMenus) << Q_FUNC_INFO << "event" << e << "ignored";
             break;
     }
 }
@@ -233,7 +324,13 @@ void MainWindow::newFile()
 void MainWindow::newWindow()
 {
     infoLabel->setText(tr("Invoked <b>File|New Window</b>"));
-    auto w = new MainWindow(m_shortCutActFlags, m_shortCut, m_nativeMenuBar, this);
+    // a prewarmed window only has to be shown
+    MainWindow *w = qobject_cast<MainWindow*>(windowPool()->take());
+    if (w) {
+        w->setParent(this, w->windowFlags());
+    } else {
+        w = new MainWindow(m_shortCutActFlags, m_shortCut, m_nativeMenuBar, this);
+    }
     w->show();
 }
 
@@ -374,161 +471,93 @@ void MainWindow::aboutQt()
     infoLabel->setText(tr("Invoked <b>Help|About Qt</b>"));
 }
 
+void MainWindow::reportShortcuts()
+{
+    const QStringList report = QQShortcutRegistry::instance()->report();
+    infoLabel->setText(tr("Invoked <b>Help|Shortcut Conflicts</b>"));
+    foreach (const QString &line, report) {
+        qWarning() << qPrintable(line);
+    }
+    QMessageBox::information(this, tr("Shortcut Conflicts"), report.join(QLatin1Char('\n')));
+}
+
+void MainWindow::reportStalls()
+{
+    QQStallWatchdog *watchdog = QQStallWatchdog::instance();
+    infoLabel->setText(tr("Invoked <b>Help|Event Loop Stalls</b>"));
+    if (!watchdog->isRunning()) {
+        QMessageBox::information(this, tr("Event Loop Stalls"), tr("The watchdog is not running (see --watchdog)."));
+        return;
+    }
+    watchdog->dump();
+    QMessageBox::information(this, tr("Event Loop Stalls"), watchdog->report().join(QLatin1Char('\n')));
+}
+
 void MainWindow::shortCutActHandler()
 {
+    // take the timestamp first so the benchmark measures dispatch, not this slot
+    m_lastShortCutDispatch = QQBenchmark::now();
+    m_shortCutDispatchCount += 1;
     infoLabel->setText(tr("Invoked <b>shortcut test action</b>"));
-    qWarning() << Q_FUNC_INFO << "shortCutAct->shortcut=" << shortCutAct->shortcut();
+    qqCDebug(lcShortcuts) << Q_FUNC_INFO << "shortCutAct->shortcut=" << shortCutAct->shortcut();
+}
+
+bool MainWindow::isMenubarMenu(const QMenu *m, bool checkIsNative) const
+{
+    if (m_menuAncestry->contains(m)) {
+        return m_menuAncestry->isMenubarMenu(m, checkIsNative);
+    }
+    // not one of our menus: fall back to walking up its associated widgets
+    return QQMenuAncestry::walkIsMenubarMenu(m, checkIsNative);
 }
 
 //! [4]
 void MainWindow::createActions()
 {
+    QQPhaseProfiler::Scope phase("createActions");
 //! [5]
-    newAct = new QAction(tr("&New"), this);
-    newAct->setShortcuts(QKeySequence::New);
-    newAct->setStatusTip(tr("Create a new file"));
-    connect(newAct, &QAction::triggered, this, &MainWindow::newFile);
-
-    newWindowAct = new QAction(tr("New Window"), this);
-    newWindowAct->setStatusTip(tr("Create a new window"));
-    connect(newWindowAct, &QAction::triggered, this, &MainWindow::newWindow);
-//! [4]
-
-    openAct = new QAction(tr("&Open..."), this);
-    openAct->setShortcuts(QKeySequence::Open);
-    openAct->setStatusTip(tr("Open an existing file"));
-    connect(openAct, &QAction::triggered, this, &MainWindow::open);
+    if (m_sharedActions) {
+        m_actions = sharedRegistry(m_shortCut);
+    } else {
+        m_ownActions.reset(new QQActionRegistry<MainWindow>(this, MainWindowActions::table, "MainWindow"));
+        m_actions = m_ownActions.data();
+        m_actions->setInitializer([this](int id, QAction *action) {
+            initializeAction(id, action, this, m_shortCut);
+        });
+    }
+    if (!s_lazyActions) {
+        m_actions->createAll();
+    }
+    // the actions with a shortcut have to exist before their menu is shown;
+    // the others are created by the menus that hold them (see createMenus())
+    newAct = m_actions->action(NewAction);
+    newWindowAct = m_actions->action(NewWindowAction);
+    openAct = m_actions->action(OpenAction);
+    saveAct = m_actions->action(SaveAction);
+    printAct = m_actions->action(PrintAction);
+    exitAct = m_actions->action(ExitAction);
+    undoAct = m_actions->action(UndoAction);
+    redoAct = m_actions->action(RedoAction);
+    cutAct = m_actions->action(CutAction);
+    copyAct = m_actions->action(CopyAction);
+    pasteAct = m_actions->action(PasteAction);
+    selectAllAct = m_actions->action(SelectAllAction);
+    boldAct = m_actions->action(BoldAction);
+    italicAct = m_actions->action(ItalicAction);
+    leftAlignAct = m_actions->action(LeftAlignAction);
+    rightAlignAct = m_actions->action(RightAlignAction);
+    justifyAct = m_actions->action(JustifyAction);
+    centerAct = m_actions->action(CenterAction);
+    fullScrAct = m_actions->action(FullScreenAction);
+    shortCutAct = m_actions->action(ShortCutTestAction);
 //! [5]
 
-    saveAct = new QAction(tr("&Save"), this);
-    saveAct->setShortcuts(QKeySequence::Save);
-    saveAct->setStatusTip(tr("Save the document to disk"));
-    connect(saveAct, &QAction::triggered, this, &MainWindow::save);
-
-    printAct = new QAction(tr("&Print..."), this);
-    printAct->setShortcuts(QKeySequence::Print);
-    printAct->setStatusTip(tr("Print the document"));
-    connect(printAct, &QAction::triggered, this, &MainWindow::print);
-
-    exitAct = new QAction(tr("E&xit"), this);
-    exitAct->setShortcuts(QKeySequence::Quit);
-    exitAct->setStatusTip(tr("Exit the application"));
-    connect(exitAct, &QAction::triggered, qApp, &QApplication::closeAllWindows);
-
-    undoAct = new QAction(tr("&Undo"), this);
-    undoAct->setShortcuts(QKeySequence::Undo);
-    undoAct->setStatusTip(tr("Undo the last operation"));
-    connect(undoAct, &QAction::triggered, this, &MainWindow::undo);
-
-    redoAct = new QAction(tr("&Redo"), this);
-    redoAct->setShortcuts(QKeySequence::Redo);
-    redoAct->setStatusTip(tr("Redo the last operation"));
-    connect(redoAct, &QAction::triggered, this, &MainWindow::redo);
-
-    cutAct = new QAction(tr("Cu&t"), this);
-    cutAct->setShortcuts(QKeySequence::Cut);
-    cutAct->setStatusTip(tr("Cut the current selection's contents to the "
-                            "clipboard"));
-    connect(cutAct, &QAction::triggered, this, &MainWindow::cut);
-
-    copyAct = new QAction(tr("&Copy"), this);
-    copyAct->setShortcuts(QKeySequence::Copy);
-    copyAct->setStatusTip(tr("Copy the current selection's contents to the "
-                             "clipboard"));
-    connect(copyAct, &QAction::triggered, this, &MainWindow::copy);
-
-    pasteAct = new QAction(tr("&Paste"), this);
-    pasteAct->setShortcuts(QKeySequence::Paste);
-    pasteAct->setStatusTip(tr("Paste the clipboard's contents into the current "
-                              "selection"));
-    connect(pasteAct, &QAction::triggered, this, &MainWindow::paste);
-
-    selectAllAct = new QAction(tr("Select &All"), this);
-    selectAllAct->setShortcuts(QKeySequence::SelectAll);
-    connect(selectAllAct, &QAction::triggered, this, &MainWindow::selectAll);
-
-    boldAct = new QAction(tr("&Bold"), this);
-    boldAct->setCheckable(true);
-    boldAct->setShortcut(QKeySequence::Bold);
-    boldAct->setStatusTip(tr("Make the text bold"));
-    connect(boldAct, &QAction::triggered, this, &MainWindow::bold);
-
-    QFont boldFont = boldAct->font();
-    boldFont.setBold(true);
-    boldAct->setFont(boldFont);
-
-    italicAct = new QAction(tr("&Italic"), this);
-    italicAct->setCheckable(true);
-    italicAct->setShortcut(QKeySequence::Italic);
-    italicAct->setStatusTip(tr("Make the text italic"));
-    connect(italicAct, &QAction::triggered, this, &MainWindow::italic);
-
-    QFont italicFont = italicAct->font();
-    italicFont.setItalic(true);
-    italicAct->setFont(italicFont);
-
-    setLineSpacingAct = new QAction(tr("Set &Line Spacing..."), this);
-    setLineSpacingAct->setStatusTip(tr("Change the gap between the lines of a "
-                                       "paragraph"));
-    connect(setLineSpacingAct, &QAction::triggered, this, &MainWindow::setLineSpacing);
-
-    setParagraphSpacingAct = new QAction(tr("Set &Paragraph Spacing..."), this);
-    setParagraphSpacingAct->setStatusTip(tr("Change the gap between paragraphs"));
-    connect(setParagraphSpacingAct, &QAction::triggered,
-            this, &MainWindow::setParagraphSpacing);
-
-    aboutAct = new QAction(tr("&About"), this);
-    aboutAct->setStatusTip(tr("Show the application's About box"));
-    aboutAct->setIcon(QIcon::fromTheme(QStringLiteral("help-info")));
-    aboutAct->setIconVisibleInMenu(true);
-    connect(aboutAct, &QAction::triggered, this, &MainWindow::about);
-
-    aboutQtAct = new QAction(tr("About &Qt"), this);
-    aboutQtAct->setStatusTip(tr("Show the Qt library's About box"));
-    connect(aboutQtAct, &QAction::triggered, qApp, &QApplication::aboutQt);
-    connect(aboutQtAct, &QAction::triggered, this, &MainWindow::aboutQt);
-
-    leftAlignAct = new QAction(tr("&Left Align"), this);
-    leftAlignAct->setCheckable(true);
-    leftAlignAct->setShortcut(tr("Ctrl+L"));
-    leftAlignAct->setStatusTip(tr("Left align the selected text"));
-    connect(leftAlignAct, &QAction::triggered, this, &MainWindow::leftAlign);
-
-    rightAlignAct = new QAction(tr("&Right Align"), this);
-    rightAlignAct->setCheckable(true);
-    rightAlignAct->setShortcut(tr("Ctrl+R"));
-    rightAlignAct->setStatusTip(tr("Right align the selected text"));
-    connect(rightAlignAct, &QAction::triggered, this, &MainWindow::rightAlign);
-
-    justifyAct = new QAction(tr("&Justify"), this);
-    justifyAct->setCheckable(true);
-    justifyAct->setShortcut(tr("Ctrl+J"));
-    justifyAct->setStatusTip(tr("Justify the selected text"));
-    connect(justifyAct, &QAction::triggered, this, &MainWindow::justify);
-
-    centerAct = new QAction(tr("&Center"), this);
-    centerAct->setCheckable(true);
-    centerAct->setShortcut(tr("Ctrl+E"));
-    centerAct->setStatusTip(tr("Center the selected text"));
-    connect(centerAct, &QAction::triggered, this, &MainWindow::center);
-
-    fullScrAct = new QAction(tr("&Fullscreen"), this);
-    fullScrAct->setCheckable(true);
-    fullScrAct->setShortcut(tr("F7"));
-    connect(fullScrAct, &QAction::triggered, this, &MainWindow::toggleFullScreen);
-
-
-    shortCutAct = new QAction(tr("shortcut test"), this);
-    shortCutAct->setShortcut(m_shortCut);
-    connect(shortCutAct, &QAction::triggered, this, &MainWindow::shortCutActHandler);
-
 //! [6] //! [7]
-    alignmentGroup = new QActionGroup(this);
-    alignmentGroup->addAction(leftAlignAct);
-    alignmentGroup->addAction(rightAlignAct);
-    alignmentGroup->addAction(justifyAct);
-    alignmentGroup->addAction(centerAct);
-    leftAlignAct->setChecked(true);
+    alignmentGroup = m_actions->group(AlignmentGroup);
+    if (!m_sharedActions) {
+        // the shared actions get this window's state when it becomes the context window
+        leftAlignAct->setChecked(true);
+    }
 //! [6]
 #ifndef QT_NO_CONTEXTMENU
     contextMenu = new QQMenu(tr("Static contextMenu"), this);
@@ -542,10 +571,232 @@ void MainWindow::createActions()
         addAction(shortCutAct);
     }
     connect(contextMenu, SIGNAL(aboutToShow()), this, SLOT(aboutToShowContextMenu()));
+    m_menuAncestry->track(contextMenu);
+    contextMenu->installEventFilter(this);
+
+    contextQuitAct = m_actions->action(ContextQuitAction);
 #endif
+    if (m_shortCutActFlags & 4) {
+        // window-level placement: the action doesn't appear in any menu
+        addAction(shortCutAct);
+    }
 }
 //! [7]
 
+void MainWindow::initializeAction(int id, QAction *action, MainWindow *window, const QString &shortCut)
+{
+    // window is nullptr for the shared actions, which act on the context window
+    const auto connectToWindow = [action, window](const std::function<void(MainWindow*)> &slot) {
+        if (window) {
+            connect(action, &QAction::triggered, window, [window, slot]() {
+                slot(window);
+            });
+        } else {
+            connect(action, &QAction::triggered, qApp, [slot]() {
+                if (MainWindow *w = contextWindow()) {
+                    slot(w);
+                }
+            });
+        }
+    };
+    switch (id) {
+        case ExitAction:
+            connect(action, &QAction::triggered, qApp, &QApplication::closeAllWindows);
+            break;
+        case BoldAction:
+        case ItalicAction: {
+            QFont font = action->font();
+            if (id == BoldAction) {
+                font.setBold(true);
+            } else {
+                font.setItalic(true);
+            }
+            action->setFont(font);
+            break;
+        }
+        case AboutAction:
+            action->setIcon(QIcon::fromTheme(QStringLiteral("help-info")));
+            action->setIconVisibleInMenu(true);
+            break;
+        case AboutQtAction:
+            connect(action, &QAction::triggered, qApp, &QApplication::aboutQt);
+            connectToWindow([](MainWindow *w) {
+                w->aboutQt();
+            });
+            break;
+        case ShortCutTestAction:
+            action->setShortcut(shortCut);
+            break;
+        case ContextQuitAction:
+            connectToWindow([](MainWindow *w) {
+                w->close();
+            });
+            break;
+        default:
+            break;
+    }
+}
+
+void MainWindow::setLazyActions(bool lazy)
+{
+    s_lazyActions = lazy;
+}
+
+bool MainWindow::lazyActions()
+{
+    return s_lazyActions;
+}
+
+void MainWindow::setSharedActions(bool shared)
+{
+    s_sharedActions = shared;
+    QWidgetStyleSelector::setShareActions(shared);
+}
+
+bool MainWindow::sharedActions()
+{
+    return s_sharedActions;
+}
+
+QQActionRegistry<MainWindow> *MainWindow::sharedRegistry(const QString &shortCut)
+{
+    // never deleted: its actions belong to the application and live as long as it does
+    static QQActionRegistry<MainWindow> *registry = nullptr;
+    if (!registry) {
+        registry = new QQActionRegistry<MainWindow>(qApp, &MainWindow::contextWindow, MainWindowActions::table, "MainWindow");
+        registry->setInitializer([shortCut](int id, QAction *action) {
+            initializeAction(id, action, nullptr, shortCut);
+        });
+    }
+    return registry;
+}
+
+MainWindow *MainWindow::contextWindow()
+{
+    if (!s_contextWindow) {
+        if (MainWindow *w = qobject_cast<MainWindow*>(QApplication::activeWindow())) {
+            w->becomeContextWindow();
+        }
+    }
+    return s_contextWindow;
+}
+
+quint64 MainWindow::checkedActionState() const
+{
+    quint64 state = 0;
+    for (int id = 0; id < ActionCount; ++id) {
+        const QAction *action = m_actions->existingAction(id);
+        if (action && action->isChecked()) {
+            state |= quint64(1) << id;
+        }
+    }
+    return state;
+}
+
+void MainWindow::becomeContextWindow()
+{
+    if (!m_sharedActions || s_contextWindow == this) {
+        return;
+    }
+    if (s_contextWindow) {
+        s_contextWindow->m_checkedActions = checkedActionState();
+    }
+    s_contextWindow = this;
+    // setChecked() emits toggled(), not triggered(), so no slot runs; the
+    // exclusive groups uncheck and check some actions more than once
+    QQActionUpdateBatch batch;
+    for (int id = 0; id < ActionCount; ++id) {
+        QAction *action = m_actions->existingAction(id);
+        if (action && action->isCheckable()) {
+            action->setChecked(m_checkedActions & (quint64(1) << id));
+        }
+    }
+}
+
+void MainWindow::showEvent(QShowEvent *e)
+{
+    // not from the constructor: prewarmed windows are created hidden
+    if (m_sharedActions) {
+        becomeContextWindow();
+    }
+    QMainWindow::showEvent(e);
+}
+
+QQPrewarmPool *MainWindow::windowPool()
+{
+    static QPointer<QQPrewarmPool> pool;
+    if (!pool) {
+        pool = new QQPrewarmPool(qApp);
+    }
+    return pool;
+}
+
+void MainWindow::changeEvent(QEvent *e)
+{
+    if (e->type() == QEvent::ActivationChange && isActiveWindow()) {
+        becomeContextWindow();
+    }
+    QMainWindow::changeEvent(e);
+}
+
+QList<QAction*> MainWindow::addStressActions(int count, int depth, QList<QMenu*> *leafMenus)
+{
+    // the second and third chords: letters and digits, with and without Shift
+    QVector<int> keys;
+    keys.reserve(72);
+    for (int k = Qt::Key_A; k <= Qt::Key_Z; ++k) {
+        keys << k << (k | Qt::SHIFT);
+    }
+    for (int k = Qt::Key_0; k <= Qt::Key_9; ++k) {
+        keys << k << (k | Qt::SHIFT);
+    }
+    const int perChord = keys.count();
+    const int maxCount = 26 * perChord * perChord;
+    if (count > maxCount) {
+        qWarning() << "Cannot generate more than" << maxCount << "unique shortcuts; limiting to that";
+        count = maxCount;
+    }
+    depth = qMax(1, depth);
+
+    // spread the actions over enough leaves to keep them at a realistic size
+    const int perMenu = depth > 1 ? 50 : qMax(1, count);
+    const int leafCount = qMax(1, (count + perMenu - 1) / perMenu);
+    const int fanOut = depth > 1 ? qMax(2, int(std::ceil(std::pow(double(leafCount), 1.0 / (depth - 1))))) : 1;
+    QList<QMenu*> leaves;
+    QQMenu *top = addMenu(tr("Stress"));
+    std::function<void(QQMenu*, int, const QString&)> grow = [&](QQMenu *parent, int level, const QString &prefix) {
+        for (int i = 1; i <= fanOut && leaves.count() < leafCount; ++i) {
+            const QString title = QStringLiteral("%1.%2").arg(prefix).arg(i);
+            QQMenu *menu = addMenu(title, parent);
+            if (level == depth) {
+                leaves.append(menu);
+            } else {
+                grow(menu, level + 1, title);
+            }
+        }
+    };
+    if (depth == 1) {
+        leaves.append(top);
+    } else {
+        grow(top, 2, QStringLiteral("Stress"));
+    }
+
+    QList<QAction*> actions;
+    actions.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        QMenu *leaf = leaves.at(qMin(i / perMenu, leaves.count() - 1));
+        QAction *action = new QAction(QStringLiteral("Stress action %1").arg(i), leaf);
+        action->setShortcut(QKeySequence(Qt::CTRL | Qt::ALT | (Qt::Key_A + i / (perChord * perChord)),
+                                         keys.at((i / perChord) % perChord), keys.at(i % perChord)));
+        leaf->addAction(action);
+        actions.append(action);
+    }
+    if (leafMenus) {
+        *leafMenus = leaves;
+    }
+    return actions;
+}
+
 void MainWindow::addMenu(QQMenu *menu, QQMenu *target)
 {
     if (target) {
@@ -554,11 +805,7 @@ void MainWindow::addMenu(QQMenu *menu, QQMenu *target)
         menuBar()->addMenu(menu);
     }
 #ifdef SET_MENUFONT
-    QFont f = menu->font();
-    f.setBold(!f.bold());
-    menu->setFont(f);
-    f.setBold(!f.bold());
-    menu->setFont(f);
+    qqSetFontExplicitly(menu);
 #endif
     connect(menu, SIGNAL(aboutToShow()), this, SLOT(aboutToShowMenu()));
 }
@@ -574,11 +821,7 @@ QQMenu *MainWindow::addMenu(const QString &title, QQMenu *target)
         menuBar()->addMenu(menu);
     }
 #ifdef SET_MENUFONT
-    QFont f = menu->font();
-    f.setBold(!f.bold());
-    menu->setFont(f);
-    f.setBold(!f.bold());
-    menu->setFont(f);
+    qqSetFontExplicitly(menu);
 #endif
     connect(menu, SIGNAL(aboutToShow()), this, SLOT(aboutToShowMenu()));
     return menu;
@@ -587,11 +830,11 @@ QQMenu *MainWindow::addMenu(const QString &title, QQMenu *target)
 //! [8]
 void MainWindow::createMenus()
 {
+    QQPhaseProfiler::Scope phase("createMenus");
     QAction *action;
 //! [9] //! [10]
     fileMenu = addMenu(tr("&File"));
-    bool isMB = isMenubarMenu(fileMenu);
-    qWarning() << Q_FUNC_INFO << "fileMenu" << fileMenu << "isNativeMenubarMenu=" << isMB;
+    qqCDebug(lcMenus) << Q_FUNC_INFO << "fileMenu" << fileMenu << "isNativeMenubarMenu=" << isMenubarMenu(fileMenu);
 
     fileMenu->addSection(tr("\u00A7 File Actions \u00A7"));
     fileMenu->addAction(newAct);
@@ -629,8 +872,10 @@ void MainWindow::createMenus()
     action->setDisabled(true);
     helpMenu->addAction(action);
 
-    helpMenu->addAction(aboutAct);
-    helpMenu->addAction(aboutQtAct);
+    // these have no shortcuts, so they can wait until the menu is opened
+    QQMenuSections::sections(helpMenu)->addSection([this]() {
+        return m_actions->actions({ShortcutReportAction, StallReportAction, AboutAction, AboutQtAction});
+    });
 //! [8]
 
 //! [12]
@@ -648,8 +893,10 @@ void MainWindow::createMenus()
     formatMenu->addAction(justifyAct);
     formatMenu->addAction(centerAct);
     formatMenu->addSeparator();
-    formatMenu->addAction(setLineSpacingAct);
-    formatMenu->addAction(setParagraphSpacingAct);
+    QQMenuSections::sections(formatMenu)->addSection([this]() {
+        return m_actions->actions({SetLineSpacingAction, SetParagraphSpacingAction});
+    });
+    QQPhaseProfiler::Scope stylePhase("style menu");
     addMenu( m_widgetStyleSelector.createStyleSelectionMenu(
         QIcon::fromTheme(QStringLiteral("preferences-desktop-theme")), tr("Widget Style"), QString(), editMenu), editMenu);
 }
@@ -52,6 +52,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QScopedPointer>
 
 #define NO_QQMENU
 #ifndef NO_QQMENU
@@ -59,13 +60,17 @@
 #else
 #  include <QMenu>
    using QQMenu = QMenu;
+#  include "qqmenu.h"
 #endif
 
 #include "qwidgetstyleselector.h"
+#include "qqmenuancestry.h"
+#include "qqactionregistry.h"
 
 QT_BEGIN_NAMESPACE
 class QAction;
 class QActionGroup;
+class QQPrewarmPool;
 class QLabel;
 class QString;
 QT_END_NAMESPACE
@@ -76,13 +81,119 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
+    // the actions in the descriptor table, in table order
+    enum ActionId {
+        NewAction,
+        NewWindowAction,
+        OpenAction,
+        SaveAction,
+        PrintAction,
+        ExitAction,
+        UndoAction,
+        RedoAction,
+        CutAction,
+        CopyAction,
+        PasteAction,
+        SelectAllAction,
+        BoldAction,
+        ItalicAction,
+        SetLineSpacingAction,
+        SetParagraphSpacingAction,
+        AboutAction,
+        AboutQtAction,
+        LeftAlignAction,
+        RightAlignAction,
+        JustifyAction,
+        CenterAction,
+        FullScreenAction,
+        ShortCutTestAction,
+        ContextQuitAction,
+        ShortcutReportAction,
+        StallReportAction,
+        ActionCount
+    };
+    enum ActionGroupId {
+        AlignmentGroup
+    };
+
     MainWindow(int shortCutActFlags, QString shortCut="Ctrl+<", bool nativeMenuBar=true, QWidget *parent = nullptr);
 
+    /**
+     * When set (the default), the actions without shortcuts are only created
+     * when their menu is first shown; otherwise all actions are created with
+     * the window. Applies to the windows created afterwards.
+     */
+    static void setLazyActions(bool lazy);
+    static bool lazyActions();
+    /**
+     * When set, the windows created afterwards share a single application-wide
+     * set of actions (including the widget style actions) instead of each
+     * creating their own; they only hold their own menus. The shared actions
+     * act on the context window, the window that was last activated, and
+     * show its state (e.g. which alignment is checked).
+     */
+    static void setSharedActions(bool shared);
+    static bool sharedActions();
+    static MainWindow *contextWindow();
+    /**
+     * The pool of hidden windows newWindow() takes its new window from, if
+     * one is ready. The pool is inactive until it is given a size and a
+     * factory function.
+     */
+    static QQPrewarmPool *windowPool();
+    /**
+     * The number of QActions created from the descriptor table so far
+     * (by all windows together with shared actions).
+     */
+    int createdActionCount() const
+    {
+        return m_actions->createdCount();
+    }
+
+    /**
+     * The number of times the shortcut test action fired in this window,
+     * and the QQBenchmark::now() timestamp at which it last did.
+     */
+    int shortCutDispatchCount() const
+    {
+        return m_shortCutDispatchCount;
+    }
+    qint64 lastShortCutDispatch() const
+    {
+        return m_lastShortCutDispatch;
+    }
+
+    const QQMenuAncestry *menuAncestry() const
+    {
+        return m_menuAncestry;
+    }
+    bool isMenubarMenu(const QMenu *m, bool checkIsNative=true) const;
+
+    /**
+     * Adds @p count generated actions with unique 3-chord shortcuts
+     * (Ctrl+Alt+letter, then two letters or digits, with or without Shift)
+     * to a tree of menus @p depth levels deep below a "Stress" menubar menu.
+     * The deepest menus receive the actions; they are returned in
+     * @p leafMenus when it is set. Returns the generated actions.
+     */
+    QList<QAction*> addStressActions(int count, int depth, QList<QMenu*> *leafMenus = nullptr);
+
+public slots:
+    /**
+     * Mark the context menu for rebuilding the next time it is shown.
+     * This happens automatically when actions are added to or removed
+     * from the static contextMenu.
+     */
+    void invalidateContextMenu();
+
 protected:
 #ifndef QT_NO_CONTEXTMENU
     void contextMenuEvent(QContextMenuEvent *event) Q_DECL_OVERRIDE;
 #endif // QT_NO_CONTEXTMENU
     void mousePressEvent(QMouseEvent *e) Q_DECL_OVERRIDE;
+    void changeEvent(QEvent *e) Q_DECL_OVERRIDE;
+    void showEvent(QShowEvent *e) Q_DECL_OVERRIDE;
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
 //! [0]
 
 //! [1]
@@ -109,6 +220,8 @@ private slots:
     void setParagraphSpacing();
     void about();
     void aboutQt();
+    void reportShortcuts();
+    void reportStalls();
     void shortCutActHandler();
     void aboutToShowContextMenu();
     void aboutToShowMenu();
@@ -117,6 +230,10 @@ private slots:
 //! [2]
 private:
     void createActions();
+    static void initializeAction(int id, QAction *action, MainWindow *window, const QString &shortCut);
+    static QQActionRegistry<MainWindow> *sharedRegistry(const QString &shortCut);
+    void becomeContextWindow();
+    quint64 checkedActionState() const;
     void addMenu(QQMenu *menu, QQMenu *target=nullptr);
     QQMenu *addMenu(const QString &title, QQMenu *target=nullptr);
     void createMenus();
@@ -128,6 +245,10 @@ private:
     QQMenu *formatMenu;
     QQMenu *helpMenu;
     QQMenu *contextMenu;
+    // the context menu that is actually shown, built from contextMenu
+    QQMenu *m_pooledContextMenu;
+    QQMenuSections *m_pooledContextSections;
+    int m_contextActionsSection;
     QActionGroup *alignmentGroup;
     QAction *newAct;
     QAction *newWindowAct;
@@ -147,11 +268,8 @@ private:
     QAction *rightAlignAct;
     QAction *justifyAct;
     QAction *centerAct;
-    QAction *setLineSpacingAct;
-    QAction *setParagraphSpacingAct;
-    QAction *aboutAct;
-    QAction *aboutQtAct;
     QAction *shortCutAct;
+    QAction *contextQuitAct;
     QLabel *infoLabel;
     QAction *fullScrAct;
     const bool m_nativeMenuBar;
@@ -161,6 +279,17 @@ private:
     Qt::WindowFlags m_normalFlags;
     QRect m_normalGeo;
     QWidget *m_normalParent;
+    QQMenuAncestry *m_menuAncestry;
+    int m_shortCutDispatchCount;
+    qint64 m_lastShortCutDispatch;
+    const bool m_sharedActions;
+    // the shared registry, or m_ownActions
+    QQActionRegistry<MainWindow> *m_actions;
+    QScopedPointer<QQActionRegistry<MainWindow> > m_ownActions;
+    // the checked state of the shared checkable actions while another window is the context
+    quint64 m_checkedActions;
+
+    friend struct MainWindowActions;
 };
 //! [3]
 
@@ -3,14 +3,40 @@ QT += widgets gui core concurrent
 
 QMAKE_CXXFLAGS += $$QMAKE_CXXFLAGS_CXX11
 
+# compile the categorised debug output out completely
+no_category_logging {
+    DEFINES += QQ_NO_CATEGORY_LOGGING
+}
+
 HEADERS       = qqmenu.h \
                 main.h \
                 mainwindow.h \
                 qwidgetstyleselector.h \
-                qqnativesemaphore.h
+                qqnativesemaphore.h \
+                qqmenuancestry.h \
+                qqlogging.h \
+                qqbenchmark.h \
+                qqshutdown.h \
+                qqactionregistry.h \
+                qqshortcutregistry.h \
+                qqprewarmpool.h \
+                qqeventrecorder.h \
+                qqstallwatchdog.h \
+                qqnotifyprofiler.h \
+                benchmarks.h
 SOURCES       = mainwindow.cpp \
                 qwidgetstyleselector.cpp \
                 qqmenu.cpp \
+                qqmenuancestry.cpp \
+                qqlogging.cpp \
+                qqbenchmark.cpp \
+                qqshutdown.cpp \
+                qqshortcutregistry.cpp \
+                qqprewarmpool.cpp \
+                qqeventrecorder.cpp \
+                qqstallwatchdog.cpp \
+                qqnotifyprofiler.cpp \
+                benchmarks.cpp \
                 main.cpp
 unix {
     SOURCES += qqnativesemaphore_unix.cpp
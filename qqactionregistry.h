@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQACTIONREGISTRY_H
+#define QQACTIONREGISTRY_H
+
+#include <QAction>
+#include <QActionGroup>
+#include <QCoreApplication>
+#include <QHash>
+#include <QKeySequence>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+
+/**
+ * QQActionDescriptor : one entry of a constant table of QActions whose
+ * triggered() signal is connected to a slot of a @p Target object.
+ * The strings are untranslated (mark them with QT_TR_NOOP) and must
+ * be literals; the table is meant to be constexpr.
+ */
+template <class Target>
+struct QQActionDescriptor
+{
+    typedef void (Target::*Slot)();
+
+    // the index of this entry in the table
+    int id;
+    const char *text;
+    // QKeySequence::UnknownKey to use @p shortcut instead
+    QKeySequence::StandardKey standardKey;
+    // a portable key sequence string, or nullptr
+    const char *shortcut;
+    const char *statusTip;
+    bool checkable;
+    // the index of the exclusive QActionGroup this action belongs to, or -1
+    int group;
+    // may be nullptr when the connection is made by the initializer
+    Slot slot;
+};
+
+/**
+ * Returns true when each descriptor in @p table has its index as id, which
+ * QQActionRegistry relies on. Use it in a static_assert.
+ */
+template <class Target, std::size_t N>
+constexpr bool qqActionIdsAreIndices(const QQActionDescriptor<Target> (&table)[N], std::size_t i = 0)
+{
+    return i == N || (table[i].id == int(i) && qqActionIdsAreIndices(table, i + 1));
+}
+
+/**
+ * QQActionRegistry : creates the QActions described by a table of
+ * QQActionDescriptors for a @p Target object, either all in one pass
+ * with createAll() or one by one as they are first requested through
+ * action() or actions(). The latter can serve as a QQMenuSections
+ * content provider so that actions without shortcuts are only created
+ * when their menu is first shown.
+ *
+ * The translated texts and the key bindings of a table are resolved once
+ * and then shared (implicitly) by the actions of all registries that use
+ * the same table, so every window after the first one only pays for the
+ * QAction itself.
+ *
+ * A registry can also serve several targets: the actions then belong to an
+ * owner object and their slots are invoked on the target that a resolver
+ * function returns when they are triggered (e.g. the active window).
+ */
+template <class Target>
+class QQActionRegistry
+{
+public:
+    typedef QQActionDescriptor<Target> Descriptor;
+    /**
+     * Called for each action right after it was created from its
+     * descriptor, for the settings a table entry cannot hold.
+     */
+    typedef std::function<void(int id, QAction *action)> Initializer;
+    typedef std::function<Target*()> Resolver;
+
+    /**
+     * Creates a registry for the actions in @p table, which will be children of
+     * @p target. The strings in @p table are translated in the @p context
+     * translation context.
+     */
+    template <std::size_t N>
+    QQActionRegistry(Target *target, const Descriptor (&table)[N], const char *context)
+        : m_owner(target)
+        , m_target(target)
+        , m_table(table)
+        , m_count(int(N))
+        , m_context(context)
+        , m_actions(int(N), nullptr)
+        , m_createdCount(0)
+    {}
+    /**
+     * Creates a registry for actions that are children of @p owner and whose
+     * slots are invoked on the object @p resolver returns at the time they
+     * are triggered (nothing happens when it returns nullptr).
+     */
+    template <std::size_t N>
+    QQActionRegistry(QObject *owner, const Resolver &resolver, const Descriptor (&table)[N], const char *context)
+        : m_owner(owner)
+        , m_target(nullptr)
+        , m_resolver(resolver)
+        , m_table(table)
+        , m_count(int(N))
+        , m_context(context)
+        , m_actions(int(N), nullptr)
+        , m_createdCount(0)
+    {}
+
+    void setInitializer(const Initializer &initializer)
+    {
+        m_initializer = initializer;
+    }
+
+    int count() const
+    {
+        return m_count;
+    }
+    /**
+     * The number of actions that have been created so far.
+     */
+    int createdCount() const
+    {
+        return m_createdCount;
+    }
+
+    /**
+     * Returns the action @p id, creating it if required.
+     */
+    QAction *action(int id)
+    {
+        QAction *&a = m_actions[id];
+        if (!a) {
+            a = create(id);
+        }
+        return a;
+    }
+    /**
+     * Returns the action @p id if it has been created, nullptr otherwise.
+     */
+    QAction *existingAction(int id) const
+    {
+        return m_actions.at(id);
+    }
+    QList<QAction*> actions(std::initializer_list<int> ids)
+    {
+        QList<QAction*> result;
+        result.reserve(int(ids.size()));
+        for (int id : ids) {
+            result.append(action(id));
+        }
+        return result;
+    }
+    /**
+     * Creates all the actions that don't exist yet, in table order.
+     */
+    void createAll()
+    {
+        for (int id = 0; id < m_count; ++id) {
+            action(id);
+        }
+    }
+
+    /**
+     * Returns the exclusive action group @p index, creating it if required.
+     */
+    QActionGroup *group(int index)
+    {
+        if (index >= m_groups.count()) {
+            m_groups.resize(index + 1);
+        }
+        QActionGroup *&g = m_groups[index];
+        if (!g) {
+            g = new QActionGroup(m_owner);
+        }
+        return g;
+    }
+
+private:
+    // the parts of a descriptor that cost allocations, shared between registries
+    struct Resolved {
+        Resolved()
+            : valid(false)
+        {}
+        bool valid;
+        QString text;
+        QString statusTip;
+        QList<QKeySequence> shortcuts;
+    };
+
+    static QHash<const void*, QVector<Resolved> > &resolvedTables()
+    {
+        static QHash<const void*, QVector<Resolved> > tables;
+        return tables;
+    }
+
+    const Resolved &resolved(int id)
+    {
+        QVector<Resolved> &table = resolvedTables()[m_table];
+        if (table.isEmpty()) {
+            table.resize(m_count);
+        }
+        Resolved &r = table[id];
+        if (!r.valid) {
+            const Descriptor &d = m_table[id];
+            r.text = QCoreApplication::translate(m_context, d.text);
+            if (d.statusTip) {
+                r.statusTip = QCoreApplication::translate(m_context, d.statusTip);
+            }
+            if (d.standardKey != QKeySequence::UnknownKey) {
+                r.shortcuts = QKeySequence::keyBindings(d.standardKey);
+            } else if (d.shortcut) {
+                r.shortcuts.append(QKeySequence(QCoreApplication::translate(m_context, d.shortcut)));
+            }
+            r.valid = true;
+        }
+        return r;
+    }
+
+    QAction *create(int id)
+    {
+        const Descriptor &d = m_table[id];
+        const Resolved &r = resolved(id);
+        QAction *a = new QAction(r.text, m_owner);
+        if (!r.shortcuts.isEmpty()) {
+            a->setShortcuts(r.shortcuts);
+        }
+        if (!r.statusTip.isEmpty()) {
+            a->setStatusTip(r.statusTip);
+        }
+        if (d.checkable) {
+            a->setCheckable(true);
+        }
+        if (d.group >= 0) {
+            group(d.group)->addAction(a);
+        }
+        if (d.slot && m_target) {
+            QObject::connect(a, &QAction::triggered, m_target, d.slot);
+        } else if (d.slot) {
+            const typename Descriptor::Slot slot = d.slot;
+            const Resolver resolver = m_resolver;
+            QObject::connect(a, &QAction::triggered, m_owner, [slot, resolver]() {
+                if (Target *target = resolver()) {
+                    (target->*slot)();
+                }
+            });
+        }
+        ++m_createdCount;
+        if (m_initializer) {
+            m_initializer(id, a);
+        }
+        return a;
+    }
+
+    QObject *m_owner;
+    Target *m_target;
+    Resolver m_resolver;
+    const Descriptor *m_table;
+    const int m_count;
+    const char *m_context;
+    QVector<QAction*> m_actions;
+    QVector<QActionGroup*> m_groups;
+    int m_createdCount;
+    Initializer m_initializer;
+};
+
+#endif
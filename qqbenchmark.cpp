@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqbenchmark.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_MACOS
+#include <mach/mach.h>
+#endif
+
+QQLatencyStats::QQLatencyStats(const QString &name, int expectedSamples)
+    : m_name(name)
+    , m_sorted(true)
+{
+    if (expectedSamples > 0) {
+        m_samples.reserve(expectedSamples);
+    }
+}
+
+void QQLatencyStats::clear()
+{
+    // resize() rather than clear() so the reserved storage is kept
+    m_samples.resize(0);
+    m_sorted = true;
+}
+
+void QQLatencyStats::sort() const
+{
+    if (!m_sorted) {
+        std::sort(m_samples.begin(), m_samples.end());
+        m_sorted = true;
+    }
+}
+
+qint64 QQLatencyStats::min() const
+{
+    if (m_samples.isEmpty()) {
+        return -1;
+    }
+    sort();
+    return m_samples.first();
+}
+
+qint64 QQLatencyStats::max() const
+{
+    if (m_samples.isEmpty()) {
+        return -1;
+    }
+    sort();
+    return m_samples.last();
+}
+
+double QQLatencyStats::mean() const
+{
+    if (m_samples.isEmpty()) {
+        return 0;
+    }
+    double sum = 0;
+    foreach (qint64 s, m_samples) {
+        sum += s;
+    }
+    return sum / m_samples.count();
+}
+
+double QQLatencyStats::stddev() const
+{
+    const int n = m_samples.count();
+    if (n < 2) {
+        return 0;
+    }
+    const double m = mean();
+    double sum = 0;
+    foreach (qint64 s, m_samples) {
+        sum += (s - m) * (s - m);
+    }
+    return std::sqrt(sum / (n - 1));
+}
+
+qint64 QQLatencyStats::percentile(double p) const
+{
+    const int n = m_samples.count();
+    if (n == 0) {
+        return -1;
+    }
+    sort();
+    int rank = int(std::ceil(p / 100.0 * n)) - 1;
+    rank = qBound(0, rank, n - 1);
+    return m_samples.at(rank);
+}
+
+QJsonObject QQLatencyStats::toJson(bool withSamples) const
+{
+    QJsonObject obj;
+    if (!m_name.isEmpty()) {
+        obj.insert(QStringLiteral("name"), m_name);
+    }
+    obj.insert(QStringLiteral("count"), count());
+    obj.insert(QStringLiteral("min_ns"), double(min()));
+    obj.insert(QStringLiteral("p50_ns"), double(percentile(50)));
+    obj.insert(QStringLiteral("p95_ns"), double(percentile(95)));
+    obj.insert(QStringLiteral("p99_ns"), double(percentile(99)));
+    obj.insert(QStringLiteral("max_ns"), double(max()));
+    obj.insert(QStringLiteral("mean_ns"), mean());
+    obj.insert(QStringLiteral("stddev_ns"), stddev());
+    if (withSamples) {
+        QJsonArray samples;
+        foreach (qint64 s, m_samples) {
+            samples.append(double(s));
+        }
+        obj.insert(QStringLiteral("samples_ns"), samples);
+    }
+    return obj;
+}
+
+QString QQLatencyStats::summary() const
+{
+    return QStringLiteral("%1: n=%2 p50=%3 p95=%4 p99=%5 max=%6")
+        .arg(m_name, -24)
+        .arg(count())
+        .arg(QQBenchmark::formatNsecs(percentile(50)))
+        .arg(QQBenchmark::formatNsecs(percentile(95)))
+        .arg(QQBenchmark::formatNsecs(percentile(99)))
+        .arg(QQBenchmark::formatNsecs(max()));
+}
+
+QQLatencyHistogram::QQLatencyHistogram(const QString &name)
+    : m_name(name)
+{
+    reset();
+}
+
+void QQLatencyHistogram::reset()
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_max.store(-1, std::memory_order_relaxed);
+}
+
+int QQLatencyHistogram::bucketOf(qint64 nsecs)
+{
+    if (nsecs < 2 * SubBuckets) {
+        return nsecs < 0 ? 0 : int(nsecs);
+    }
+    int msb = 0;
+    for (quint64 v = quint64(nsecs); v > 1; v >>= 1) {
+        msb += 1;
+    }
+    // msb >= SubBucketBits + 1; keep the SubBucketBits bits below it
+    const int shift = msb - SubBucketBits;
+    const int bucket = 2 * SubBuckets + (msb - SubBucketBits - 1) * SubBuckets
+        + int((quint64(nsecs) >> shift) - SubBuckets);
+    return qMin(bucket, int(BucketCount) - 1);
+}
+
+qint64 QQLatencyHistogram::upperBoundOf(int bucket)
+{
+    if (bucket < 2 * SubBuckets) {
+        return bucket;
+    }
+    const int octave = (bucket - 2 * SubBuckets) / SubBuckets;
+    const int sub = (bucket - 2 * SubBuckets) % SubBuckets;
+    const int shift = octave + 1;
+    return ((qint64(SubBuckets + sub) + 1) << shift) - 1;
+}
+
+void QQLatencyHistogram::record(qint64 nsecs)
+{
+    m_buckets[bucketOf(nsecs)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while (nsecs > max && !m_max.compare_exchange_weak(max, nsecs, std::memory_order_relaxed)) {
+    }
+}
+
+qint64 QQLatencyHistogram::percentile(double p) const
+{
+    const quint64 n = count();
+    if (n == 0) {
+        return -1;
+    }
+    const quint64 rank = qMax<quint64>(1, quint64(std::ceil(p / 100.0 * n)));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return qMin(upperBoundOf(i), max());
+        }
+    }
+    return max();
+}
+
+QJsonObject QQLatencyHistogram::toJson(bool withBuckets) const
+{
+    QJsonObject obj;
+    if (!m_name.isEmpty()) {
+        obj.insert(QStringLiteral("name"), m_name);
+    }
+    obj.insert(QStringLiteral("count"), double(count()));
+    obj.insert(QStringLiteral("p50_ns"), double(percentile(50)));
+    obj.insert(QStringLiteral("p95_ns"), double(percentile(95)));
+    obj.insert(QStringLiteral("p99_ns"), double(percentile(99)));
+    obj.insert(QStringLiteral("p999_ns"), double(percentile(99.9)));
+    obj.insert(QStringLiteral("max_ns"), double(max()));
+    if (withBuckets) {
+        QJsonArray buckets;
+        for (int i = 0; i < BucketCount; ++i) {
+            const quint64 n = m_buckets[i].load(std::memory_order_relaxed);
+            if (n) {
+                buckets.append(QJsonArray() << double(upperBoundOf(i)) << double(n));
+            }
+        }
+        obj.insert(QStringLiteral("buckets"), buckets);
+    }
+    return obj;
+}
+
+QString QQLatencyHistogram::summary() const
+{
+    return QStringLiteral("%1: n=%2 p50=%3 p99=%4 p99.9=%5 max=%6")
+        .arg(m_name, -24)
+        .arg(count())
+        .arg(QQBenchmark::formatNsecs(percentile(50)))
+        .arg(QQBenchmark::formatNsecs(percentile(99)))
+        .arg(QQBenchmark::formatNsecs(percentile(99.9)))
+        .arg(QQBenchmark::formatNsecs(max()));
+}
+
+QQPhaseProfiler::QQPhaseProfiler()
+    : m_enabled(false)
+{
+    m_phases.reserve(64);
+}
+
+QQPhaseProfiler *QQPhaseProfiler::instance()
+{
+    static QQPhaseProfiler profiler;
+    return &profiler;
+}
+
+void QQPhaseProfiler::begin(const char *name)
+{
+    if (!m_enabled) {
+        return;
+    }
+    Phase phase;
+    phase.name = name;
+    phase.parent = m_open.isEmpty() ? -1 : m_open.last();
+    phase.end = -1;
+    m_open.append(m_phases.count());
+    // take the time last so the bookkeeping is not included
+    phase.start = QQBenchmark::now();
+    m_phases.append(phase);
+}
+
+void QQPhaseProfiler::end()
+{
+    if (!m_enabled) {
+        return;
+    }
+    const qint64 t = QQBenchmark::now();
+    if (!m_open.isEmpty()) {
+        m_phases[m_open.takeLast()].end = t;
+    }
+}
+
+void QQPhaseProfiler::clear()
+{
+    m_phases.resize(0);
+    m_open.resize(0);
+}
+
+QString QQPhaseProfiler::path(int index) const
+{
+    QString p = QString::fromLatin1(m_phases.at(index).name);
+    for (int i = m_phases.at(index).parent; i >= 0; i = m_phases.at(i).parent) {
+        p = QString::fromLatin1(m_phases.at(i).name) + QLatin1Char('/') + p;
+    }
+    return p;
+}
+
+QVector<QPair<QString,qint64> > QQPhaseProfiler::phases() const
+{
+    QVector<QPair<QString,qint64> > result;
+    for (int i = 0; i < m_phases.count(); ++i) {
+        if (m_phases.at(i).end >= 0) {
+            result.append(qMakePair(path(i), m_phases.at(i).end - m_phases.at(i).start));
+        }
+    }
+    return result;
+}
+
+QJsonObject QQPhaseProfiler::toJson() const
+{
+    // build the children bottom-up: a child always comes after its parent
+    QVector<QJsonArray> children(m_phases.count());
+    QJsonArray roots;
+    for (int i = m_phases.count() - 1; i >= 0; --i) {
+        const Phase &phase = m_phases.at(i);
+        if (phase.end < 0) {
+            continue;
+        }
+        QJsonObject node;
+        node.insert(QStringLiteral("name"), QString::fromLatin1(phase.name));
+        node.insert(QStringLiteral("ns"), double(phase.end - phase.start));
+        if (!children.at(i).isEmpty()) {
+            node.insert(QStringLiteral("children"), children.at(i));
+        }
+        QJsonArray &siblings = phase.parent >= 0 ? children[phase.parent] : roots;
+        siblings.prepend(node);
+    }
+    QJsonObject obj;
+    obj.insert(QStringLiteral("phases"), roots);
+    return obj;
+}
+
+void QQPhaseProfiler::printTree(const QVector<QPair<QString,qint64> > &phases)
+{
+    for (int i = 0; i < phases.count(); ++i) {
+        const QString &path = phases.at(i).first;
+        const int depth = path.count(QLatin1Char('/'));
+        const QString name = path.section(QLatin1Char('/'), -1);
+        QQBenchmark::print(QStringLiteral("%1%2 %3")
+            .arg(QString(depth * 2, QLatin1Char(' ')))
+            .arg(name, -(32 - depth * 2))
+            .arg(QQBenchmark::formatNsecs(phases.at(i).second), 10));
+    }
+}
+
+qint64 QQBenchmark::now()
+{
+    static QElapsedTimer timer;
+    if (!timer.isValid()) {
+        timer.start();
+    }
+    return timer.nsecsElapsed();
+}
+
+qint64 QQBenchmark::residentSetSize()
+{
+#if defined(Q_OS_LINUX)
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        long size = 0, resident = 0;
+        int n = fscanf(fp, "%ld %ld", &size, &resident);
+        fclose(fp);
+        if (n == 2) {
+            return qint64(resident) * sysconf(_SC_PAGESIZE);
+        }
+    }
+    return -1;
+#elif defined(Q_OS_MACOS)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+        return qint64(info.resident_size);
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+int QQBenchmark::threadCount()
+{
+#if defined(Q_OS_LINUX)
+    return QDir(QStringLiteral("/proc/self/task")).entryList(QDir::Dirs | QDir::NoDotAndDotDot).count();
+#elif defined(Q_OS_MACOS)
+    thread_act_array_t threads;
+    mach_msg_type_number_t count = 0;
+    if (task_threads(mach_task_self(), &threads, &count) == KERN_SUCCESS) {
+        for (mach_msg_type_number_t i = 0; i < count; ++i) {
+            mach_port_deallocate(mach_task_self(), threads[i]);
+        }
+        vm_deallocate(mach_task_self(), vm_address_t(threads), count * sizeof(thread_act_t));
+        return int(count);
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+int QQBenchmark::openFileDescriptors()
+{
+#if defined(Q_OS_LINUX)
+    const QString fdDir = QStringLiteral("/proc/self/fd");
+#elif defined(Q_OS_MACOS)
+    const QString fdDir = QStringLiteral("/dev/fd");
+#else
+    const QString fdDir;
+#endif
+    if (fdDir.isEmpty()) {
+        return -1;
+    }
+    // don't count the descriptor used to read the directory itself
+    return QDir(fdDir).entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count() - 1;
+}
+
+QString QQBenchmark::formatNsecs(qint64 nsecs)
+{
+    if (nsecs < 0) {
+        return QStringLiteral("n/a");
+    } else if (nsecs < 10000) {
+        return QStringLiteral("%1ns").arg(nsecs);
+    } else if (nsecs < 10000000) {
+        return QStringLiteral("%1us").arg(nsecs / 1e3, 0, 'f', 1);
+    }
+    return QStringLiteral("%1ms").arg(nsecs / 1e6, 0, 'f', 2);
+}
+
+void QQBenchmark::print(const QString &line)
+{
+    fprintf(stdout, "%s\n", line.toLocal8Bit().constData());
+    fflush(stdout);
+}
+
+bool QQBenchmark::writeJson(const QString &fileName, const QJsonObject &object)
+{
+    const QByteArray json = QJsonDocument(object).toJson();
+    if (fileName.isEmpty() || fileName == QStringLiteral("-")) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        fflush(stdout);
+        return true;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write benchmark results to" << fileName << ":" << file.errorString();
+        return false;
+    }
+    return file.write(json) == json.size();
+}
+
+QJsonObject QQBenchmark::readJson(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot read benchmark results from" << fileName << ":" << file.errorString();
+        return QJsonObject();
+    }
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (!document.isObject()) {
+        qWarning() << "No benchmark results in" << fileName << ":" << error.errorString();
+        return QJsonObject();
+    }
+    return document.object();
+}
+
+// the continued fraction of the incomplete beta function (modified Lentz's method)
+static double betaContinuedFraction(double a, double b, double x)
+{
+    const double epsilon = 3e-14, tiny = 1e-300;
+    const double qab = a + b, qap = a + 1, qam = a - 1;
+    double c = 1, d = 1 - qab * x / qap;
+    d = 1 / (std::fabs(d) < tiny ? tiny : d);
+    double h = d;
+    for (int m = 1; m <= 300; ++m) {
+        const int m2 = 2 * m;
+        // the even and the odd step of the recurrence
+        double aa = m * (b - m) * x / ((qam + m2) * (a + m2));
+        d = 1 + aa * d;
+        d = 1 / (std::fabs(d) < tiny ? tiny : d);
+        c = 1 + aa / c;
+        c = std::fabs(c) < tiny ? tiny : c;
+        h *= d * c;
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2));
+        d = 1 + aa * d;
+        d = 1 / (std::fabs(d) < tiny ? tiny : d);
+        c = 1 + aa / c;
+        c = std::fabs(c) < tiny ? tiny : c;
+        const double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1) < epsilon) {
+            break;
+        }
+    }
+    return h;
+}
+
+// the regularized incomplete beta function I_x(a, b)
+static double incompleteBeta(double a, double b, double x)
+{
+    if (x <= 0) {
+        return 0;
+    } else if (x >= 1) {
+        return 1;
+    }
+    const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b)
+                                  + a * std::log(x) + b * std::log(1 - x));
+    // the continued fraction converges quickly on this side of the mean only
+    if (x < (a + 1) / (a + b + 2)) {
+        return front * betaContinuedFraction(a, b, x) / a;
+    }
+    return 1 - front * betaContinuedFraction(b, a, 1 - x) / b;
+}
+
+double QQBenchmark::studentTUpperTail(double t, double degreesOfFreedom)
+{
+    const double tail = 0.5 * incompleteBeta(degreesOfFreedom / 2, 0.5, degreesOfFreedom / (degreesOfFreedom + t * t));
+    return t >= 0 ? tail : 1 - tail;
+}
+
+double QQBenchmark::welchTest(double mean1, double stddev1, int n1, double mean2, double stddev2, int n2)
+{
+    if (n1 < 2 || n2 < 2) {
+        return 1;
+    }
+    const double v1 = stddev1 * stddev1 / n1, v2 = stddev2 * stddev2 / n2;
+    if (v1 + v2 <= 0) {
+        // two constant samples
+        return mean2 > mean1 ? 0 : 1;
+    }
+    const double t = (mean2 - mean1) / std::sqrt(v1 + v2);
+    // the Welch-Satterthwaite approximation of the degrees of freedom
+    const double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    return studentTUpperTail(t, df);
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQBENCHMARK_H
+#define QQBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+#include <QPair>
+
+#include <atomic>
+
+/**
+ * QQLatencyStats : a collection of latency samples (in nanoseconds)
+ * with the order statistics we report for them.
+ *
+ * Storage can be reserved up front so that adding samples from inside
+ * a measurement loop does not allocate.
+ */
+class QQLatencyStats
+{
+public:
+    explicit QQLatencyStats(const QString &name = QString(), int expectedSamples = 0);
+
+    void reserve(int n)
+    {
+        m_samples.reserve(n);
+    }
+    void addSample(qint64 nsecs)
+    {
+        m_samples.append(nsecs);
+        m_sorted = false;
+    }
+    void clear();
+
+    QString name() const
+    {
+        return m_name;
+    }
+    int count() const
+    {
+        return m_samples.count();
+    }
+
+    qint64 min() const;
+    qint64 max() const;
+    double mean() const;
+    /**
+     * The sample standard deviation (with Bessel's n - 1), as
+     * QQBenchmark::welchTest() expects it; 0 for fewer than 2 samples.
+     */
+    double stddev() const;
+    /**
+     * Returns the nearest-rank percentile @p p (0-100) of the samples,
+     * or -1 when there are none.
+     */
+    qint64 percentile(double p) const;
+    qint64 median() const
+    {
+        return percentile(50);
+    }
+
+    /**
+     * Returns the statistics as a JSON object; the raw samples are
+     * included when @p withSamples is set.
+     */
+    QJsonObject toJson(bool withSamples = false) const;
+    /**
+     * Returns a single human-readable line with count, p50, p95, p99 and max.
+     */
+    QString summary() const;
+
+private:
+    void sort() const;
+
+    QString m_name;
+    mutable QVector<qint64> m_samples;
+    mutable bool m_sorted;
+};
+
+/**
+ * QQLatencyHistogram : an HDR-style histogram of latencies (in nanoseconds)
+ * for long-running measurements, where keeping every sample is not an
+ * option. Values below 128ns are counted exactly; above that every power of
+ * two is split into 64 buckets, so the reported percentiles are within 1.6%
+ * of the true value, up to about 39 hours. The storage is fixed (22KB).
+ *
+ * record() is wait-free and can be called from any thread, concurrently
+ * with the readers.
+ */
+class QQLatencyHistogram
+{
+public:
+    explicit QQLatencyHistogram(const QString &name = QString());
+
+    void record(qint64 nsecs);
+    void reset();
+
+    QString name() const
+    {
+        return m_name;
+    }
+    quint64 count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+    qint64 max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+    /**
+     * Returns the highest value equivalent to the percentile @p p (0-100),
+     * or -1 when nothing was recorded.
+     */
+    qint64 percentile(double p) const;
+
+    /**
+     * As QQLatencyStats::toJson(), with the non-empty buckets as
+     * [upper bound, count] pairs when @p withBuckets is set.
+     */
+    QJsonObject toJson(bool withBuckets = false) const;
+    QString summary() const;
+
+private:
+    enum {
+        SubBucketBits = 6,
+        SubBuckets = 1 << SubBucketBits,
+        // exact values up to 2 * SubBuckets, then 41 powers of two
+        BucketCount = 2 * SubBuckets + 41 * SubBuckets
+    };
+    static int bucketOf(qint64 nsecs);
+    static qint64 upperBoundOf(int bucket);
+
+    QString m_name;
+    std::atomic<quint64> m_buckets[BucketCount];
+    std::atomic<quint64> m_count;
+    std::atomic<qint64> m_max;
+};
+
+/**
+ * QQPhaseProfiler : records a tree of named, nested phases (e.g. of the
+ * application startup). Phases are delimited with QQPhaseProfiler::Scope
+ * objects; while the profiler is disabled a scope costs a single branch.
+ */
+class QQPhaseProfiler
+{
+public:
+    static QQPhaseProfiler *instance();
+
+    void setEnabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * Start and end a phase explicitly; both are no-ops while disabled.
+     * @p name must remain valid (a literal).
+     */
+    void begin(const char *name);
+    void end();
+    void clear();
+
+    /**
+     * The completed phases as (path, nanoseconds) pairs in start order; the
+     * path joins the names of the enclosing phases with a '/'.
+     */
+    QVector<QPair<QString,qint64> > phases() const;
+    /**
+     * The phases as a tree of {name, ns, children} objects.
+     */
+    QJsonObject toJson() const;
+
+    /**
+     * Prints @p phases (as returned by phases(), or aggregated from
+     * several runs) as an indented tree.
+     */
+    static void printTree(const QVector<QPair<QString,qint64> > &phases);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name)
+            : m_profiler(QQPhaseProfiler::instance()->isEnabled() ? QQPhaseProfiler::instance() : nullptr)
+        {
+            if (m_profiler) {
+                m_profiler->begin(name);
+            }
+        }
+        ~Scope()
+        {
+            if (m_profiler) {
+                m_profiler->end();
+            }
+        }
+    private:
+        QQPhaseProfiler *m_profiler;
+    };
+
+private:
+    QQPhaseProfiler();
+
+    struct Phase {
+        const char *name;
+        int parent;
+        qint64 start, end;
+    };
+    QString path(int index) const;
+
+    bool m_enabled;
+    QVector<Phase> m_phases;
+    QVector<int> m_open;
+};
+
+/**
+ * Helpers shared by the benchmark modes.
+ */
+namespace QQBenchmark
+{
+    /**
+     * Monotonic time in nanoseconds, counted from the first call.
+     */
+    qint64 now();
+    /**
+     * Current resident set size in bytes, or -1 if it cannot be determined.
+     */
+    qint64 residentSetSize();
+    /**
+     * Number of threads in this process, or -1 if it cannot be determined.
+     */
+    int threadCount();
+    /**
+     * Number of open file descriptors, or -1 if it cannot be determined.
+     */
+    int openFileDescriptors();
+
+    QString formatNsecs(qint64 nsecs);
+    /**
+     * Writes @p line to stdout (benchmark reports do not go through qWarning).
+     */
+    void print(const QString &line);
+    bool writeJson(const QString &fileName, const QJsonObject &object);
+    /**
+     * Reads the JSON object in @p fileName; returns an empty object (with a
+     * warning) when the file cannot be read or does not hold an object.
+     */
+    QJsonObject readJson(const QString &fileName);
+
+    /**
+     * The probability that a Student's t variate with @p degreesOfFreedom
+     * exceeds @p t.
+     */
+    double studentTUpperTail(double t, double degreesOfFreedom);
+    /**
+     * Welch's t-test for samples with unequal variances: returns the one-sided
+     * p-value for the hypothesis that the second sample comes from a population
+     * with a higher mean than the first, given the mean, sample standard deviation
+     * (n - 1 in the denominator, as QQLatencyStats::stddev() and its stddev_ns)
+     * and size of each. Samples of fewer than 2 values give 1 (no evidence).
+     */
+    double welchTest(double mean1, double stddev1, int n1, double mean2, double stddev2, int n2);
+}
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqeventrecorder.h"
+
+#include <QApplication>
+#include <QContextMenuEvent>
+#include <QJsonValue>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QWidget>
+#include <QWindow>
+#include <QDebug>
+#include <qpa/qwindowsysteminterface.h>
+
+#include <cstring>
+
+using namespace QQEventRecording;
+
+// the format is mapped as is, so its layout must not depend on the compiler
+Q_STATIC_ASSERT(sizeof(Header) == 24);
+Q_STATIC_ASSERT(sizeof(Record) == 40);
+
+static const quint64 initialCapacity = 4096;
+
+WindowList::WindowList(const char *windowClass)
+    : m_windowClass(windowClass)
+{
+}
+
+void WindowList::shown(QObject *watched)
+{
+    if (!watched->isWidgetType() || !watched->inherits(m_windowClass)) {
+        return;
+    }
+    QWidget *widget = static_cast<QWidget*>(watched);
+    if (widget->isWindow() && !m_widgets.contains(widget)) {
+        m_widgets.append(widget);
+    }
+}
+
+bool WindowList::locate(const QObject *window, Target *target, quint8 *index) const
+{
+    for (int i = 0; i < m_widgets.count() && i < 256; ++i) {
+        const QWidget *widget = m_widgets.at(i);
+        if (widget && widget->windowHandle() == window) {
+            *target = Window;
+            *index = quint8(i);
+            return true;
+        }
+    }
+    const QWidget *popup = QApplication::activePopupWidget();
+    if (popup && popup->windowHandle() == window) {
+        *target = Popup;
+        *index = 0;
+        return true;
+    }
+    return false;
+}
+
+QWindow *WindowList::window(Target target, int index) const
+{
+    const QWidget *widget = nullptr;
+    if (target == Popup) {
+        widget = QApplication::activePopupWidget();
+    } else if (index < m_widgets.count()) {
+        widget = m_widgets.at(index);
+    }
+    return widget && widget->isVisible() ? widget->windowHandle() : nullptr;
+}
+
+QQEventRecorder::QQEventRecorder(const char *windowClass, QObject *parent)
+    : QObject(parent)
+    , m_windows(windowClass)
+    , m_map(nullptr)
+    , m_count(0)
+    , m_capacity(0)
+    , m_pressFromOverride(false)
+{
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &QQEventRecorder::stop);
+}
+
+QQEventRecorder::~QQEventRecorder()
+{
+    stop();
+}
+
+bool QQEventRecorder::start(const QString &fileName)
+{
+    stop();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qWarning() << "Cannot record events to" << fileName << ":" << m_file.errorString();
+        return false;
+    }
+    m_count = 0;
+    m_pressFromOverride = false;
+    if (!remap(initialCapacity)) {
+        m_file.close();
+        return false;
+    }
+    Header *h = header();
+    std::memcpy(h->magic, "QQEV", 4);
+    h->version = Version;
+    h->recordSize = sizeof(Record);
+    h->reserved = 0;
+    h->count = 0;
+    m_clock.start();
+    qApp->installEventFilter(this);
+    return true;
+}
+
+void QQEventRecorder::stop()
+{
+    if (!m_map) {
+        return;
+    }
+    qApp->removeEventFilter(this);
+    m_file.unmap(m_map);
+    m_map = nullptr;
+    m_file.resize(sizeof(Header) + m_count * sizeof(Record));
+    m_file.close();
+}
+
+bool QQEventRecorder::remap(quint64 capacity)
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    const qint64 size = sizeof(Header) + capacity * sizeof(Record);
+    if (!m_file.resize(size) || !(m_map = m_file.map(0, size))) {
+        qWarning() << "Cannot map" << m_file.fileName() << "for recording:" << m_file.errorString();
+        return false;
+    }
+    m_capacity = capacity;
+    return true;
+}
+
+bool QQEventRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type()) {
+        case QEvent::Show:
+            m_windows.shown(watched);
+            break;
+        case QEvent::ShortcutOverride:
+        case QEvent::KeyPress:
+        case QEvent::KeyRelease:
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonRelease:
+        case QEvent::MouseButtonDblClick:
+        case QEvent::MouseMove:
+        case QEvent::ContextMenu:
+            if (event->spontaneous() && watched->isWindowType()) {
+                record(watched, event);
+            }
+            break;
+        default:
+            break;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void QQEventRecorder::record(QObject *window, QEvent *event)
+{
+    Target target;
+    quint8 index;
+    if (!m_windows.locate(window, &target, &index)) {
+        return;
+    }
+    if (event->type() == QEvent::KeyPress && m_pressFromOverride) {
+        // the press of the override we just recorded, which was not a shortcut
+        const Record *last = reinterpret_cast<const Record*>(m_map + sizeof(Header)) + m_count - 1;
+        const QKeyEvent *ke = static_cast<QKeyEvent*>(event);
+        m_pressFromOverride = false;
+        if (last->code == ke->key() && last->modifiers == quint32(ke->modifiers())) {
+            return;
+        }
+    }
+    if (m_count == m_capacity && !remap(m_capacity * 2)) {
+        // keep what was recorded so far; the header has the count
+        qApp->removeEventFilter(this);
+        m_file.close();
+        return;
+    }
+    Record *r = reinterpret_cast<Record*>(m_map + sizeof(Header)) + m_count;
+    std::memset(r, 0, sizeof(Record));
+    r->time = m_clock.nsecsElapsed();
+    r->type = quint16(event->type() == QEvent::ShortcutOverride ? QEvent::KeyPress : event->type());
+    r->target = quint8(target);
+    r->window = index;
+    m_pressFromOverride = event->type() == QEvent::ShortcutOverride;
+    switch (event->type()) {
+        case QEvent::ShortcutOverride:
+        case QEvent::KeyPress:
+        case QEvent::KeyRelease: {
+            const QKeyEvent *ke = static_cast<QKeyEvent*>(event);
+            const QString text = ke->text();
+            r->modifiers = quint32(ke->modifiers());
+            r->code = ke->key();
+            for (int i = 0; i < 2 && i < text.size(); ++i) {
+                r->text[i] = text.at(i).unicode();
+            }
+            r->flags = (ke->isAutoRepeat() ? AutoRepeat : 0)
+                | (m_pressFromOverride ? FromShortcutOverride : 0);
+            r->count = quint16(ke->count());
+            break;
+        }
+        case QEvent::ContextMenu: {
+            const QContextMenuEvent *ce = static_cast<QContextMenuEvent*>(event);
+            r->modifiers = quint32(ce->modifiers());
+            r->code = ce->reason();
+            r->x = ce->pos().x();
+            r->y = ce->pos().y();
+            break;
+        }
+        default: {
+            const QMouseEvent *me = static_cast<QMouseEvent*>(event);
+            r->modifiers = quint32(me->modifiers());
+            r->code = me->button();
+            r->buttons = quint32(me->buttons());
+            r->x = me->pos().x();
+            r->y = me->pos().y();
+            break;
+        }
+    }
+    m_count += 1;
+    header()->count = m_count;
+}
+
+QQEventReplayer::QQEventReplayer(const char *windowClass, QObject *parent)
+    : QObject(parent)
+    , m_windows(windowClass)
+    , m_map(nullptr)
+    , m_records(nullptr)
+    , m_count(0)
+    , m_next(0)
+    , m_skipped(0)
+    , m_speed(1)
+    , m_duration(-1)
+    , m_keyStats(QStringLiteral("key event dispatch"))
+    , m_mouseStats(QStringLiteral("mouse event dispatch"))
+    , m_contextMenuStats(QStringLiteral("context menu event dispatch"))
+    , m_lagStats(QStringLiteral("lag behind the recording"))
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &QQEventReplayer::replayNext);
+}
+
+QQEventReplayer::~QQEventReplayer()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+bool QQEventReplayer::open(const QString &fileName)
+{
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot replay events from" << fileName << ":" << m_file.errorString();
+        return false;
+    }
+    const qint64 size = m_file.size();
+    if (size < qint64(sizeof(Header)) || !(m_map = m_file.map(0, size))) {
+        qWarning() << "Cannot map" << fileName << "for replay:" << m_file.errorString();
+        return false;
+    }
+    const Header *h = reinterpret_cast<const Header*>(m_map);
+    if (std::memcmp(h->magic, "QQEV", 4) != 0 || h->version != Version || h->recordSize != sizeof(Record)) {
+        qWarning() << fileName << "is not an event recording, or one in an unsupported format";
+        return false;
+    }
+    m_records = reinterpret_cast<const Record*>(m_map + sizeof(Header));
+    // follow the windows from now on, to number them like the recorder did
+    qApp->installEventFilter(this);
+    // a recording that was not stopped properly is padded, or truncated when the disk was full
+    m_count = qMin<quint64>(h->count, (size - sizeof(Header)) / sizeof(Record));
+    return true;
+}
+
+void QQEventReplayer::start(double speed)
+{
+    m_speed = qMax(0.0, speed);
+    m_next = 0;
+    m_skipped = 0;
+    m_duration = -1;
+    m_keyStats.reserve(int(m_count));
+    m_mouseStats.reserve(int(m_count));
+    m_lagStats.reserve(m_speed > 0 ? int(m_count) : 0);
+    m_clock.start();
+    scheduleNext();
+}
+
+qint64 QQEventReplayer::dueTime(const Record &record) const
+{
+    return m_speed > 0 ? qint64(record.time / m_speed) : 0;
+}
+
+void QQEventReplayer::scheduleNext()
+{
+    qint64 delay = 0;
+    if (m_next < m_count) {
+        delay = dueTime(m_records[m_next]) - m_clock.nsecsElapsed();
+    }
+    // round up, so events are never sent early
+    m_timer.start(int(qMax<qint64>(0, (delay + 999999) / 1000000)));
+}
+
+void QQEventReplayer::replayNext()
+{
+    if (m_next >= m_count) {
+        m_duration = m_clock.nsecsElapsed();
+        emit finished();
+        return;
+    }
+    const Record &record = m_records[m_next++];
+    if (m_speed > 0) {
+        m_lagStats.addSample(m_clock.nsecsElapsed() - dueTime(record));
+    }
+    // before sending, in case the event starts a nested event loop
+    scheduleNext();
+    dispatch(record);
+}
+
+void QQEventReplayer::dispatch(const Record &record)
+{
+    QWindow *window = m_windows.window(Target(record.target), record.window);
+    if (!window) {
+        m_skipped += 1;
+        return;
+    }
+    const QPoint pos(record.x, record.y);
+    const Qt::KeyboardModifiers modifiers(QFlag(record.modifiers));
+    const qint64 t0 = QQBenchmark::now();
+    switch (record.type) {
+        case QEvent::KeyPress:
+        case QEvent::KeyRelease: {
+            QString text;
+            for (int i = 0; i < 2 && record.text[i]; ++i) {
+                text += QChar(record.text[i]);
+            }
+            // through the platform's path, so a press tries the shortcut map
+            // first; delivered before handleKeyEvent() returns
+            QWindowSystemInterface::setSynchronousWindowSystemEvents(true);
+            QWindowSystemInterface::handleKeyEvent(window, QEvent::Type(record.type), record.code, modifiers,
+                                                   text, record.flags & AutoRepeat, record.count);
+            QWindowSystemInterface::setSynchronousWindowSystemEvents(false);
+            m_keyStats.addSample(QQBenchmark::now() - t0);
+            break;
+        }
+        case QEvent::ContextMenu: {
+            QContextMenuEvent event(QContextMenuEvent::Reason(record.code), pos, window->mapToGlobal(pos), modifiers);
+            QCoreApplication::sendEvent(window, &event);
+            m_contextMenuStats.addSample(QQBenchmark::now() - t0);
+            break;
+        }
+        default: {
+            QMouseEvent event(QEvent::Type(record.type), QPointF(pos), QPointF(pos), QPointF(window->mapToGlobal(pos)),
+                              Qt::MouseButton(record.code), Qt::MouseButtons(QFlag(record.buttons)), modifiers);
+            QCoreApplication::sendEvent(window, &event);
+            m_mouseStats.addSample(QQBenchmark::now() - t0);
+            break;
+        }
+    }
+}
+
+bool QQEventReplayer::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Show) {
+        m_windows.shown(watched);
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+QStringList QQEventReplayer::report() const
+{
+    QStringList lines;
+    const qint64 duration = m_duration >= 0 ? m_duration : m_clock.nsecsElapsed();
+    lines << QStringLiteral("Replayed %1 of %2 events from %3 in %4 (%5), %6 events/s")
+        .arg(m_next - m_skipped).arg(m_count).arg(m_file.fileName())
+        .arg(QQBenchmark::formatNsecs(duration))
+        .arg(m_speed > 0 ? QStringLiteral("speed %1x").arg(m_speed) : QStringLiteral("speed max"))
+        .arg(duration > 0 ? double(m_next) * 1e9 / duration : 0.0, 0, 'f', 0);
+    foreach (const QQLatencyStats *stats, QList<const QQLatencyStats*>()
+             << &m_keyStats << &m_mouseStats << &m_contextMenuStats << &m_lagStats) {
+        if (stats->count() > 0) {
+            lines << QStringLiteral("  ") + stats->summary();
+        }
+    }
+    if (m_skipped) {
+        lines << QStringLiteral("  %1 events skipped because their window or popup was not open").arg(m_skipped);
+    }
+    return lines;
+}
+
+QJsonObject QQEventReplayer::toJson() const
+{
+    QJsonObject json;
+    json.insert(QStringLiteral("benchmark"), QStringLiteral("replay"));
+    json.insert(QStringLiteral("file"), m_file.fileName());
+    json.insert(QStringLiteral("speed"), m_speed > 0 ? QJsonValue(m_speed) : QJsonValue(QStringLiteral("max")));
+    json.insert(QStringLiteral("events"), double(m_count));
+    json.insert(QStringLiteral("replayed"), double(m_next - m_skipped));
+    json.insert(QStringLiteral("skipped"), double(m_skipped));
+    json.insert(QStringLiteral("durationNs"), double(m_duration >= 0 ? m_duration : m_clock.nsecsElapsed()));
+    json.insert(QStringLiteral("key"), m_keyStats.toJson());
+    json.insert(QStringLiteral("mouse"), m_mouseStats.toJson());
+    json.insert(QStringLiteral("contextMenu"), m_contextMenuStats.toJson());
+    if (m_speed > 0) {
+        json.insert(QStringLiteral("lag"), m_lagStats.toJson());
+    }
+    return json;
+}
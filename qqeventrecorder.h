@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQEVENTRECORDER_H
+#define QQEVENTRECORDER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QList>
+#include <QPointer>
+#include <QStringList>
+#include <QTimer>
+
+#include "qqbenchmark.h"
+
+QT_BEGIN_NAMESPACE
+class QWidget;
+class QWindow;
+QT_END_NAMESPACE
+
+/**
+ * The binary format of the input event recordings: a Header followed by
+ * Header::count fixed-size Records, in native byte order. Both the recorder
+ * and the replayer access the file through a memory mapping, so recording
+ * an event is a store into the mapping and replay reads the records in
+ * place, without parsing.
+ *
+ * Events are recorded as the platform delivers them, i.e. to the QWindow
+ * of a top-level widget, so that replaying them goes through the same
+ * dispatch (focus, shortcuts, mouse grabs, popups) as the original input.
+ * Windows are identified by the order in which they were first shown;
+ * menus and other popups as "the active popup".
+ *
+ * A key press that matches a shortcut never reaches the window as a
+ * KeyPress: the shortcut map consumes it after sending the window a
+ * spontaneous ShortcutOverride. That override is recorded as the key
+ * press (with the FromShortcutOverride flag) instead. The second and
+ * later keys of a multi-key shortcut are consumed without an override
+ * and cannot be recorded.
+ */
+namespace QQEventRecording
+{
+    enum Target {
+        Window = 0,
+        Popup = 1
+    };
+
+    enum RecordFlags {
+        AutoRepeat = 0x1,
+        // a key press recorded from the ShortcutOverride that precedes it
+        FromShortcutOverride = 0x2
+    };
+
+    struct Header {
+        char magic[4];      // "QQEV"
+        quint32 version;
+        quint32 recordSize;
+        quint32 reserved;
+        // kept up to date while recording, so a recording survives a crash
+        quint64 count;
+    };
+
+    struct Record {
+        // nanoseconds since the start of the recording
+        quint64 time;
+        // the QEvent::Type
+        quint16 type;
+        quint8 target;
+        // the index of the window, for target Window
+        quint8 window;
+        quint32 modifiers;
+        // the key, the mouse button or the context menu reason
+        qint32 code;
+        quint32 buttons;
+        // the position in window coordinates
+        qint32 x, y;
+        // the key text, in UTF-16
+        quint16 text[2];
+        quint16 flags;
+        quint16 count;
+    };
+
+    static const quint32 Version = 1;
+
+    /**
+     * Follows the top-level widgets inheriting @p windowClass in the order in
+     * which they are first shown, and maps the QWindows events are delivered
+     * to onto Target and window index and back.
+     */
+    class WindowList
+    {
+    public:
+        explicit WindowList(const char *windowClass);
+
+        // to be called with the QEvent::Show events seen by an application event filter
+        void shown(QObject *watched);
+        bool locate(const QObject *window, Target *target, quint8 *index) const;
+        QWindow *window(Target target, int index) const;
+
+    private:
+        const char *m_windowClass;
+        QList<QPointer<QWidget> > m_widgets;
+    };
+}
+
+/**
+ * QQEventRecorder : records the key, mouse and context menu events delivered
+ * to the windows of a given class (and to their popups) to a file, through
+ * an application event filter. Only spontaneous events are recorded, so the
+ * events an application sends itself are not duplicated on replay. (The key
+ * events of a replay are spontaneous, see QQEventReplayer, so recording a
+ * replay captures its keys but not its mouse events.)
+ *
+ * The file mapping starts out with room for a few thousand events and
+ * doubles when full. The recording stops, and the file is truncated to its
+ * contents, when the application is about to quit.
+ */
+class QQEventRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QQEventRecorder(const char *windowClass, QObject *parent = nullptr);
+    ~QQEventRecorder();
+
+    bool start(const QString &fileName);
+    bool isRecording() const
+    {
+        return m_map != nullptr;
+    }
+    quint64 count() const
+    {
+        return m_count;
+    }
+
+public Q_SLOTS:
+    void stop();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    bool remap(quint64 capacity);
+    void record(QObject *window, QEvent *event);
+    QQEventRecording::Header *header() const
+    {
+        return reinterpret_cast<QQEventRecording::Header*>(m_map);
+    }
+
+    QQEventRecording::WindowList m_windows;
+    QFile m_file;
+    uchar *m_map;
+    quint64 m_count;
+    quint64 m_capacity;
+    QElapsedTimer m_clock;
+    // the last record is a key press taken from a ShortcutOverride, whose
+    // KeyPress (if the override was not a shortcut) is not recorded again
+    bool m_pressFromOverride;
+};
+
+/**
+ * QQEventReplayer : sends the events of a recording back to the windows of
+ * the given class, at the recorded pace (or a multiple of it) or as fast as
+ * possible. In the latter case one event is sent per event loop iteration,
+ * so the application still gets to process the effects of each, like
+ * opening a menu, before the next one arrives.
+ *
+ * Key events are handed to QWindowSystemInterface, as a platform plugin
+ * would, so that key presses go through the shortcut map before they are
+ * delivered to the window; mouse and context menu events are sent to the
+ * window directly.
+ *
+ * The next event is always scheduled before the current one is sent, so the
+ * replay continues inside the nested event loops of menus and dialogs. The
+ * time spent dispatching each event and, when paced, the lag behind the
+ * recording are collected for the report.
+ */
+class QQEventReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QQEventReplayer(const char *windowClass, QObject *parent = nullptr);
+    ~QQEventReplayer();
+
+    /**
+     * Maps the recording @p fileName. This has to happen before the windows
+     * the events are for are shown, as they are numbered from then on.
+     */
+    bool open(const QString &fileName);
+    quint64 count() const
+    {
+        return m_count;
+    }
+    /**
+     * Starts the replay; @p speed multiplies the recorded pace, 0 replays
+     * as fast as possible.
+     */
+    void start(double speed = 1);
+
+    quint64 skippedCount() const
+    {
+        return m_skipped;
+    }
+    QStringList report() const;
+    QJsonObject toJson() const;
+
+Q_SIGNALS:
+    void finished();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void replayNext();
+
+private:
+    qint64 dueTime(const QQEventRecording::Record &record) const;
+    void scheduleNext();
+    void dispatch(const QQEventRecording::Record &record);
+
+    QQEventRecording::WindowList m_windows;
+    QFile m_file;
+    uchar *m_map;
+    const QQEventRecording::Record *m_records;
+    quint64 m_count;
+    quint64 m_next;
+    quint64 m_skipped;
+    double m_speed;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_duration;
+    QQLatencyStats m_keyStats;
+    QQLatencyStats m_mouseStats;
+    QQLatencyStats m_contextMenuStats;
+    QQLatencyStats m_lagStats;
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqlogging.h"
+
+Q_LOGGING_CATEGORY(lcMenus, "shortcuttest.menus", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcShortcuts, "shortcuttest.shortcuts", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcSignals, "shortcuttest.signals", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcStyles, "shortcuttest.styles", QtWarningMsg)
+
+void qqSetCategoryLogging(bool enabled)
+{
+    QLoggingCategory::setFilterRules(enabled ? QStringLiteral("shortcuttest.*.debug=true")
+                                             : QStringLiteral("shortcuttest.*.debug=false"));
+}
+
+bool qqCategoryLoggingAvailable()
+{
+#ifdef QQ_NO_CATEGORY_LOGGING
+    return false;
+#else
+    return true;
+#endif
+}
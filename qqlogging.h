@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQLOGGING_H
+#define QQLOGGING_H
+
+#include <QLoggingCategory>
+
+/**
+ * Logging categories for the diagnostic output of the menu, shortcut,
+ * signal and style code paths. Their debug output is disabled by default
+ * (so a disabled statement costs a single branch) and can be enabled with
+ * --verbose or through QT_LOGGING_RULES, e.g.
+ *
+ *     QT_LOGGING_RULES="shortcuttest.menus.debug=true"
+ *
+ * Building with QQ_NO_CATEGORY_LOGGING defined (qmake CONFIG+=no_category_logging)
+ * compiles the qqCDebug() statements out completely.
+ */
+Q_DECLARE_LOGGING_CATEGORY(lcMenus)
+Q_DECLARE_LOGGING_CATEGORY(lcShortcuts)
+Q_DECLARE_LOGGING_CATEGORY(lcSignals)
+Q_DECLARE_LOGGING_CATEGORY(lcStyles)
+
+#ifdef QQ_NO_CATEGORY_LOGGING
+#  define qqCDebug(category) while (false) QMessageLogger().noDebug()
+#else
+#  define qqCDebug(category) qCDebug(category)
+#endif
+
+/**
+ * Turns the debug output of all the categories above on or off.
+ */
+void qqSetCategoryLogging(bool enabled);
+/**
+ * Returns false when the categories have been compiled out.
+ */
+bool qqCategoryLoggingAvailable();
+
+#endif
@@ -1,20 +1,221 @@
+#include <QAction>
+#include <QActionEvent>
+#include <QApplication>
 #include <QFont>
+#include <QSet>
+#include <QPair>
+#include <QPointer>
 #include <QDebug>
 
 #include "qqmenu.h"
 
-QQMenu::QQMenu(const QString &title, QWidget *parent)
-    : QMenu(title, parent)
+QQMenuSections::QQMenuSections(QMenu *menu)
+    : QObject(menu)
+    , m_menu(menu)
+    , m_rebuildCount(0)
+{
+    connect(menu, &QMenu::aboutToShow, this, &QQMenuSections::update);
+}
+
+QQMenuSections *QQMenuSections::sections(QMenu *menu, bool create)
+{
+    if (!menu) {
+        return nullptr;
+    }
+    QQMenuSections *s = menu->findChild<QQMenuSections*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!s && create) {
+        s = new QQMenuSections(menu);
+    }
+    return s;
+}
+
+int QQMenuSections::addSection(const ContentProvider &provider)
+{
+    Section section;
+    section.provider = provider;
+    section.end = new QAction(this);
+    section.end->setVisible(false);
+    section.generation = 1;
+    section.builtGeneration = 0;
+    m_menu->addAction(section.end);
+    m_sections.append(section);
+    return m_sections.count() - 1;
+}
+
+void QQMenuSections::invalidate(int id)
+{
+    if (id >= 0 && id < m_sections.count()) {
+        m_sections[id].generation += 1;
+    }
+}
+
+void QQMenuSections::invalidateAll()
+{
+    for (int i = 0; i < m_sections.count(); ++i) {
+        m_sections[i].generation += 1;
+    }
+}
+
+quint64 QQMenuSections::generation(int id) const
 {
+    return (id >= 0 && id < m_sections.count()) ? m_sections.at(id).generation : 0;
+}
+
+void QQMenuSections::update()
+{
+    for (int i = 0; i < m_sections.count(); ++i) {
+        // const access first so unchanged sections don't cause a detach
+        if (m_sections.at(i).builtGeneration == m_sections.at(i).generation) {
+            continue;
+        }
+        Section &section = m_sections[i];
+        foreach (const QPointer<QAction> &action, section.actions) {
+            // deleted actions have already removed themselves from the menu
+            if (action) {
+                m_menu->removeAction(action);
+            }
+        }
+        section.actions.clear();
+        const QList<QAction*> actions = section.provider ? section.provider() : QList<QAction*>();
+        foreach (QAction *action, actions) {
+            section.actions.append(action);
+        }
+        m_menu->insertActions(section.end, actions);
+        section.builtGeneration = section.generation;
+        m_rebuildCount += 1;
+    }
+}
+
+namespace {
+
+class ActionChangeCollector : public QObject
+{
+public:
+    explicit ActionChangeCollector(QObject *parent)
+        : QObject(parent)
+        , depth(0)
+        , held(0)
+        , delivered(0)
+    {
+    }
+
+    void begin()
+    {
+        if (depth++ == 0) {
+            qApp->installEventFilter(this);
+        }
+    }
+
+    void end()
+    {
+        if (--depth > 0) {
+            return;
+        }
+        qApp->removeEventFilter(this);
+        const QVector<QPair<QPointer<QWidget>, QPointer<QAction> > > changes = pending;
+        pending.clear();
+        seen.clear();
+        for (int i = 0; i < changes.count(); ++i) {
+            QWidget *widget = changes.at(i).first;
+            QAction *action = changes.at(i).second;
+            if (widget && action && action->associatedWidgets().contains(widget)) {
+                QActionEvent event(QEvent::ActionChanged, action);
+                QCoreApplication::sendEvent(widget, &event);
+                delivered += 1;
+            }
+        }
+    }
+
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE
+    {
+        if (event->type() == QEvent::ActionChanged && watched->isWidgetType()) {
+            QWidget *widget = static_cast<QWidget*>(watched);
+            QAction *action = static_cast<QActionEvent*>(event)->action();
+            const QPair<QWidget*, QAction*> key(widget, action);
+            if (!seen.contains(key)) {
+                seen.insert(key);
+                pending.append(qMakePair(QPointer<QWidget>(widget), QPointer<QAction>(action)));
+            }
+            held += 1;
+            return true;
+        }
+        return false;
+    }
+
+    int depth;
+    quint64 held;
+    quint64 delivered;
+    // in the order of their first change
+    QVector<QPair<QPointer<QWidget>, QPointer<QAction> > > pending;
+    QSet<QPair<QWidget*, QAction*> > seen;
+};
+
+ActionChangeCollector *collector()
+{
+    static QPointer<ActionChangeCollector> instance;
+    if (!instance) {
+        instance = new ActionChangeCollector(qApp);
+    }
+    return instance;
+}
+
+}
+
+QQActionUpdateBatch::QQActionUpdateBatch()
+{
+    collector()->begin();
+}
+
+QQActionUpdateBatch::~QQActionUpdateBatch()
+{
+    collector()->end();
+}
+
+bool QQActionUpdateBatch::isActive()
+{
+    return collector()->depth > 0;
+}
+
+quint64 QQActionUpdateBatch::heldCount()
+{
+    return collector()->held;
+}
+
+quint64 QQActionUpdateBatch::deliveredCount()
+{
+    return collector()->delivered;
+}
+
 #ifdef SET_MENUFONT
-    QFont f = font();
-//     qWarning() << Q_FUNC_INFO << "menu=" << title << "font=" << f;
-    // force QAction::setFont() to reset the font so that menu items show
-    // the actual font even when attached to native menubars on Mac.
+void qqSetFontExplicitly(QWidget *widget)
+{
+    // toggling a property back leaves the value as it was but marks it as set;
+    // QWidget::setFont() looks at that, so a single call suffices
+    QFont f = widget->font();
+    f.setBold(!f.bold());
     f.setBold(!f.bold());
-    setFont(f);
+    widget->setFont(f);
+}
+
+void qqSetFontExplicitly(QAction *action)
+{
+    // QAction::setFont() ignores an equal font, so it takes two calls, and
+    // two change notifications unless a batch coalesces them
+    QQActionUpdateBatch batch;
+    QFont f = action->font();
     f.setBold(!f.bold());
-    setFont(f);
+    action->setFont(f);
+    f.setBold(!f.bold());
+    action->setFont(f);
+}
+#endif
+
+QQMenu::QQMenu(const QString &title, QWidget *parent)
+    : QMenu(title, parent)
+{
+#ifdef SET_MENUFONT
+//     qWarning() << Q_FUNC_INFO << "menu=" << title << "font=" << font();
+    qqSetFontExplicitly(this);
 #endif
 }
 
@@ -22,12 +223,8 @@ void QQMenu::addAction(QAction *action)
 {
     if (action) {
 #ifdef SET_MENUFONT
-        QFont f = action->font();
-//         qWarning() << Q_FUNC_INFO << "item=" << action << "font=" << f;
-        f.setBold(!f.bold());
-        action->setFont(f);
-        f.setBold(!f.bold());
-        action->setFont(f);
+//         qWarning() << Q_FUNC_INFO << "item=" << action << "font=" << action->font();
+        qqSetFontExplicitly(action);
 #endif
         QMenu::addAction(action);
     }
@@ -36,15 +233,25 @@ void QQMenu::addAction(QAction *action)
 QAction *QQMenu::addSection(const QString &title)
 {
     QAction *section = QMenu::addSection(title);
+    // the section is in the menu already: update its item once
+    QQActionUpdateBatch batch;
 #ifdef SET_MENUFONT
-    QFont f = section->font();
-//     qWarning() << Q_FUNC_INFO << "section=" << section << "font=" << f;
-    f.setBold(!f.bold());
-    section->setFont(f);
-    f.setBold(!f.bold());
-    section->setFont(f);
+//     qWarning() << Q_FUNC_INFO << "section=" << section << "font=" << section->font();
+    qqSetFontExplicitly(section);
 #endif
     section->setStatusTip(tr("this is a menu section"));
     return section;
 }
 
+
+int QQMenu::addDynamicSection(const QQMenuSections::ContentProvider &provider)
+{
+    return QQMenuSections::sections(this)->addSection(provider);
+}
+
+void QQMenu::invalidateDynamicSection(int id)
+{
+    if (QQMenuSections *s = QQMenuSections::sections(this, false)) {
+        s->invalidate(id);
+    }
+}
@@ -20,10 +20,133 @@
 #ifndef QQMENU_H
 
 #include <QMenu>
+#include <QList>
+#include <QPointer>
+#include <QVector>
+
+#include <functional>
+
 class QString;
+class QAction;
 
 // #define SET_MENUFONT
 
+/**
+ * QQMenuSections : dynamic sections for a QMenu (or QQMenu).
+ *
+ * Each section is filled by a content provider and tracks a generation
+ * number. When the menu is about to be shown, only the sections whose
+ * generation changed since they were last built are repopulated: their
+ * previous actions are removed and the provider's current actions are
+ * inserted in their place. Shows without changes don't allocate and don't
+ * touch any QAction.
+ *
+ * The actions returned by a provider remain owned by the provider; returning
+ * the same persistent actions each time avoids creating new ones on every
+ * rebuild.
+ *
+ * The helper is a child of the menu; use QQMenuSections::sections()
+ * to get (or create) the one for a given menu.
+ */
+class QQMenuSections : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QList<QAction*>()> ContentProvider;
+
+    explicit QQMenuSections(QMenu *menu);
+
+    static QQMenuSections *sections(QMenu *menu, bool create = true);
+
+    /**
+     * Appends a section to the menu and returns its id. The section is
+     * populated the next time the menu is shown.
+     */
+    int addSection(const ContentProvider &provider);
+    /**
+     * Bump the generation of section @p id so it will be rebuilt the
+     * next time the menu is shown.
+     */
+    void invalidate(int id);
+    void invalidateAll();
+
+    quint64 generation(int id) const;
+    /**
+     * The number of times a section has been (re)built.
+     */
+    int rebuildCount() const
+    {
+        return m_rebuildCount;
+    }
+
+public Q_SLOTS:
+    /**
+     * Rebuild the stale sections; called automatically from QMenu::aboutToShow.
+     */
+    void update();
+
+private:
+    struct Section {
+        ContentProvider provider;
+        // invisible action that marks the end of the section
+        QAction *end;
+        // guarded: the provider may delete its actions between two rebuilds
+        QList<QPointer<QAction> > actions;
+        quint64 generation;
+        quint64 builtGeneration;
+    };
+
+    QMenu *m_menu;
+    QVector<Section> m_sections;
+    int m_rebuildCount;
+};
+
+/**
+ * QQActionUpdateBatch : coalesces the change notifications of QActions.
+ *
+ * Every property change of a QAction sends a QEvent::ActionChanged to each
+ * widget showing it, which makes a menu lay out its items again (when it
+ * is open) and sync the item with a native menu. While a batch exists those
+ * events are held back by an application event filter, and each (widget,
+ * action) pair is delivered once when the outermost batch goes out of
+ * scope; so an item is updated once no matter how many of its properties
+ * changed, or how often, as with the double setFont() of SET_MENUFONT or the
+ * check/uncheck cascade of an exclusive QActionGroup. QAction::changed() is
+ * still emitted for every change.
+ *
+ * Batches nest, belong to the GUI thread and must not span anything that
+ * runs an event loop, like a dialog or QMenu::exec(). For that reason the
+ * toggles a user makes by triggering an item of an exclusive group are not
+ * batched: they happen inside QMenu's activation of the item, and the
+ * triggered() slots may well open a dialog.
+ */
+class QQActionUpdateBatch
+{
+public:
+    QQActionUpdateBatch();
+    ~QQActionUpdateBatch();
+
+    static bool isActive();
+    /**
+     * The number of ActionChanged events held back, and the number delivered
+     * in their place, since the start of the application.
+     */
+    static quint64 heldCount();
+    static quint64 deliveredCount();
+
+private:
+    Q_DISABLE_COPY(QQActionUpdateBatch)
+};
+
+#ifdef SET_MENUFONT
+/**
+ * Set the current font of @p widget or @p action explicitly, so that menu
+ * items show the actual font even when attached to native menubars on Mac.
+ */
+void qqSetFontExplicitly(QWidget *widget);
+void qqSetFontExplicitly(QAction *action);
+#endif
+
 #ifndef NO_QQMENU
 
 class QQMenu : public QMenu
@@ -33,6 +156,12 @@ public:
     QQMenu(const QString &title, QWidget *parent=nullptr);
     void addAction(QAction *action);
     QAction *addSection(const QString &title);
+
+    /**
+     * Appends a dynamic section, see QQMenuSections.
+     */
+    int addDynamicSection(const QQMenuSections::ContentProvider &provider);
+    void invalidateDynamicSection(int id);
 };
 
 #endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqmenuancestry.h"
+
+#include <QAction>
+#include <QActionEvent>
+#include <QMenu>
+#include <QMenuBar>
+#include <QSet>
+
+// remove @p object from @p list, comparing as QObject pointers so this
+// remains valid while @p object is being destroyed.
+template <typename T>
+static void removeObject(QVector<T*> &list, const QObject *object)
+{
+    for (int i = list.count() - 1; i >= 0; --i) {
+        if (static_cast<const QObject*>(list.at(i)) == object) {
+            list.remove(i);
+        }
+    }
+}
+
+QQMenuAncestry::QQMenuAncestry(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void QQMenuAncestry::track(QMenuBar *menuBar)
+{
+    if (menuBar) {
+        watch(menuBar);
+    }
+}
+
+void QQMenuAncestry::track(QMenu *menu)
+{
+    if (menu) {
+        watch(menu);
+    }
+}
+
+bool QQMenuAncestry::contains(const QMenu *menu) const
+{
+    return m_entries.contains(menu);
+}
+
+const QMenuBar *QQMenuAncestry::menuBar(const QMenu *menu) const
+{
+    const auto it = m_entries.constFind(menu);
+    return it == m_entries.constEnd() ? nullptr : it->menuBar;
+}
+
+bool QQMenuAncestry::isMenubarMenu(const QMenu *menu, bool checkIsNative) const
+{
+    const QMenuBar *mb = menuBar(menu);
+    return mb && (!checkIsNative || mb->isNativeMenuBar());
+}
+
+void QQMenuAncestry::watch(QWidget *widget)
+{
+    if (m_entries.contains(widget)) {
+        return;
+    }
+    Entry &entry = m_entries[widget];
+    if (QMenuBar *mb = qobject_cast<QMenuBar*>(widget)) {
+        entry.menuBar = mb;
+    }
+    widget->installEventFilter(this);
+    connect(widget, &QObject::destroyed, this, &QQMenuAncestry::forget);
+    // pick up the submenus that were added before we started watching
+    foreach (QAction *action, widget->actions()) {
+        if (QMenu *menu = action->menu()) {
+            attach(widget, menu);
+        }
+    }
+}
+
+void QQMenuAncestry::attach(QWidget *container, QMenu *menu)
+{
+    watch(container);
+    watch(menu);
+    Entry &entry = m_entries[menu];
+    if (entry.containers.contains(container)) {
+        return;
+    }
+    entry.containers.append(container);
+    m_entries[container].submenus.append(menu);
+    resolve(menu);
+}
+
+void QQMenuAncestry::detach(QWidget *container, QMenu *menu)
+{
+    const auto it = m_entries.find(menu);
+    if (it == m_entries.end()) {
+        return;
+    }
+    it->containers.removeAll(container);
+    const auto ct = m_entries.find(container);
+    if (ct != m_entries.end()) {
+        ct->submenus.removeAll(menu);
+    }
+    resolve(menu);
+}
+
+void QQMenuAncestry::resolve(QMenu *menu, int depth)
+{
+    // menus can be added to each other; don't follow such cycles forever
+    if (depth > 64) {
+        return;
+    }
+    const auto it = m_entries.find(menu);
+    if (it == m_entries.end()) {
+        return;
+    }
+    const QMenuBar *mb = nullptr;
+    foreach (const QWidget *container, it->containers) {
+        const auto ct = m_entries.constFind(container);
+        if (ct != m_entries.constEnd() && ct->menuBar) {
+            mb = ct->menuBar;
+            break;
+        }
+    }
+    if (mb != it->menuBar) {
+        it->menuBar = mb;
+        const QVector<QMenu*> submenus = it->submenus;
+        foreach (QMenu *submenu, submenus) {
+            resolve(submenu, depth + 1);
+        }
+    }
+}
+
+void QQMenuAncestry::forget(QObject *object)
+{
+    const auto it = m_entries.find(object);
+    if (it == m_entries.end()) {
+        return;
+    }
+    const Entry entry = *it;
+    m_entries.erase(it);
+    foreach (QWidget *container, entry.containers) {
+        const auto ct = m_entries.find(container);
+        if (ct != m_entries.end()) {
+            removeObject(ct->submenus, object);
+        }
+    }
+    foreach (QMenu *submenu, entry.submenus) {
+        const auto st = m_entries.find(submenu);
+        if (st != m_entries.end()) {
+            removeObject(st->containers, object);
+            resolve(submenu);
+        }
+    }
+}
+
+bool QQMenuAncestry::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type()) {
+        case QEvent::ActionAdded:
+        case QEvent::ActionRemoved: {
+            const QActionEvent *ae = static_cast<QActionEvent*>(event);
+            QMenu *menu = ae->action() ? ae->action()->menu() : nullptr;
+            QWidget *container = qobject_cast<QWidget*>(watched);
+            if (menu && container) {
+                if (event->type() == QEvent::ActionAdded) {
+                    attach(container, menu);
+                } else {
+                    detach(container, menu);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+bool QQMenuAncestry::walkIsMenubarMenu(const QMenu *m, bool checkIsNative)
+{
+    QSet<const QMenu*> checkList;
+    if (m && m->menuAction()) {
+        const QAction *mAct = m->menuAction();
+        foreach (const QWidget *w, mAct->associatedWidgets()) {
+            if (w == m) {
+                return false;
+            }
+            if (const QMenuBar *mb = qobject_cast<const QMenuBar*>(w)) {
+                return checkIsNative ? mb->isNativeMenuBar() : true;
+            } else if (const QMenu *mm = qobject_cast<const QMenu*>(w)) {
+                if (checkList.contains(mm)) {
+                    continue;
+                }
+                checkList += mm;
+                if (walkIsMenubarMenu(mm, checkIsNative)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQMENUANCESTRY_H
+#define QQMENUANCESTRY_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QMenu;
+class QMenuBar;
+class QWidget;
+QT_END_NAMESPACE
+
+/**
+ * QQMenuAncestry : an index that maps each tracked QMenu to the QMenuBar
+ * it is (indirectly) attached to, if any.
+ *
+ * The index watches the QEvent::ActionAdded and QEvent::ActionRemoved events
+ * of the tracked menubars and menus, so it follows submenus as they are added,
+ * moved or removed and it forgets menus when they are destroyed. Lookups are
+ * a single hash probe and never allocate, which makes them cheap enough for
+ * aboutToShow handlers.
+ *
+ * A menu can be attached to several containers; it maps to a menubar as soon
+ * as one of its containers does, just like the reference walk
+ * QQMenuAncestry::walkIsMenubarMenu() which follows QAction::associatedWidgets().
+ */
+class QQMenuAncestry : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QQMenuAncestry(QObject *parent = nullptr);
+
+    /**
+     * Start tracking @p menuBar and all the menus it contains.
+     */
+    void track(QMenuBar *menuBar);
+    /**
+     * Start tracking @p menu and its submenus. This is only required for
+     * menus that are not (yet) attached to a tracked menubar or menu,
+     * like context menus.
+     */
+    void track(QMenu *menu);
+
+    bool contains(const QMenu *menu) const;
+    /**
+     * Returns the menubar @p menu is attached to, or nullptr if it is
+     * not attached to any menubar or not tracked.
+     */
+    const QMenuBar *menuBar(const QMenu *menu) const;
+    /**
+     * Returns true if @p menu is attached to a menubar, and that menubar is
+     * native when @p checkIsNative is set.
+     */
+    bool isMenubarMenu(const QMenu *menu, bool checkIsNative = true) const;
+
+    /**
+     * The reference implementation: determine the same thing by walking
+     * up QMenu::menuAction()->associatedWidgets() recursively.
+     */
+    static bool walkIsMenubarMenu(const QMenu *menu, bool checkIsNative = true);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void forget(QObject *object);
+
+private:
+    struct Entry {
+        Entry()
+            : menuBar(nullptr)
+        {}
+        const QMenuBar *menuBar;
+        // the menubars and menus this menu has been added to
+        QVector<QWidget*> containers;
+        // the menus that have been added to this menubar or menu
+        QVector<QMenu*> submenus;
+    };
+
+    void watch(QWidget *widget);
+    void attach(QWidget *container, QMenu *menu);
+    void detach(QWidget *container, QMenu *menu);
+    void resolve(QMenu *menu, int depth = 0);
+
+    QHash<const QObject*, Entry> m_entries;
+};
+
+#endif
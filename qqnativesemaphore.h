@@ -24,14 +24,20 @@ typedef semaphore_t sem_t;
 #undef QQNATIVESEMAPHORE_LOCK_FREE
 #endif
 
+// the number of trigger payloads that can be pending; must be a power of 2.
+#ifndef QQNATIVESEMAPHORE_QUEUE_SIZE
+#define QQNATIVESEMAPHORE_QUEUE_SIZE 256
+#endif
+
 
 /**
  * QQNativeSemaphore : a thin wrapper around platform-native semaphores.
  *
  * Each instance sets up a single semaphore when enabled and spawns a thread
- * that waits on the semaphore. When the semaphore is released/signalled (the
- * wait ends) the QQNativeSemaphore::triggered signal is emitted and the instance
- * rearms itself. Releasing (triggering) the semaphore is done with the
+ * that waits on the semaphore (DedicatedMonitor), or registers with a single
+ * process-wide monitor thread (SharedMonitor, the default). When the semaphore
+ * is released/signalled (the wait ends) the QQNativeSemaphore::triggered signal
+ * is emitted and the instance rearms itself. Releasing (triggering) the semaphore is done with the
  * QQNativeSemaphore::trigger() method.
  *
  * POSIX semaphores emulate a queue; they lock when empty and become (remain)
@@ -45,16 +51,56 @@ typedef semaphore_t sem_t;
  * file descriptors), and that QQNativeSemaphore::trigger() is safe to be called
  * in async signal handlers (on platforms here std::atomic_bool and std::atomic_int
  * are lock free).
+ *
+ * Trigger payloads are kept in a fixed-capacity (QQNATIVESEMAPHORE_QUEUE_SIZE)
+ * lock-free multi-producer queue, so triggers can come from several threads and
+ * signal handlers at once without losing their payloads. The monitor thread
+ * drains the queue each time it wakes up and emits triggered() once per payload
+ * or, in batched mode, once per batch. Triggers that find the queue full are
+ * rejected and counted (see QQNativeSemaphore::overflowCount()).
+ *
+ * On Linux the internal semaphore can also be a bare futex word instead of a
+ * sem_t (see QQNativeSemaphore::WaitBackend). Posting it only enters the kernel
+ * when a thread is actually parked on it, and waiting spins for an adaptive
+ * number of iterations before parking, so uncontended trigger/wait pairs and
+ * monitor wake-ups take no system calls at all.
  */
 class QQNativeSemaphore : public QObject
 {
    Q_OBJECT
 public:
+    /**
+     * The primitive behind the internal semaphore.
+     */
+    enum WaitBackend {
+        // a POSIX sem_t
+        SemaphoreWait,
+        // Linux: a futex word with adaptive spin-then-park; falls back to SemaphoreWait elsewhere
+        FutexWait
+    };
+
+    /**
+     * Non-native mode: the thread that waits for triggers and emits triggered().
+     */
+    enum MonitorMode {
+        // a thread per enabled instance, waiting on the instance's own semaphore
+        DedicatedMonitor,
+        // one thread for all instances, woken through a single eventfd (or pipe)
+        // and handed the triggered instances through a lock-free list. Enabling
+        // and disabling is O(1) and never starts or stops a thread (except for
+        // the creation of the shared monitor itself, once).
+        SharedMonitor
+    };
+
     QQNativeSemaphore(bool enabled = false, bool nativeMode = false, int initialValue = 0, QObject *parent = nullptr);
     /**
      * releases all the resources used by this instance. In native mode
      * this unlocks the internal native semaphore which means ongoing
-     * waits are unblocked.
+     * waits are unblocked. In non-native mode a delivery to this instance
+     * that is in progress is allowed to finish (the dedicated monitor thread
+     * is joined); a pending one is dropped without waiting for the shared
+     * monitor to get to it. Hence triggered() must not be connected through
+     * a Qt::BlockingQueuedConnection to the thread that destroys the instance.
      */
     virtual ~QQNativeSemaphore();
 
@@ -64,7 +110,8 @@ public:
      * waits that are currently ongoing (and which cannot be unblocked
      * until the semaphore is reactivated). In non-native mode this
      * takes down the monitoring thread and the internal native semaphore
-     * (but without sending a signal).
+     * (but without sending a signal), or unregisters the instance from
+     * the shared monitor.
      */
     bool setEnabled(bool enabled);
     bool isEnabled() const
@@ -86,14 +133,85 @@ public:
         return m_currentValue;
     }
 
-//     bool setValue(int val)
-//     {
-//         if (val >= 0) {
-//             m_currentValue = val;
-//             return true;
-//         }
-//         return false;
-//     }
+    /**
+     * The backend used by instances created from now on; SemaphoreWait
+     * unless changed.
+     */
+    static void setDefaultWaitBackend(WaitBackend backend);
+    static WaitBackend defaultWaitBackend();
+    static bool isWaitBackendAvailable(WaitBackend backend);
+    /**
+     * Change the backend of this instance. This is only possible while it
+     * holds no internal semaphore, i.e. while it is disabled in non-native
+     * mode; returns false otherwise or when @p backend is not available.
+     */
+    bool setWaitBackend(WaitBackend backend);
+    WaitBackend waitBackend() const
+    {
+        return m_waitBackend;
+    }
+
+    /**
+     * The monitor mode of instances created from now on; SharedMonitor
+     * unless changed.
+     */
+    static void setDefaultMonitorMode(MonitorMode mode);
+    static MonitorMode defaultMonitorMode();
+    /**
+     * Change the monitor mode of this instance, which is only possible
+     * while it is disabled.
+     */
+    bool setMonitorMode(MonitorMode mode);
+    MonitorMode monitorMode() const
+    {
+        return m_monitorMode;
+    }
+    /**
+     * The number of instances currently registered with the shared monitor.
+     */
+    static int sharedMonitorInstances();
+
+    typedef qint64 Payload;
+
+    /**
+     * In batched mode the monitor emits triggered() once per wake-up, with
+     * a QVariantList holding all payloads received since the previous one,
+     * instead of once per payload.
+     */
+    void setBatchedDelivery(bool batched)
+    {
+        m_batchedDelivery = batched;
+    }
+    bool batchedDelivery() const
+    {
+        return m_batchedDelivery;
+    }
+    /**
+     * The number of triggers that were rejected because the payload queue was full.
+     */
+    unsigned int overflowCount() const
+    {
+        return m_overflowCount;
+    }
+    static int queueCapacity()
+    {
+        return QQNATIVESEMAPHORE_QUEUE_SIZE;
+    }
+
+    /**
+     * Non-native mode: set the number of triggers that are still swallowed
+     * before they start firing. In native mode the value mirrors the count
+     * of the internal semaphore and cannot be changed; returns false then,
+     * and for negative @p val.
+     */
+    bool setValue(int val)
+    {
+        if (val >= 0 && !m_nativeMode) {
+            m_currentValue = val;
+            return true;
+        }
+        return false;
+    }
 
     /**
      * Returns true if QQNativeSemaphore is lock free.
@@ -110,7 +228,8 @@ public:
 
     /**
      * Native mode only.
-     * Returns true after a blocking wait and will have emitted the
+     * Returns true when a trigger was consumed, whether it was already
+     * pending or the call blocked for it, and will have emitted the
      * triggered(@p val) signal in that case. The argument passed
      * with the signal can be set through the call to QQNativeSemaphore::trigger()
      * which unlocks the semaphore, or through this function (which takes
@@ -120,7 +239,9 @@ public:
      */
     bool wait(bool checkFirst = false, QVariant val = QVariant());
     /**
-     * As QQNativeSemaphore::wait() but with a timeout (in seconds).
+     * As QQNativeSemaphore::wait() but with a timeout (in seconds). A wait
+     * that times out leaves the semaphore as it found it, so it can be used
+     * for heartbeats that are allowed to arrive late.
      */
     bool timedWait(double timeOut, QVariant val = QVariant());
 
@@ -142,13 +263,60 @@ public Q_SLOTS:
      * the internal semaphore is released and the triggered() signal is sent.
      *
      * @p val an arbitrary value that will be sent out with the trigger signal.
-     * Note that this feature is not thread or signal safe; when multiple calls
-     * are made to trigger() before the monitor thread has had a chance to send
-     * signal out the last value will be sent with the signal.
+     * Integer values are queued like the payloads of trigger(Payload). Other
+     * values are not thread or signal safe; when multiple calls are made
+     * to trigger() before the monitor thread has had a chance to send
+     * the signal out the last such value will be sent with the signal.
+     *
+     * Returns false if the trigger was not accepted (disabled, still counting
+     * down in non-native mode, or payload queue full).
      */
     bool trigger(QVariant val = QVariant());
+    /**
+     * As QQNativeSemaphore::trigger(QVariant) but with an integer payload
+     * that is queued without locks or allocation, making this overload
+     * safe to call from async signal handlers and from multiple threads.
+     */
+    bool trigger(Payload payload);
 
 private:
+    enum PayloadKind {
+        NoPayload = 0,
+        IntegerPayload,
+        VariantPayload
+    };
+    struct Cell {
+        std::atomic_uint sequence;
+        int kind;
+        Payload payload;
+    };
+
+    // the internal semaphore, through the selected WaitBackend
+    bool semInit(int value);
+    void semDestroy();
+    void semPost();
+    // wait at most @p timeOut seconds, or forever when negative; returns 0 or -1 and errno like sem_wait()
+    int semWait(double timeOut = -1);
+    bool semTryWait();
+    // take the post that belongs to a count already consumed from m_currentValue
+    void takePendingPost();
+#ifdef Q_OS_LINUX
+    int futexWait(double timeOut);
+    bool futexTryWait();
+#endif
+
+    bool post(int kind, Payload payload);
+    // the bounded MPMC queue from D. Vyukov
+    bool push(int kind, Payload payload);
+    bool pop(int &kind, Payload &payload);
+    QVariant payloadValue(int kind, Payload payload) const;
+    // emit triggered() for everything in the queue
+    void deliverPending();
+
+    struct SharedMonitor;
+    friend struct SharedMonitor;
+    struct ReadyLink;
+
     QVariant m_triggerValue;
     void semaphoreMonitor();
     static void *monitorStarter(void*);
@@ -159,12 +327,30 @@ private:
     bool m_nativeMode;
     bool m_hasSemaphore;
 
+    WaitBackend m_waitBackend;
 #ifdef Q_OS_UNIX
     sem_t m_sem;
 #endif
+    // FutexWait: the number of posts available, the number of parked threads
+    // and the current spin budget
+    std::atomic_int m_futex;
+    std::atomic_int m_futexWaiters;
+    std::atomic_int m_spinLimit;
+    MonitorMode m_monitorMode;
     std::atomic_bool m_monitorEnabled;
     std::atomic_int m_currentValue;
     pthread_t m_monitorThread;
+
+    Cell m_queue[QQNATIVESEMAPHORE_QUEUE_SIZE];
+    std::atomic_uint m_enqueuePos;
+    std::atomic_uint m_dequeuePos;
+    // set when the monitor has been posted and hasn't drained the queue yet
+    std::atomic_bool m_wakePending;
+    // SharedMonitor: our entry in the list of triggered instances, created
+    // on first registration and handed to the monitor when we are destroyed
+    ReadyLink *m_readyLink;
+    std::atomic_bool m_batchedDelivery;
+    std::atomic_uint m_overflowCount;
 };
 
 #endif
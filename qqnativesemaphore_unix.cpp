@@ -2,7 +2,16 @@
 
 #include <QDebug>
 
+#include "qqlogging.h"
+
+#include <mutex>
+
 #include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
 
 #ifdef Q_OS_MACOS
 // Darwin doesn't have unnamed POSIX semaphores but can use MACH semaphores.
@@ -14,18 +23,221 @@
 #endif // Q_OS_MACOS
 #ifdef Q_OS_LINUX
 #define pthread_setname(t,n)    pthread_setname_np((t),(n));
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+static_assert(sizeof(std::atomic_int) == sizeof(int), "std::atomic_int cannot be used as a futex word");
+
+static inline long futex(std::atomic_int *word, int op, int val, const struct timespec *timeout = nullptr)
+{
+    return syscall(SYS_futex, reinterpret_cast<int*>(word), op | FUTEX_PRIVATE_FLAG, val, timeout,
+                   nullptr, FUTEX_BITSET_MATCH_ANY);
+}
+#endif
+
+static inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// bounds of the adaptive spin budget of FutexWait
+static const int minSpin = 16;
+static const int maxSpin = 4096;
+
+static QQNativeSemaphore::WaitBackend defaultBackend = QQNativeSemaphore::SemaphoreWait;
+static QQNativeSemaphore::MonitorMode defaultMonitor = QQNativeSemaphore::SharedMonitor;
+
+/**
+ * An instance's entry in the ready list of the shared monitor. It lives apart
+ * from the instance so that a destroyed instance can leave it to the monitor
+ * instead of waiting until the monitor has passed it; whichever of the two
+ * lets go of it last frees it.
+ */
+struct QQNativeSemaphore::ReadyLink
+{
+    explicit ReadyLink(QQNativeSemaphore *sem)
+        : owner(sem)
+        , next(nullptr)
+        , state(0)
+    {}
+
+    enum { Orphaned = 1 << 30 };
+
+    // held by the monitor while it delivers to the owner, and by the owner's
+    // destructor while it detaches
+    std::mutex lock;
+    QQNativeSemaphore *owner;
+    ReadyLink *next;
+    // the number of times the link is in the monitor's hands (it can be
+    // rescheduled while it is being delivered), plus Orphaned once the
+    // owner is gone
+    std::atomic_int state;
+};
+
+/**
+ * The process-wide monitor thread of the SharedMonitor mode. Triggered instances
+ * are pushed on a lock-free (Treiber) stack of their ReadyLinks; the thread is
+ * only woken when that stack was empty. An instance is on the stack at most once,
+ * guarded by its m_wakePending flag, until its delivery has begun.
+ */
+struct QQNativeSemaphore::SharedMonitor
+{
+    SharedMonitor()
+        : ready(nullptr)
+        , instances(0)
+        , wakeRead(-1)
+        , wakeWrite(-1)
+        , valid(false)
+    {
+#ifdef Q_OS_LINUX
+        wakeRead = wakeWrite = eventfd(0, EFD_CLOEXEC);
 #endif
+        if (wakeRead == -1) {
+            int pp[2];
+            if (pipe(pp) == 0) {
+                wakeRead = pp[0];
+                wakeWrite = pp[1];
+                fcntl(wakeRead, F_SETFD, FD_CLOEXEC);
+                fcntl(wakeWrite, F_SETFD, FD_CLOEXEC);
+                fcntl(wakeWrite, F_SETFL, fcntl(wakeWrite, F_GETFL) | O_NONBLOCK);
+            }
+        }
+        if (wakeRead != -1 && pthread_create(&thread, nullptr, starter, this) == 0) {
+            pthread_detach(thread);
+            valid = true;
+        } else {
+            qCritical() << "QQNativeSemaphore: couldn't start the shared monitor:" << strerror(errno);
+        }
+    }
+
+    // created on first use and never destroyed: the thread outlives all instances
+    static SharedMonitor *instance()
+    {
+        static SharedMonitor *monitor = new SharedMonitor;
+        return monitor;
+    }
+
+    // async-signal-safe
+    void schedule(QQNativeSemaphore *sem)
+    {
+        ReadyLink *link = sem->m_readyLink;
+        link->state.fetch_add(1);
+        ReadyLink *head = ready.load(std::memory_order_relaxed);
+        do {
+            link->next = head;
+        } while (!ready.compare_exchange_weak(head, link, std::memory_order_release, std::memory_order_relaxed));
+        if (!head) {
+            const int savedErrno = errno;
+#ifdef Q_OS_LINUX
+            if (wakeRead == wakeWrite) {
+                const uint64_t one = 1;
+                ssize_t n = write(wakeWrite, &one, sizeof(one));
+                Q_UNUSED(n);
+            } else
+#endif
+            {
+                const char c = 0;
+                ssize_t n = write(wakeWrite, &c, 1);
+                Q_UNUSED(n);
+            }
+            errno = savedErrno;
+        }
+    }
+
+    bool isMonitorThread() const
+    {
+        return valid && pthread_equal(pthread_self(), thread);
+    }
+
+    static void *starter(void *arg)
+    {
+        static_cast<SharedMonitor*>(arg)->run();
+        return nullptr;
+    }
+
+    void run()
+    {
+        pthread_setname(pthread_self(), "QQNSem monitor");
+        char buf[64];
+        for (;;) {
+            // drains the eventfd counter, or whatever is in the pipe
+            if (read(wakeRead, buf, sizeof(buf)) == -1 && errno != EINTR) {
+                perror("QQNativeSemaphore shared monitor");
+                return;
+            }
+            ReadyLink *list = ready.exchange(nullptr, std::memory_order_acquire);
+            // the stack is LIFO; deliver in trigger order
+            ReadyLink *ordered = nullptr;
+            while (list) {
+                ReadyLink *next = list->next;
+                list->next = ordered;
+                ordered = list;
+                list = next;
+            }
+            while (ordered) {
+                ReadyLink *link = ordered;
+                // read the link first: once m_wakePending is cleared the
+                // instance can be scheduled (and relinked) again
+                ordered = link->next;
+                {
+                    std::lock_guard<std::mutex> guard(link->lock);
+                    if (QQNativeSemaphore *sem = link->owner) {
+                        if (sem->m_monitorEnabled) {
+                            sem->deliverPending();
+                        } else {
+                            sem->m_wakePending = false;
+                        }
+                    }
+                }
+                if (link->state.fetch_sub(1) == ReadyLink::Orphaned + 1) {
+                    delete link;
+                }
+            }
+        }
+    }
+
+    std::atomic<ReadyLink*> ready;
+    std::atomic_int instances;
+    int wakeRead, wakeWrite;
+    pthread_t thread;
+    bool valid;
+};
+
+static_assert((QQNATIVESEMAPHORE_QUEUE_SIZE & (QQNATIVESEMAPHORE_QUEUE_SIZE - 1)) == 0,
+              "QQNATIVESEMAPHORE_QUEUE_SIZE must be a power of 2");
+static const unsigned int queueMask = QQNATIVESEMAPHORE_QUEUE_SIZE - 1;
 
 QQNativeSemaphore::QQNativeSemaphore::QQNativeSemaphore(bool enabled, bool nativeMode, int initialValue, QObject* parent)
     : QObject(parent)
     , m_triggerValue(QVariant())
     , m_nativeMode(nativeMode)
     , m_hasSemaphore(false)
+    , m_waitBackend(defaultBackend)
+    , m_futex(0)
+    , m_futexWaiters(0)
+    , m_spinLimit(minSpin)
+    , m_monitorMode(defaultMonitor)
     , m_monitorEnabled(false)
     , m_currentValue(initialValue)
+    , m_enqueuePos(0)
+    , m_dequeuePos(0)
+    , m_wakePending(false)
+    , m_readyLink(nullptr)
+    , m_batchedDelivery(false)
+    , m_overflowCount(0)
 {
+    for (unsigned int i = 0; i < QQNATIVESEMAPHORE_QUEUE_SIZE; ++i) {
+        m_queue[i].sequence.store(i, std::memory_order_relaxed);
+        m_queue[i].kind = NoPayload;
+        m_queue[i].payload = 0;
+    }
     if (m_nativeMode) {
-        if (sem_init(&m_sem, 0, initialValue) != -1) {
+        if (semInit(initialValue)) {
             m_hasSemaphore = true;
         }
     }
@@ -37,11 +249,26 @@ QQNativeSemaphore::~QQNativeSemaphore()
     if (m_nativeMode) {
         if (m_hasSemaphore) {
             m_monitorEnabled = false;
-            sem_post(&m_sem);
-            sem_destroy(&m_sem);
+            semPost();
+            semDestroy();
         }
     } else {
         setEnabled(false);
+        if (m_readyLink) {
+            // we may still be on the shared monitor's list: leave the link to
+            // the monitor, which skips it. Only a delivery to this instance
+            // that is in progress makes us wait (unless it is the one
+            // destroying us).
+            if (SharedMonitor::instance()->isMonitorThread()) {
+                m_readyLink->owner = nullptr;
+            } else {
+                std::lock_guard<std::mutex> guard(m_readyLink->lock);
+                m_readyLink->owner = nullptr;
+            }
+            if ((m_readyLink->state.fetch_or(ReadyLink::Orphaned) & ~ReadyLink::Orphaned) == 0) {
+                delete m_readyLink;
+            }
+        }
     }
 }
 
@@ -50,16 +277,34 @@ bool QQNativeSemaphore::setEnabled(bool enabled)
     bool ret = true;
     if (m_nativeMode) {
         m_monitorEnabled = enabled && m_hasSemaphore;
+    } else if (m_monitorMode == SharedMonitor) {
+        // m_wakePending is left alone: the instance may still be on the
+        // shared monitor's list, which will clear it.
+        if (enabled && !m_monitorEnabled) {
+            SharedMonitor *monitor = SharedMonitor::instance();
+            if (monitor->valid) {
+                if (!m_readyLink) {
+                    m_readyLink = new ReadyLink(this);
+                }
+                m_monitorEnabled = true;
+                monitor->instances += 1;
+            } else {
+                ret = false;
+            }
+        } else if (!enabled && m_monitorEnabled.exchange(false)) {
+            SharedMonitor::instance()->instances -= 1;
+        }
     } else if (enabled && !m_monitorEnabled.exchange(true)) {
-        if (sem_init(&m_sem, 0, 0) != -1) {
+        m_wakePending = false;
+        if (semInit(0)) {
+            // joinable, so disabling can wait until the thread is off the semaphore
             if (pthread_create(&m_monitorThread, nullptr, monitorStarter, this) == 0) {
                 m_hasSemaphore = true;
-                pthread_detach(m_monitorThread);
             } else {
                 m_monitorThread = 0;
                 m_monitorEnabled = false;
                 ret = false;
-                sem_destroy(&m_sem);
+                semDestroy();
             }
         } else {
             // we failed, so turn back off
@@ -68,14 +313,215 @@ bool QQNativeSemaphore::setEnabled(bool enabled)
             ret = false;
         }
     } else if (m_monitorEnabled.exchange(false)) {
-        qWarning() << "\tsignalling semaphore monitor to exit";
-        sem_post(&m_sem);
-        sem_destroy(&m_sem);
+        qqCDebug(lcSignals) << "\tsignalling semaphore monitor to exit";
+        semPost();
+        if (pthread_equal(pthread_self(), m_monitorThread)) {
+            // disabled from a slot connected directly to triggered(): the
+            // thread exits as soon as it returns from the delivery, without
+            // touching the semaphore again
+            pthread_detach(m_monitorThread);
+        } else {
+            pthread_join(m_monitorThread, nullptr);
+        }
+        m_monitorThread = 0;
+        semDestroy();
         m_hasSemaphore = false;
     }
+    return ret;
+}
+
+void QQNativeSemaphore::setDefaultMonitorMode(MonitorMode mode)
+{
+    defaultMonitor = mode;
+}
+
+QQNativeSemaphore::MonitorMode QQNativeSemaphore::defaultMonitorMode()
+{
+    return defaultMonitor;
+}
+
+bool QQNativeSemaphore::setMonitorMode(MonitorMode mode)
+{
+    if (m_monitorEnabled) {
+        return mode == m_monitorMode;
+    }
+    m_monitorMode = mode;
+    return true;
+}
+
+int QQNativeSemaphore::sharedMonitorInstances()
+{
+    return SharedMonitor::instance()->instances;
+}
+
+void QQNativeSemaphore::setDefaultWaitBackend(WaitBackend backend)
+{
+    defaultBackend = isWaitBackendAvailable(backend) ? backend : SemaphoreWait;
+}
+
+QQNativeSemaphore::WaitBackend QQNativeSemaphore::defaultWaitBackend()
+{
+    return defaultBackend;
+}
+
+bool QQNativeSemaphore::isWaitBackendAvailable(WaitBackend backend)
+{
+#ifdef Q_OS_LINUX
+    Q_UNUSED(backend);
+    return true;
+#else
+    return backend == SemaphoreWait;
+#endif
+}
+
+bool QQNativeSemaphore::setWaitBackend(WaitBackend backend)
+{
+    if (m_hasSemaphore || !isWaitBackendAvailable(backend)) {
+        return backend == m_waitBackend;
+    }
+    m_waitBackend = backend;
     return true;
 }
 
+bool QQNativeSemaphore::semInit(int value)
+{
+    if (m_waitBackend == FutexWait) {
+        m_futex = value;
+        m_futexWaiters = 0;
+        return true;
+    }
+    return sem_init(&m_sem, 0, value) != -1;
+}
+
+void QQNativeSemaphore::semDestroy()
+{
+    if (m_waitBackend == SemaphoreWait) {
+        sem_destroy(&m_sem);
+    }
+}
+
+void QQNativeSemaphore::semPost()
+{
+#ifdef Q_OS_LINUX
+    if (m_waitBackend == FutexWait) {
+        // we can be called from a signal handler: leave errno alone
+        const int savedErrno = errno;
+        m_futex.fetch_add(1);
+        // sequentially consistent with the waiter's increment of m_futexWaiters
+        // followed by its read of m_futex: if we don't see the waiter here, it
+        // will see the new count (or FUTEX_WAIT will find the word changed).
+        if (m_futexWaiters.load() > 0) {
+            futex(&m_futex, FUTEX_WAKE, 1);
+        }
+        errno = savedErrno;
+        return;
+    }
+#endif
+    sem_post(&m_sem);
+}
+
+bool QQNativeSemaphore::semTryWait()
+{
+#ifdef Q_OS_LINUX
+    if (m_waitBackend == FutexWait) {
+        return futexTryWait();
+    }
+#endif
+#ifdef Q_OS_MACOS
+    mach_timespec_t zero = {0, 0};
+    return semaphore_timedwait(m_sem, zero) == KERN_SUCCESS;
+#else
+    return sem_trywait(&m_sem) == 0;
+#endif
+}
+
+void QQNativeSemaphore::takePendingPost()
+{
+    if (!semTryWait()) {
+        while (semWait() != 0 && errno == EINTR) {
+        }
+    }
+}
+
+int QQNativeSemaphore::semWait(double timeOut)
+{
+#ifdef Q_OS_LINUX
+    if (m_waitBackend == FutexWait) {
+        return futexWait(timeOut);
+    }
+#endif
+    if (timeOut < 0) {
+        return sem_wait(&m_sem);
+    }
+    // sem_timedwait() takes an absolute CLOCK_REALTIME deadline
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    const double deadline = now.tv_sec + now.tv_usec * 1e-6 + timeOut;
+    struct timespec ts;
+    ts.tv_sec = time_t(deadline);
+    ts.tv_nsec = long((deadline - ts.tv_sec) * 1e9);
+    return sem_timedwait(&m_sem, &ts);
+}
+
+#ifdef Q_OS_LINUX
+bool QQNativeSemaphore::futexTryWait()
+{
+    int v = m_futex.load();
+    while (v > 0) {
+        if (m_futex.compare_exchange_weak(v, v - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int QQNativeSemaphore::futexWait(double timeOut)
+{
+    static const bool multiCore = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    if (futexTryWait()) {
+        return 0;
+    }
+    // spin before parking: when there is a poster on another core the count
+    // often goes up within a few hundred cycles. The budget doubles each time
+    // spinning pays off and halves each time it doesn't.
+    if (multiCore) {
+        const int limit = m_spinLimit.load(std::memory_order_relaxed);
+        for (int i = 0; i < limit; ++i) {
+            cpuRelax();
+            if (m_futex.load(std::memory_order_relaxed) > 0 && futexTryWait()) {
+                m_spinLimit.store(qMin(limit * 2, maxSpin), std::memory_order_relaxed);
+                return 0;
+            }
+        }
+        m_spinLimit.store(qMax(limit / 2, minSpin), std::memory_order_relaxed);
+    }
+
+    // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline, so
+    // spurious wake-ups don't extend the timeout
+    struct timespec deadline;
+    if (timeOut >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        const double t = deadline.tv_sec + deadline.tv_nsec * 1e-9 + timeOut;
+        deadline.tv_sec = time_t(t);
+        deadline.tv_nsec = long((t - deadline.tv_sec) * 1e9);
+    }
+    int ret = 0;
+    m_futexWaiters.fetch_add(1);
+    while (!futexTryWait()) {
+        if (futex(&m_futex, FUTEX_WAIT_BITSET, 0, timeOut >= 0 ? &deadline : nullptr) == -1
+                && (errno == ETIMEDOUT || errno == EINTR)) {
+            ret = -1;
+            break;
+        }
+        // woken up, or EAGAIN because the count changed before we slept
+    }
+    const int savedErrno = errno;
+    m_futexWaiters.fetch_sub(1);
+    errno = savedErrno;
+    return ret;
+}
+#endif
+
 void* QQNativeSemaphore::monitorStarter(void *arg)
 {
     QQNativeSemaphore *that = static_cast<QQNativeSemaphore*>(arg);
@@ -91,79 +537,223 @@ void QQNativeSemaphore::semaphoreMonitor()
         pthread_setname(pthread_self(), objectName().toLocal8Bit().constData());
     }
     int s;
-    while (m_monitorEnabled && (((s = sem_wait(&m_sem)) == -1 && errno == EINTR) || s == 0)) {
+    while (m_monitorEnabled && (((s = semWait()) == -1 && errno == EINTR) || s == 0)) {
         if (m_monitorEnabled) {
             if (s == 0) {
-                qWarning() << Q_FUNC_INFO << "semaphore triggered with" << m_triggerValue;
-                emit triggered(m_triggerValue);
-                m_triggerValue = QVariant();
+                deliverPending();
             } else {
                 perror("sem_wait");
             }
-            qWarning() << "\tmonitor continues";
+            qqCDebug(lcSignals) << "\tmonitor continues";
         }
         continue;       /* Restart if interrupted by handler */
     }
-    qWarning() << Q_FUNC_INFO << "monitor exitting";
+    qqCDebug(lcSignals) << Q_FUNC_INFO << "monitor exitting";
 }
 
-bool QQNativeSemaphore::trigger(QVariant val)
+void QQNativeSemaphore::deliverPending()
 {
-    m_triggerValue = val;
-    bool ret = false;
-    if (m_monitorEnabled) {
-        if (m_nativeMode) {
-            m_currentValue += 1;
-            sem_post(&m_sem);
-            ret = true;
+    // clear the flag before draining: a trigger that is queued after this
+    // point will post the semaphore again.
+    m_wakePending = false;
+    int kind;
+    Payload payload;
+    if (m_batchedDelivery) {
+        QVariantList batch;
+        while (pop(kind, payload)) {
+            batch.append(payloadValue(kind, payload));
+        }
+        if (!batch.isEmpty()) {
+            qqCDebug(lcSignals) << Q_FUNC_INFO << "semaphore triggered with a batch of" << batch.count();
+            emit triggered(batch);
+        }
+    } else {
+        while (pop(kind, payload)) {
+            const QVariant val = payloadValue(kind, payload);
+            qqCDebug(lcSignals) << Q_FUNC_INFO << "semaphore triggered with" << val;
+            emit triggered(val);
+        }
+    }
+}
+
+bool QQNativeSemaphore::push(int kind, Payload payload)
+{
+    Cell *cell;
+    unsigned int pos = m_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &m_queue[pos & queueMask];
+        const unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+        const int dif = int(seq - pos);
+        if (dif == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            // full
+            return false;
         } else {
-            if (m_currentValue.fetch_sub(1) == 0) {
-                sem_post(&m_sem);
-                ret = true;
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->kind = kind;
+    cell->payload = payload;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool QQNativeSemaphore::pop(int &kind, Payload &payload)
+{
+    Cell *cell;
+    unsigned int pos = m_dequeuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        cell = &m_queue[pos & queueMask];
+        const unsigned int seq = cell->sequence.load(std::memory_order_acquire);
+        const int dif = int(seq - (pos + 1));
+        if (dif == 0) {
+            if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
             }
+        } else if (dif < 0) {
+            // empty, or the next cell is still being written
+            return false;
+        } else {
+            pos = m_dequeuePos.load(std::memory_order_relaxed);
         }
     }
-    return ret;
+    kind = cell->kind;
+    payload = cell->payload;
+    cell->sequence.store(pos + queueMask + 1, std::memory_order_release);
+    return true;
+}
+
+QVariant QQNativeSemaphore::payloadValue(int kind, Payload payload) const
+{
+    switch (kind) {
+        case IntegerPayload:
+            return QVariant(qlonglong(payload));
+        case VariantPayload:
+            return m_triggerValue;
+        default:
+            return QVariant();
+    }
+}
+
+bool QQNativeSemaphore::post(int kind, Payload payload)
+{
+    if (!m_monitorEnabled) {
+        return false;
+    }
+    if (m_nativeMode) {
+        if (!push(kind, payload)) {
+            m_overflowCount += 1;
+            return false;
+        }
+        m_currentValue += 1;
+        semPost();
+        return true;
+    }
+    // count down without going below zero; once zero is reached every trigger fires.
+    int v = m_currentValue.load();
+    while (v > 0 && !m_currentValue.compare_exchange_weak(v, v - 1)) {
+    }
+    if (v > 0) {
+        return false;
+    }
+    if (!push(kind, payload)) {
+        m_overflowCount += 1;
+        return false;
+    }
+    if (!m_wakePending.exchange(true)) {
+        if (m_monitorMode == SharedMonitor) {
+            SharedMonitor::instance()->schedule(this);
+        } else {
+            semPost();
+        }
+    }
+    return true;
+}
+
+bool QQNativeSemaphore::trigger(Payload payload)
+{
+    return post(IntegerPayload, payload);
+}
+
+bool QQNativeSemaphore::trigger(QVariant val)
+{
+    switch (val.userType()) {
+        case QMetaType::UnknownType:
+            return post(NoPayload, 0);
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::ULong:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Short:
+        case QMetaType::UShort:
+            return post(IntegerPayload, val.toLongLong());
+        default:
+            m_triggerValue = val;
+            return post(VariantPayload, 0);
+    }
 }
 
 bool QQNativeSemaphore::wait(bool checkFirst, QVariant val)
 {
     bool ret = false, waited = false;
     if (m_nativeMode && m_hasSemaphore && m_monitorEnabled) {
-        if (m_currentValue.fetch_sub(1) == 0) {
+        const int prev = m_currentValue.fetch_sub(1);
+        if (prev == 0) {
             errno = 0;
             if (checkFirst) {
                 ret = true;
                 errno = EAGAIN;
             } else {
-                ret = (sem_wait(&m_sem) == 0);
+                ret = (semWait() == 0);
                 waited = (errno != EINTR);
                 ret &= waited;
             }
+        } else if (prev > 0) {
+            // consumed a pending trigger without blocking: take its post so the
+            // semaphore stays in step with the count, and deliver its payload
+            // as if we had blocked for it. post() publishes the count before
+            // it posts, so the post may still be on its way: wait for it.
+            takePendingPost();
+            ret = waited = true;
         }
     }
     if (ret) {
-        if (val.isValid()) {
-            m_triggerValue = val;
+        int kind = NoPayload;
+        Payload payload = 0;
+        if (waited) {
+            pop(kind, payload);
         }
-        qWarning() << Q_FUNC_INFO << "semaphore triggered with" << m_triggerValue;
-        emit triggered(m_triggerValue);
-        m_triggerValue = QVariant();
+        const QVariant value = val.isValid() ? val : payloadValue(kind, payload);
+        qqCDebug(lcSignals) << Q_FUNC_INFO << "semaphore triggered with" << value;
+        emit triggered(value);
     }
     return ret;
 }
 
 #ifdef Q_OS_MACOS
 // from https://raw.githubusercontent.com/tumi8/vermont/master/src/osdep/osx/sem_timedwait.cpp
-int QQNativeSemaphore::sem_timedwait(sem_t *sem, const struct timespec *timeout)
+int QQNativeSemaphore::sem_timedwait(sem_t *sem, const struct timespec *abs_timeout)
 {
     int ret = -1;
+    // semaphore_timedwait() takes a relative timeout
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    double rel = (abs_timeout->tv_sec - now.tv_sec) + (abs_timeout->tv_nsec - now.tv_usec * 1000) * 1e-9;
+    if (rel < 0) {
+        rel = 0;
+    }
     struct mach_timespec mts;
-    mts.tv_sec = timeout->tv_sec;
-    mts.tv_nsec = timeout->tv_nsec;
+    mts.tv_sec = (unsigned int)(rel);
+    mts.tv_nsec = (clock_res_t)((rel - mts.tv_sec) * 1e9);
     switch (semaphore_timedwait(*sem, mts)) {
         case KERN_SUCCESS:
             ret = 0;
+            break;
         case KERN_OPERATION_TIMED_OUT:
             errno = ETIMEDOUT;
             break;
@@ -174,7 +764,7 @@ int QQNativeSemaphore::sem_timedwait(sem_t *sem, const struct timespec *timeout)
             errno =  EINVAL;
             break;
     }
-    return -1;
+    return ret;
 }
 #endif
 
@@ -182,25 +772,31 @@ bool QQNativeSemaphore::timedWait(double timeOut, QVariant val)
 {
     bool ret = false, waited = false;
     if (m_nativeMode && m_hasSemaphore && m_monitorEnabled) {
-        if (m_currentValue.fetch_sub(1) == 0) {
-            struct timespec ts;
-            ts.tv_sec = time_t(timeOut);
-            ts.tv_nsec = long((timeOut - ts.tv_sec) * 1e9);
+        const int prev = m_currentValue.fetch_sub(1);
+        if (prev == 0) {
             errno = 0;
-            ret = (sem_timedwait(&m_sem, &ts) == 0);
+            ret = (semWait(timeOut) == 0);
             waited = (errno != EINTR) && (errno != ETIMEDOUT);
             ret &= waited;
-            // it is not entirely clear if we should restore (re-increment)
-            // m_currentValue if the wait timed out?
+            if (!ret) {
+                // nothing was consumed: give the count back, or the next
+                // (timed) wait would return without blocking. A trigger that
+                // came in after the timeout simply remains pending.
+                m_currentValue.fetch_add(1);
+            }
+        } else if (prev > 0) {
+            // as in wait()
+            takePendingPost();
+            ret = waited = true;
         }
     }
     if (ret) {
-        if (val.isValid()) {
-            m_triggerValue = val;
-        }
-        qWarning() << Q_FUNC_INFO << "semaphore triggered with" << m_triggerValue;
-        emit triggered(val);
-        m_triggerValue = QVariant();
+        int kind = NoPayload;
+        Payload payload = 0;
+        pop(kind, payload);
+        const QVariant value = val.isValid() ? val : payloadValue(kind, payload);
+        qqCDebug(lcSignals) << Q_FUNC_INFO << "semaphore triggered with" << value;
+        emit triggered(value);
     }
     return ret;
 }
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqnotifyprofiler.h"
+#include "qqbenchmark.h"
+
+#include <QEvent>
+#include <QHash>
+#include <QJsonArray>
+#include <QMetaEnum>
+#include <QMutexLocker>
+#include <QObject>
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// only the owning thread writes a Counter, so plain loads and stores
+// are enough and no read-modify-write instructions are needed
+struct Counter {
+    std::atomic<quint64> count;
+    std::atomic<qint64> totalNs;
+    std::atomic<qint64> selfNs;
+    std::atomic<qint64> maxNs;
+
+    void add(qint64 ns, qint64 self)
+    {
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totalNs.store(totalNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        selfNs.store(selfNs.load(std::memory_order_relaxed) + self, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed)) {
+            maxNs.store(ns, std::memory_order_relaxed);
+        }
+    }
+    void clear()
+    {
+        count.store(0, std::memory_order_relaxed);
+        totalNs.store(0, std::memory_order_relaxed);
+        selfNs.store(0, std::memory_order_relaxed);
+        maxNs.store(0, std::memory_order_relaxed);
+    }
+    void mergeInto(QQNotifyProfiler::Entry &entry) const
+    {
+        entry.count += count.load(std::memory_order_relaxed);
+        entry.totalNs += totalNs.load(std::memory_order_relaxed);
+        entry.selfNs += selfNs.load(std::memory_order_relaxed);
+        entry.maxNs = qMax(entry.maxNs, maxNs.load(std::memory_order_relaxed));
+    }
+};
+
+// the system event types get a counter each, the user types share one
+const int typeSlots = QEvent::User + 1;
+// a power of 2; classes beyond that share the overflow counter
+const int classSlots = 512;
+
+std::atomic<quint64> s_nextProfilerId(1);
+
+}
+
+struct QQNotifyProfiler::ThreadCounters {
+    ThreadCounters()
+        : childNs(0)
+    {
+        for (int i = 0; i < typeSlots; ++i) {
+            types[i].clear();
+        }
+        for (int i = 0; i <= classSlots; ++i) {
+            classKeys[i].store(nullptr, std::memory_order_relaxed);
+            classes[i].clear();
+        }
+    }
+
+    Counter &classCounter(const QMetaObject *mo)
+    {
+        const quintptr hash = quintptr(mo) >> 4;
+        for (int probe = 0; probe < classSlots; ++probe) {
+            const int i = int((hash + probe) & (classSlots - 1));
+            const QMetaObject *key = classKeys[i].load(std::memory_order_relaxed);
+            if (key == mo) {
+                return classes[i];
+            } else if (!key) {
+                classKeys[i].store(mo, std::memory_order_release);
+                return classes[i];
+            }
+        }
+        return classes[classSlots];
+    }
+
+    Counter types[typeSlots];
+    std::atomic<const QMetaObject*> classKeys[classSlots + 1];
+    Counter classes[classSlots + 1];
+    // the time spent in the events nested in the current one; owner only
+    qint64 childNs;
+};
+
+QQNotifyProfiler::QQNotifyProfiler()
+    : m_id(s_nextProfilerId.fetch_add(1))
+{
+}
+
+QQNotifyProfiler::~QQNotifyProfiler()
+{
+    qDeleteAll(m_threads);
+}
+
+QQNotifyProfiler::ThreadCounters *QQNotifyProfiler::threadCounters()
+{
+    // the profiler id rather than its address, which a later one could reuse
+    struct Slot {
+        quint64 profilerId;
+        ThreadCounters *counters;
+    };
+    static thread_local Slot slot = { 0, nullptr };
+    if (Q_LIKELY(slot.profilerId == m_id)) {
+        return slot.counters;
+    }
+    ThreadCounters *counters = new ThreadCounters;
+    {
+        QMutexLocker lock(&m_lock);
+        m_threads.append(counters);
+    }
+    slot.profilerId = m_id;
+    slot.counters = counters;
+    return counters;
+}
+
+QQNotifyProfiler::Measurement::Measurement(QQNotifyProfiler *profiler, const QObject *receiver, const QEvent *event)
+    : m_counters(profiler->threadCounters())
+    // the receiver and the event may not survive their dispatch
+    , m_type(event->type())
+    , m_class(receiver->metaObject())
+    , m_outerChildNs(m_counters->childNs)
+{
+    m_counters->childNs = 0;
+    m_start = QQBenchmark::now();
+}
+
+QQNotifyProfiler::Measurement::~Measurement()
+{
+    const qint64 ns = QQBenchmark::now() - m_start;
+    m_counters->types[qMin(m_type, typeSlots - 1)].add(ns, ns - m_counters->childNs);
+    m_counters->classCounter(m_class).add(ns, ns - m_counters->childNs);
+    m_counters->childNs = m_outerChildNs + ns;
+}
+
+static bool moreExpensive(const QQNotifyProfiler::Entry &a, const QQNotifyProfiler::Entry &b)
+{
+    return a.totalNs > b.totalNs;
+}
+
+static QString typeName(int type)
+{
+    if (type >= QEvent::User) {
+        return QStringLiteral("(user events)");
+    }
+    const char *key = QMetaEnum::fromType<QEvent::Type>().valueToKey(type);
+    return key ? QString::fromLatin1(key) : QStringLiteral("QEvent::Type(%1)").arg(type);
+}
+
+QVector<QQNotifyProfiler::Entry> QQNotifyProfiler::byType() const
+{
+    QVector<Entry> entries(typeSlots);
+    for (int i = 0; i < typeSlots; ++i) {
+        Entry &entry = entries[i];
+        entry.count = 0;
+        entry.totalNs = entry.selfNs = entry.maxNs = 0;
+    }
+    {
+        QMutexLocker lock(&m_lock);
+        foreach (const ThreadCounters *counters, m_threads) {
+            for (int i = 0; i < typeSlots; ++i) {
+                counters->types[i].mergeInto(entries[i]);
+            }
+        }
+    }
+    QVector<Entry> result;
+    for (int i = 0; i < typeSlots; ++i) {
+        if (entries.at(i).count) {
+            result.append(entries.at(i));
+            result.last().name = typeName(i);
+        }
+    }
+    std::sort(result.begin(), result.end(), moreExpensive);
+    return result;
+}
+
+QVector<QQNotifyProfiler::Entry> QQNotifyProfiler::byClass() const
+{
+    QHash<const QMetaObject*, Entry> merged;
+    Entry overflow = { QStringLiteral("(other classes)"), 0, 0, 0, 0 };
+    {
+        QMutexLocker lock(&m_lock);
+        foreach (const ThreadCounters *counters, m_threads) {
+            for (int i = 0; i < classSlots; ++i) {
+                const QMetaObject *mo = counters->classKeys[i].load(std::memory_order_acquire);
+                if (mo) {
+                    Entry &entry = merged[mo];
+                    if (entry.name.isEmpty()) {
+                        entry.name = QString::fromLatin1(mo->className());
+                        entry.count = 0;
+                        entry.totalNs = entry.selfNs = entry.maxNs = 0;
+                    }
+                    counters->classes[i].mergeInto(entry);
+                }
+            }
+            counters->classes[classSlots].mergeInto(overflow);
+        }
+    }
+    QVector<Entry> result;
+    result.reserve(merged.count() + 1);
+    foreach (const Entry &entry, merged) {
+        result.append(entry);
+    }
+    if (overflow.count) {
+        result.append(overflow);
+    }
+    std::sort(result.begin(), result.end(), moreExpensive);
+    return result;
+}
+
+void QQNotifyProfiler::reset()
+{
+    QMutexLocker lock(&m_lock);
+    foreach (ThreadCounters *counters, m_threads) {
+        for (int i = 0; i < typeSlots; ++i) {
+            counters->types[i].clear();
+        }
+        // the class keys stay, only their counters are cleared
+        for (int i = 0; i <= classSlots; ++i) {
+            counters->classes[i].clear();
+        }
+    }
+}
+
+static QStringList table(const QString &title, const QVector<QQNotifyProfiler::Entry> &entries, int top)
+{
+    QStringList lines;
+    lines << QStringLiteral("  %1 %2 %3 %4 %5")
+        .arg(title, -32).arg(QStringLiteral("count"), 10).arg(QStringLiteral("total"), 10)
+        .arg(QStringLiteral("self"), 10).arg(QStringLiteral("max"), 10);
+    for (int i = 0; i < entries.count() && i < top; ++i) {
+        const QQNotifyProfiler::Entry &entry = entries.at(i);
+        lines << QStringLiteral("  %1 %2 %3 %4 %5")
+            .arg(entry.name.left(32), -32).arg(entry.count, 10)
+            .arg(QQBenchmark::formatNsecs(entry.totalNs), 10)
+            .arg(QQBenchmark::formatNsecs(entry.selfNs), 10)
+            .arg(QQBenchmark::formatNsecs(entry.maxNs), 10);
+    }
+    return lines;
+}
+
+QStringList QQNotifyProfiler::report(int top) const
+{
+    const QVector<Entry> types = byType();
+    quint64 count = 0;
+    qint64 selfNs = 0;
+    foreach (const Entry &entry, types) {
+        count += entry.count;
+        selfNs += entry.selfNs;
+    }
+    int threads;
+    {
+        QMutexLocker lock(&m_lock);
+        threads = m_threads.count();
+    }
+    QStringList lines;
+    lines << QStringLiteral("Event dispatch profile: %1 events in %2 threads, %3 in notify()")
+        .arg(count).arg(threads).arg(QQBenchmark::formatNsecs(selfNs));
+    lines << table(QStringLiteral("event type"), types, top);
+    lines << table(QStringLiteral("receiver class"), byClass(), top);
+    return lines;
+}
+
+static QJsonArray toJsonArray(const QVector<QQNotifyProfiler::Entry> &entries)
+{
+    QJsonArray array;
+    foreach (const QQNotifyProfiler::Entry &entry, entries) {
+        QJsonObject obj;
+        obj.insert(QStringLiteral("name"), entry.name);
+        obj.insert(QStringLiteral("count"), double(entry.count));
+        obj.insert(QStringLiteral("total_ns"), double(entry.totalNs));
+        obj.insert(QStringLiteral("self_ns"), double(entry.selfNs));
+        obj.insert(QStringLiteral("max_ns"), double(entry.maxNs));
+        array.append(obj);
+    }
+    return array;
+}
+
+QJsonObject QQNotifyProfiler::toJson() const
+{
+    QJsonObject json;
+    json.insert(QStringLiteral("benchmark"), QStringLiteral("notify-profile"));
+    json.insert(QStringLiteral("types"), toJsonArray(byType()));
+    json.insert(QStringLiteral("classes"), toJsonArray(byClass()));
+    return json;
+}
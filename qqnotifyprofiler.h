@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQNOTIFYPROFILER_H
+#define QQNOTIFYPROFILER_H
+
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QEvent;
+class QObject;
+struct QMetaObject;
+QT_END_NAMESPACE
+
+/**
+ * QQNotifyProfiler : counts the events that go through
+ * QCoreApplication::notify(), with their total, self (excluding nested
+ * events) and maximum dispatch time, per QEvent::Type and per receiver
+ * class. The user event types are counted together.
+ *
+ * Every thread that dispatches events gets its own set of counters on its
+ * first event, so recording never takes a lock nor contends with other
+ * threads: the counters are atomics that only their thread writes, and the
+ * receiver classes go into a fixed-size open-addressing table whose keys
+ * are published with a release store. Readers can merge the counters at
+ * any time; the result is exact once the threads are idle.
+ *
+ * The profiler is hooked in by QQApplication::notify(), see
+ * QQApplication::setNotifyProfiling().
+ */
+class QQNotifyProfiler
+{
+    struct ThreadCounters;
+public:
+    QQNotifyProfiler();
+    ~QQNotifyProfiler();
+
+    struct Entry {
+        QString name;
+        quint64 count;
+        qint64 totalNs;
+        qint64 selfNs;
+        qint64 maxNs;
+    };
+
+    /**
+     * The merged counters of all threads, most expensive (total time) first.
+     */
+    QVector<Entry> byType() const;
+    QVector<Entry> byClass() const;
+    /**
+     * Zeroes the counters; updates from threads that are dispatching
+     * events at the same time can be lost.
+     */
+    void reset();
+
+    /**
+     * A table of the @p top most expensive event types and receiver classes.
+     */
+    QStringList report(int top = 15) const;
+    QJsonObject toJson() const;
+
+    /**
+     * Times the dispatch of @p event to @p receiver from construction to
+     * destruction, in the calling thread.
+     */
+    class Measurement
+    {
+    public:
+        Measurement(QQNotifyProfiler *profiler, const QObject *receiver, const QEvent *event);
+        ~Measurement();
+    private:
+        ThreadCounters *m_counters;
+        int m_type;
+        const QMetaObject *m_class;
+        qint64 m_outerChildNs;
+        qint64 m_start;
+    };
+
+private:
+    Q_DISABLE_COPY(QQNotifyProfiler)
+    ThreadCounters *threadCounters();
+
+    const quint64 m_id;
+    mutable QMutex m_lock;
+    QVector<ThreadCounters*> m_threads;
+};
+
+#endif
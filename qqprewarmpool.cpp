@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqprewarmpool.h"
+
+#include <QCoreApplication>
+#include <QLayout>
+#include <QTimer>
+#include <QWidget>
+
+QQPrewarmPool::QQPrewarmPool(QObject *parent)
+    : QObject(parent)
+    , m_size(0)
+    , m_scheduled(false)
+{
+    // the widgets have to go before QApplication does
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &QQPrewarmPool::clear);
+}
+
+QQPrewarmPool::~QQPrewarmPool()
+{
+    clear();
+}
+
+void QQPrewarmPool::setFactory(const Factory &factory)
+{
+    m_factory = factory;
+    schedule();
+}
+
+void QQPrewarmPool::setSize(int size)
+{
+    m_size = qMax(0, size);
+    while (m_widgets.count() > m_size) {
+        delete m_widgets.takeLast();
+    }
+    schedule();
+}
+
+int QQPrewarmPool::available() const
+{
+    int n = 0;
+    foreach (const QPointer<QWidget> &widget, m_widgets) {
+        if (widget) {
+            n += 1;
+        }
+    }
+    return n;
+}
+
+QWidget *QQPrewarmPool::take()
+{
+    QWidget *widget = nullptr;
+    while (!widget && !m_widgets.isEmpty()) {
+        widget = m_widgets.takeFirst();
+    }
+    schedule();
+    return widget;
+}
+
+void QQPrewarmPool::schedule()
+{
+    if (!m_scheduled && m_factory && m_widgets.count() < m_size) {
+        m_scheduled = true;
+        QTimer::singleShot(0, this, SLOT(fill()));
+    }
+}
+
+void QQPrewarmPool::fill()
+{
+    m_scheduled = false;
+    // forget the widgets that were deleted behind our back
+    m_widgets.removeAll(QPointer<QWidget>());
+    if (!m_factory || m_widgets.count() >= m_size) {
+        return;
+    }
+    // one widget per event loop iteration
+    QWidget *widget = m_factory();
+    if (widget) {
+        widget->ensurePolished();
+        if (QLayout *layout = widget->layout()) {
+            layout->activate();
+        }
+        m_widgets.append(widget);
+        emit prewarmed(widget);
+        schedule();
+    }
+}
+
+void QQPrewarmPool::clear()
+{
+    m_size = 0;
+    while (!m_widgets.isEmpty()) {
+        delete m_widgets.takeLast();
+    }
+}
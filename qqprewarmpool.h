@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQPREWARMPOOL_H
+#define QQPREWARMPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QWidget;
+QT_END_NAMESPACE
+
+/**
+ * QQPrewarmPool : keeps a number of hidden, ready-made widgets (typically
+ * windows) so that opening a new one only requires showing it.
+ *
+ * The widgets are built with the factory function one at a time from the
+ * event loop, like the style cache preloads styles, so user input is not
+ * held up for long. Each one is polished and has its layout activated, but
+ * no native window is created, so it can still be reparented cheaply.
+ * take() hands out a widget and schedules a replacement.
+ *
+ * The pool starts out with size 0, i.e. empty and inactive. It empties
+ * itself when the application is about to quit.
+ */
+class QQPrewarmPool : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QWidget*()> Factory;
+
+    explicit QQPrewarmPool(QObject *parent = nullptr);
+    ~QQPrewarmPool();
+
+    void setFactory(const Factory &factory);
+    /**
+     * Sets the number of widgets to keep ready, building or deleting
+     * widgets as needed.
+     */
+    void setSize(int size);
+    int size() const
+    {
+        return m_size;
+    }
+    /**
+     * The number of widgets that are ready.
+     */
+    int available() const;
+
+    /**
+     * Returns a prewarmed (hidden) widget, or nullptr when none is ready.
+     * The caller takes ownership.
+     */
+    QWidget *take();
+
+Q_SIGNALS:
+    void prewarmed(QWidget *widget);
+
+private Q_SLOTS:
+    void fill();
+    void clear();
+
+private:
+    void schedule();
+
+    Factory m_factory;
+    int m_size;
+    bool m_scheduled;
+    QList<QPointer<QWidget> > m_widgets;
+};
+
+#endif
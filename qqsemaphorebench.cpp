@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/*
+ * qqsemaphorebench : microbenchmarks for QQNativeSemaphore, across its wait
+ * backends, monitor modes and producer thread counts. Results are printed
+ * and written as JSON (--json).
+ */
+
+#include "qqnativesemaphore.h"
+#include "qqbenchmark.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QThread>
+#include <QVector>
+#include <QDebug>
+
+#include <atomic>
+#include <functional>
+
+#include <signal.h>
+#include <time.h>
+
+namespace {
+
+// clock_gettime() is async-signal-safe, unlike the first call to QQBenchmark::now()
+qint64 monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+class Worker : public QThread
+{
+public:
+    explicit Worker(const std::function<void()> &job)
+        : m_job(job)
+    {}
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        m_job();
+    }
+
+private:
+    std::function<void()> m_job;
+};
+
+// spin until @p flag is set or @p msecs have passed
+bool waitFor(const std::atomic_bool &flag, int msecs = 1000)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!flag) {
+        if (timer.elapsed() > msecs) {
+            return false;
+        }
+        QThread::yieldCurrentThread();
+    }
+    return true;
+}
+
+struct Configuration {
+    QQNativeSemaphore::WaitBackend backend;
+    QQNativeSemaphore::MonitorMode monitor;
+
+    QString backendName() const
+    {
+        return backend == QQNativeSemaphore::FutexWait ? QStringLiteral("futex") : QStringLiteral("sem_t");
+    }
+    QString monitorName() const
+    {
+        return monitor == QQNativeSemaphore::SharedMonitor ? QStringLiteral("shared") : QStringLiteral("dedicated");
+    }
+    void apply() const
+    {
+        QQNativeSemaphore::setDefaultWaitBackend(backend);
+        QQNativeSemaphore::setDefaultMonitorMode(monitor);
+    }
+    QJsonObject tag(const QString &test) const
+    {
+        QJsonObject obj;
+        obj.insert(QStringLiteral("test"), test);
+        obj.insert(QStringLiteral("waitBackend"), backendName());
+        obj.insert(QStringLiteral("monitor"), monitorName());
+        return obj;
+    }
+};
+
+QJsonObject merged(QJsonObject obj, const QJsonObject &other)
+{
+    for (auto it = other.constBegin(); it != other.constEnd(); ++it) {
+        obj.insert(it.key(), it.value());
+    }
+    return obj;
+}
+
+// non-native mode: the delay between trigger() and the triggered() signal
+QJsonObject triggerLatency(const Configuration &config, int iterations)
+{
+    config.apply();
+    QQNativeSemaphore sem;
+    std::atomic_bool received(false);
+    QQLatencyStats latency(QStringLiteral("trigger->triggered %1/%2").arg(config.backendName(), config.monitorName()), iterations);
+    QObject::connect(&sem, &QQNativeSemaphore::triggered, [&](QVariant val) {
+        latency.addSample(monotonicNs() - val.toLongLong());
+        received = true;
+    });
+    sem.setEnabled(true);
+    int missed = 0;
+    for (int i = 0; i < iterations; ++i) {
+        received = false;
+        if (!sem.trigger(QQNativeSemaphore::Payload(monotonicNs())) || !waitFor(received)) {
+            ++missed;
+        }
+    }
+    sem.setEnabled(false);
+    QQBenchmark::print(latency.summary());
+    QJsonObject result = merged(config.tag(QStringLiteral("trigger-latency")), latency.toJson());
+    result.insert(QStringLiteral("missed"), missed);
+    return result;
+}
+
+// non-native mode: @p producers threads trigger as fast as they can
+QJsonObject throughput(const Configuration &config, int producers, int triggersPerProducer)
+{
+    config.apply();
+    QQNativeSemaphore sem;
+    std::atomic<qint64> delivered(0);
+    std::atomic<qint64> accepted(0);
+    QObject::connect(&sem, &QQNativeSemaphore::triggered, [&delivered](QVariant) {
+        delivered += 1;
+    });
+    sem.setEnabled(true);
+
+    std::atomic_bool go(false);
+    QVector<Worker*> workers;
+    for (int p = 0; p < producers; ++p) {
+        workers.append(new Worker([&]() {
+            while (!go) {
+                QThread::yieldCurrentThread();
+            }
+            for (int i = 0; i < triggersPerProducer; ++i) {
+                if (sem.trigger(QQNativeSemaphore::Payload(i))) {
+                    accepted += 1;
+                }
+            }
+        }));
+        workers.last()->start();
+    }
+    const qint64 t0 = monotonicNs();
+    go = true;
+    foreach (Worker *worker, workers) {
+        worker->wait();
+    }
+    QElapsedTimer timeout;
+    timeout.start();
+    while (delivered < accepted && timeout.elapsed() < 5000) {
+        QThread::yieldCurrentThread();
+    }
+    const qint64 elapsed = monotonicNs() - t0;
+    sem.setEnabled(false);
+    qDeleteAll(workers);
+
+    const double rate = elapsed > 0 ? delivered * 1e9 / elapsed : 0;
+    QQBenchmark::print(QStringLiteral("throughput %1/%2, %3 producers: %4 triggers/s, %5 of %6 rejected (queue full)")
+        .arg(config.backendName(), config.monitorName()).arg(producers)
+        .arg(rate, 0, 'f', 0).arg(qint64(producers) * triggersPerProducer - accepted)
+        .arg(qint64(producers) * triggersPerProducer));
+    QJsonObject result = config.tag(QStringLiteral("throughput"));
+    result.insert(QStringLiteral("producers"), producers);
+    result.insert(QStringLiteral("triggers"), double(qint64(producers) * triggersPerProducer));
+    result.insert(QStringLiteral("accepted"), double(accepted));
+    result.insert(QStringLiteral("delivered"), double(delivered));
+    result.insert(QStringLiteral("elapsed_ns"), double(elapsed));
+    result.insert(QStringLiteral("triggers_per_s"), rate);
+    return result;
+}
+
+// native mode: the delay between trigger() and the return from a blocked wait()/timedWait()
+QJsonObject waitLatency(const Configuration &config, bool timed, int iterations)
+{
+    config.apply();
+    QQNativeSemaphore sem(true, true);
+    const QString test = timed ? QStringLiteral("timedWait-latency") : QStringLiteral("wait-latency");
+    QQLatencyStats latency(QStringLiteral("%1 %2").arg(test, config.backendName()), iterations);
+    std::atomic_bool waiting(false), woken(false);
+    // wait() emits triggered() from the waiting thread
+    QObject::connect(&sem, &QQNativeSemaphore::triggered, [&](QVariant val) {
+        latency.addSample(monotonicNs() - val.toLongLong());
+    });
+    Worker waiter([&]() {
+        for (int i = 0; i < iterations; ++i) {
+            waiting = true;
+            if (timed) {
+                sem.timedWait(1.0);
+            } else {
+                sem.wait();
+            }
+            waiting = false;
+            woken = true;
+        }
+    });
+    waiter.start();
+    int missed = 0;
+    for (int i = 0; i < iterations; ++i) {
+        if (!waitFor(waiting)) {
+            ++missed;
+            break;
+        }
+        // give the waiter the time to block
+        QThread::usleep(100);
+        woken = false;
+        sem.trigger(QQNativeSemaphore::Payload(monotonicNs()));
+        if (!waitFor(woken, 2000)) {
+            ++missed;
+        }
+    }
+    // release the waiter if we gave up on it
+    while (!waiter.wait(10)) {
+        sem.trigger(QQNativeSemaphore::Payload(monotonicNs()));
+    }
+    QQBenchmark::print(latency.summary());
+    QJsonObject result = merged(config.tag(test), latency.toJson());
+    result.insert(QStringLiteral("missed"), missed);
+    return result;
+}
+
+QQNativeSemaphore *signalTarget = nullptr;
+
+void triggerFromSignal(int)
+{
+    signalTarget->trigger(QQNativeSemaphore::Payload(monotonicNs()));
+}
+
+// non-native mode: @p producers threads each raise SIGUSR1 at themselves;
+// the handler triggers the semaphore.
+QJsonObject signalProducers(const Configuration &config, int producers, int signalsPerProducer)
+{
+    config.apply();
+    QQNativeSemaphore sem;
+    QQLatencyStats latency(QStringLiteral("signal->triggered %1/%2, %3 producers")
+        .arg(config.backendName(), config.monitorName()).arg(producers), producers * signalsPerProducer);
+    std::atomic<qint64> delivered(0);
+    // only the monitor thread adds samples
+    QObject::connect(&sem, &QQNativeSemaphore::triggered, [&](QVariant val) {
+        latency.addSample(monotonicNs() - val.toLongLong());
+        delivered += 1;
+    });
+    sem.setEnabled(true);
+    signalTarget = &sem;
+    struct sigaction action, oldAction;
+    action.sa_handler = triggerFromSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, &oldAction);
+
+    QVector<Worker*> workers;
+    for (int p = 0; p < producers; ++p) {
+        workers.append(new Worker([&]() {
+            for (int i = 0; i < signalsPerProducer; ++i) {
+                pthread_kill(pthread_self(), SIGUSR1);
+                // don't outrun the queue
+                if ((i & 15) == 15) {
+                    QThread::usleep(50);
+                }
+            }
+        }));
+        workers.last()->start();
+    }
+    foreach (Worker *worker, workers) {
+        worker->wait();
+    }
+    QElapsedTimer timeout;
+    timeout.start();
+    while (delivered + sem.overflowCount() < qint64(producers) * signalsPerProducer && timeout.elapsed() < 2000) {
+        QThread::yieldCurrentThread();
+    }
+    sem.setEnabled(false);
+    sigaction(SIGUSR1, &oldAction, nullptr);
+    signalTarget = nullptr;
+    qDeleteAll(workers);
+
+    QQBenchmark::print(latency.summary());
+    QJsonObject result = merged(config.tag(QStringLiteral("signal-producers")), latency.toJson());
+    result.insert(QStringLiteral("producers"), producers);
+    result.insert(QStringLiteral("signals"), producers * signalsPerProducer);
+    result.insert(QStringLiteral("delivered"), double(delivered));
+    result.insert(QStringLiteral("overflows"), double(sem.overflowCount()));
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    const QCommandLineOption iterationsOption(QStringLiteral("iterations"),
+                                              QStringLiteral("latency samples per measurement"),
+                                              "N", QString::number(10000));
+    const QCommandLineOption maxProducersOption(QStringLiteral("max-producers"),
+                                                QStringLiteral("measure with 1, 2, 4, ... up to <N> producer threads"),
+                                                "N", QString::number(64));
+    const QCommandLineOption jsonOption(QStringLiteral("json"),
+                                        QStringLiteral("write the results as JSON to <file> (- for stdout)"),
+                                        "file");
+    parser.addOption(iterationsOption);
+    parser.addOption(maxProducersOption);
+    parser.addOption(jsonOption);
+    parser.addHelpOption();
+    parser.process(app);
+
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    const int maxProducers = qBound(1, parser.value(maxProducersOption).toInt(), 1024);
+    // prime QQBenchmark::now() and the monotonic clock
+    QQBenchmark::now();
+    monotonicNs();
+
+    QVector<Configuration> configurations;
+    const QQNativeSemaphore::WaitBackend backends[] = { QQNativeSemaphore::SemaphoreWait, QQNativeSemaphore::FutexWait };
+    const QQNativeSemaphore::MonitorMode monitors[] = { QQNativeSemaphore::DedicatedMonitor, QQNativeSemaphore::SharedMonitor };
+    for (QQNativeSemaphore::WaitBackend backend : backends) {
+        if (!QQNativeSemaphore::isWaitBackendAvailable(backend)) {
+            continue;
+        }
+        for (QQNativeSemaphore::MonitorMode monitor : monitors) {
+            Configuration config = { backend, monitor };
+            configurations.append(config);
+        }
+    }
+
+    QJsonArray results;
+    foreach (const Configuration &config, configurations) {
+        results.append(triggerLatency(config, iterations));
+        for (int producers = 1; producers <= maxProducers; producers *= 2) {
+            results.append(throughput(config, producers, qMax(1, iterations * 10 / producers)));
+        }
+        for (int producers = 1; producers <= maxProducers; producers *= 2) {
+            results.append(signalProducers(config, producers, qMax(1, iterations / producers)));
+        }
+        // the waits are native mode, where the monitor mode doesn't matter
+        if (config.monitor == QQNativeSemaphore::SharedMonitor) {
+            results.append(waitLatency(config, false, iterations));
+            results.append(waitLatency(config, true, iterations));
+        }
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject report;
+        report.insert(QStringLiteral("benchmark"), QStringLiteral("qqnativesemaphore"));
+        report.insert(QStringLiteral("iterations"), iterations);
+        report.insert(QStringLiteral("queueCapacity"), QQNativeSemaphore::queueCapacity());
+        report.insert(QStringLiteral("results"), results);
+        if (!QQBenchmark::writeJson(parser.value(jsonOption), report)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+# QQNativeSemaphore microbenchmarks; needs only QtCore
+TEMPLATE      = app
+TARGET        = qqsemaphorebench
+QT            = core
+CONFIG       += console
+CONFIG       -= app_bundle
+
+QMAKE_CXXFLAGS += $$QMAKE_CXXFLAGS_CXX11
+
+# this project shares its directory with menus.pro
+OBJECTS_DIR   = .obj-qqsemaphorebench
+MOC_DIR       = .moc-qqsemaphorebench
+
+HEADERS       = qqnativesemaphore.h \
+                qqlogging.h \
+                qqbenchmark.h
+SOURCES       = qqsemaphorebench.cpp \
+                qqlogging.cpp \
+                qqbenchmark.cpp
+unix {
+    SOURCES += qqnativesemaphore_unix.cpp
+}
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqshortcutregistry.h"
+#include "qqlogging.h"
+
+#include <QAction>
+#include <QActionEvent>
+#include <QApplication>
+#include <QMenu>
+#include <QShortcutEvent>
+#include <QWidget>
+#include <QDebug>
+
+uint qHash(const QQShortcutRegistry::Key &key, uint seed)
+{
+    return qHash(quintptr(key.scope), seed) ^ qHash(key.chords01, seed) ^ qHash(key.chords23, seed + 1);
+}
+
+QQShortcutRegistry::QQShortcutRegistry(QObject *parent)
+    : QObject(parent)
+    , m_enabled(false)
+    , m_ambiguousCount(0)
+{
+    qRegisterMetaType<QQShortcutRegistry::Conflict>();
+}
+
+QQShortcutRegistry *QQShortcutRegistry::instance()
+{
+    static QPointer<QQShortcutRegistry> registry;
+    if (!registry) {
+        registry = new QQShortcutRegistry(qApp);
+    }
+    return registry;
+}
+
+void QQShortcutRegistry::setEnabled(bool enabled)
+{
+    if (enabled == m_enabled) {
+        return;
+    }
+    m_enabled = enabled;
+    if (enabled) {
+        qApp->installEventFilter(this);
+        foreach (QWidget *widget, QApplication::allWidgets()) {
+            foreach (QAction *action, widget->actions()) {
+                registerAction(action);
+            }
+        }
+    } else {
+        qApp->removeEventFilter(this);
+        foreach (QAction *action, m_actions.keys()) {
+            disconnect(action, &QObject::destroyed, this, &QQShortcutRegistry::forget);
+        }
+        m_actions.clear();
+        m_sequences.clear();
+        m_prefixes.clear();
+        m_allScopes.clear();
+        m_conflicts.clear();
+    }
+}
+
+QKeySequence QQShortcutRegistry::normalized(const QKeySequence &sequence)
+{
+    int chords[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < sequence.count() && i < 4; ++i) {
+        int key = sequence[i] & ~Qt::KeyboardModifierMask;
+        int modifiers = sequence[i] & Qt::KeyboardModifierMask & ~Qt::KeypadModifier;
+        if (key >= 'a' && key <= 'z') {
+            key -= 'a' - 'A';
+        } else if (key == Qt::Key_Backtab) {
+            key = Qt::Key_Tab;
+            modifiers |= Qt::ShiftModifier;
+        }
+        chords[i] = key | modifiers;
+    }
+    return QKeySequence(chords[0], chords[1], chords[2], chords[3]);
+}
+
+QQShortcutRegistry::Key QQShortcutRegistry::makeKey(const QObject *scope, const QKeySequence &sequence, int chords)
+{
+    Key key;
+    key.scope = scope;
+    key.chords01 = (quint64(uint(sequence[0])) << 32) | (chords > 1 ? uint(sequence[1]) : 0);
+    key.chords23 = (quint64(chords > 2 ? uint(sequence[2]) : 0) << 32) | (chords > 3 ? uint(sequence[3]) : 0);
+    return key;
+}
+
+QKeySequence QQShortcutRegistry::prefix(const QKeySequence &sequence, int chords)
+{
+    return QKeySequence(sequence[0], chords > 1 ? sequence[1] : 0,
+                        chords > 2 ? sequence[2] : 0, chords > 3 ? sequence[3] : 0);
+}
+
+const QObject *QQShortcutRegistry::scopeOf(const QAction *action)
+{
+    if (action->shortcutContext() == Qt::ApplicationShortcut) {
+        return nullptr;
+    }
+    QWidget *w = qobject_cast<QWidget*>(action->parent());
+    if (!w && !action->associatedWidgets().isEmpty()) {
+        w = action->associatedWidgets().first();
+    }
+    // menus are windows of their own; their shortcuts apply to the window holding them
+    QWidget *scope = w;
+    while (w) {
+        scope = w;
+        if (w->isWindow() && !qobject_cast<QMenu*>(w)) {
+            break;
+        }
+        w = w->parentWidget();
+    }
+    return scope ? static_cast<const QObject*>(scope) : action;
+}
+
+void QQShortcutRegistry::registerAction(QAction *action)
+{
+    if (!action) {
+        return;
+    }
+    Registration registration;
+    registration.scope = scopeOf(action);
+    foreach (const QKeySequence &sequence, action->shortcuts()) {
+        if (!sequence.isEmpty()) {
+            registration.sequences.append(normalized(sequence));
+        }
+    }
+    const auto it = m_actions.find(action);
+    if (it != m_actions.end()) {
+        if (it->scope == registration.scope && it->sequences == registration.sequences) {
+            return;
+        }
+        remove(action, *it);
+        m_actions.erase(it);
+    } else {
+        connect(action, &QObject::destroyed, this, &QQShortcutRegistry::forget);
+    }
+    // check against the other actions before adding this one
+    foreach (const QKeySequence &sequence, registration.sequences) {
+        check(action, registration.scope, sequence);
+    }
+    insert(action, registration);
+    m_actions.insert(action, registration);
+}
+
+void QQShortcutRegistry::unregisterAction(QAction *action)
+{
+    const auto it = m_actions.find(action);
+    if (it != m_actions.end()) {
+        remove(action, *it);
+        m_actions.erase(it);
+        disconnect(action, &QObject::destroyed, this, &QQShortcutRegistry::forget);
+    }
+}
+
+void QQShortcutRegistry::forget(QObject *object)
+{
+    // object is being destroyed: only use it as a key
+    QAction *action = static_cast<QAction*>(object);
+    const auto it = m_actions.find(action);
+    if (it != m_actions.end()) {
+        remove(action, *it);
+        m_actions.erase(it);
+    }
+}
+
+void QQShortcutRegistry::insert(QAction *action, const Registration &registration)
+{
+    foreach (const QKeySequence &sequence, registration.sequences) {
+        const int n = sequence.count();
+        m_sequences[makeKey(registration.scope, sequence, n)].append(action);
+        m_allScopes[makeKey(nullptr, sequence, n)].append(action);
+        for (int i = 1; i < n; ++i) {
+            m_prefixes[makeKey(registration.scope, sequence, i)].append(action);
+        }
+    }
+}
+
+template <typename Hash>
+static void removeFrom(Hash &hash, const typename Hash::key_type &key, QAction *action)
+{
+    const auto it = hash.find(key);
+    if (it != hash.end()) {
+        it->removeOne(action);
+        if (it->isEmpty()) {
+            hash.erase(it);
+        }
+    }
+}
+
+void QQShortcutRegistry::remove(QAction *action, const Registration &registration)
+{
+    foreach (const QKeySequence &sequence, registration.sequences) {
+        const int n = sequence.count();
+        removeFrom(m_sequences, makeKey(registration.scope, sequence, n), action);
+        removeFrom(m_allScopes, makeKey(nullptr, sequence, n), action);
+        for (int i = 1; i < n; ++i) {
+            removeFrom(m_prefixes, makeKey(registration.scope, sequence, i), action);
+        }
+    }
+}
+
+void QQShortcutRegistry::check(QAction *action, const QObject *scope, const QKeySequence &sequence)
+{
+    const int n = sequence.count();
+    if (scope) {
+        // the same sequence in the same window, or application-wide
+        auto it = m_sequences.constFind(makeKey(scope, sequence, n));
+        if (it != m_sequences.constEnd()) {
+            addConflict(Duplicate, sequence, sequence, action, it->first());
+        }
+        it = m_sequences.constFind(makeKey(nullptr, sequence, n));
+        if (it != m_sequences.constEnd()) {
+            addConflict(Duplicate, sequence, sequence, action, it->first());
+        }
+    } else {
+        // an application-wide shortcut conflicts with the same sequence anywhere
+        const auto it = m_allScopes.constFind(makeKey(nullptr, sequence, n));
+        if (it != m_allScopes.constEnd()) {
+            addConflict(Duplicate, sequence, sequence, action, it->first());
+        }
+    }
+    // a longer sequence that starts with this one
+    const auto pt = m_prefixes.constFind(makeKey(scope, sequence, n));
+    if (pt != m_prefixes.constEnd()) {
+        QAction *other = pt->first();
+        foreach (const QKeySequence &longer, m_actions.value(other).sequences) {
+            if (longer.count() > n && prefix(longer, n) == sequence) {
+                addConflict(Prefix, sequence, longer, action, other);
+                break;
+            }
+        }
+    }
+    // a shorter sequence this one starts with
+    for (int i = 1; i < n; ++i) {
+        const auto it = m_sequences.constFind(makeKey(scope, sequence, i));
+        if (it != m_sequences.constEnd()) {
+            addConflict(Prefix, prefix(sequence, i), sequence, it->first(), action);
+        }
+    }
+}
+
+void QQShortcutRegistry::addConflict(ConflictKind kind, const QKeySequence &sequence, const QKeySequence &other,
+                                     QAction *action, QAction *otherAction)
+{
+    Conflict conflict;
+    conflict.kind = kind;
+    conflict.sequence = sequence;
+    conflict.other = other;
+    conflict.action = action;
+    conflict.otherAction = otherAction;
+    m_conflicts.append(conflict);
+    qqCDebug(lcShortcuts) << "shortcut conflict:" << kind << sequence << action << other << otherAction;
+    emit conflictFound(conflict);
+}
+
+bool QQShortcutRegistry::isValid(const Conflict &conflict) const
+{
+    if (!conflict.action || !conflict.otherAction || conflict.action == conflict.otherAction) {
+        return false;
+    }
+    const auto a = m_actions.constFind(conflict.action.data());
+    const auto b = m_actions.constFind(conflict.otherAction.data());
+    if (a == m_actions.constEnd() || b == m_actions.constEnd()) {
+        return false;
+    }
+    if (a->scope != b->scope && a->scope && b->scope) {
+        return false;
+    }
+    return a->sequences.contains(conflict.sequence) && b->sequences.contains(conflict.other);
+}
+
+QVector<QQShortcutRegistry::Conflict> QQShortcutRegistry::conflicts() const
+{
+    // drop the conflicts that were resolved or recorded more than once
+    QVector<Conflict> current;
+    QSet<QString> seen;
+    foreach (const Conflict &conflict, m_conflicts) {
+        if (!isValid(conflict)) {
+            continue;
+        }
+        const QString id = QStringLiteral("%1 %2 %3 %4 %5").arg(conflict.kind)
+            .arg(quintptr(conflict.action.data())).arg(quintptr(conflict.otherAction.data()))
+            .arg(conflict.sequence.toString(QKeySequence::PortableText))
+            .arg(conflict.other.toString(QKeySequence::PortableText));
+        if (!seen.contains(id)) {
+            seen.insert(id);
+            current.append(conflict);
+        }
+    }
+    m_conflicts = current;
+    return current;
+}
+
+QStringList QQShortcutRegistry::report() const
+{
+    const QVector<Conflict> current = conflicts();
+    QStringList lines;
+    lines << tr("%1 actions with shortcuts indexed, %2 conflicts, %3 ambiguous shortcut events")
+        .arg(m_actions.count()).arg(current.count()).arg(m_ambiguousCount);
+    foreach (const Conflict &conflict, current) {
+        const QString text = conflict.action->text();
+        const QString otherText = conflict.otherAction->text();
+        if (conflict.kind == Duplicate) {
+            lines << tr("duplicate: %1 on \"%2\" and \"%3\"")
+                .arg(conflict.sequence.toString(QKeySequence::NativeText), text, otherText);
+        } else {
+            lines << tr("prefix: %1 (\"%2\") starts %3 (\"%4\")")
+                .arg(conflict.sequence.toString(QKeySequence::NativeText), text)
+                .arg(conflict.other.toString(QKeySequence::NativeText), otherText);
+        }
+    }
+    for (auto it = m_ambiguousSequences.constBegin(); it != m_ambiguousSequences.constEnd(); ++it) {
+        lines << tr("ambiguous: %1 (%2 times)").arg(it.key()).arg(it.value());
+    }
+    return lines;
+}
+
+bool QQShortcutRegistry::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type()) {
+        case QEvent::ActionAdded:
+        case QEvent::ActionChanged:
+            registerAction(static_cast<QActionEvent*>(event)->action());
+            break;
+        case QEvent::Shortcut: {
+            const QShortcutEvent *se = static_cast<QShortcutEvent*>(event);
+            if (se->isAmbiguous()) {
+                m_ambiguousCount += 1;
+                m_ambiguousSequences[se->key().toString(QKeySequence::NativeText)] += 1;
+                qqCDebug(lcShortcuts) << "ambiguous shortcut" << se->key() << "for" << watched;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return QObject::eventFilter(watched, event);
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQSHORTCUTREGISTRY_H
+#define QQSHORTCUTREGISTRY_H
+
+#include <QObject>
+#include <QHash>
+#include <QKeySequence>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QAction;
+QT_END_NAMESPACE
+
+/**
+ * QQShortcutRegistry : an index of the shortcuts of all the QActions that
+ * have been added to a widget (a window, a menubar or a menu), for finding
+ * the shortcuts that cannot fire reliably.
+ *
+ * Two kinds of conflicts are detected when an action is registered:
+ * - duplicates: the same (normalised) key sequence on two actions in the
+ *   same window, or on an application-wide action and any other action;
+ * - prefixes: a sequence that is the start of a longer one in the same
+ *   window, as in "Ctrl+X" and "Ctrl+X, Ctrl+S", which makes QShortcutMap
+ *   wait for the next key.
+ * The sequences, and all the proper prefixes of the multi-chord ones, are
+ * hashed per window, so registration costs a handful of hash lookups
+ * regardless of the number of actions. Actions are indexed whether or not
+ * they are enabled: a conflict between them is a bug waiting to happen.
+ *
+ * The registry follows the QEvent::ActionAdded and QEvent::ActionChanged
+ * events through an application event filter, which also counts the
+ * QEvent::Shortcut events that QShortcutMap delivers as ambiguous.
+ */
+class QQShortcutRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    enum ConflictKind {
+        Duplicate,
+        Prefix
+    };
+    Q_ENUM(ConflictKind)
+
+    struct Conflict {
+        ConflictKind kind;
+        // for Prefix conflicts, @p sequence is the shorter one
+        QKeySequence sequence;
+        QKeySequence other;
+        QPointer<QAction> action;
+        QPointer<QAction> otherAction;
+    };
+
+    static QQShortcutRegistry *instance();
+
+    /**
+     * Starts or stops following the actions of the application. Enabling the
+     * registry indexes the actions that already belong to a widget.
+     */
+    void setEnabled(bool enabled);
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    /**
+     * (Re)index the shortcuts of @p action; normally called automatically.
+     */
+    void registerAction(QAction *action);
+    void unregisterAction(QAction *action);
+
+    int actionCount() const
+    {
+        return m_actions.count();
+    }
+    /**
+     * The current conflicts. Only the sequences that were found to conflict
+     * at registration are checked again, so this stays cheap.
+     */
+    QVector<Conflict> conflicts() const;
+    /**
+     * The number of ambiguous QEvent::Shortcut events seen so far.
+     */
+    int ambiguousCount() const
+    {
+        return m_ambiguousCount;
+    }
+    /**
+     * A readable report of the conflicts and ambiguous shortcut events,
+     * one per line.
+     */
+    QStringList report() const;
+
+    /**
+     * Returns @p sequence in the form used for indexing: letters in upper
+     * case, as QKeySequence("ctrl+a") already does, and without the keypad
+     * modifier, which does not make a different shortcut for the user.
+     */
+    static QKeySequence normalized(const QKeySequence &sequence);
+
+Q_SIGNALS:
+    void conflictFound(const QQShortcutRegistry::Conflict &conflict);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void forget(QObject *object);
+
+private:
+    explicit QQShortcutRegistry(QObject *parent);
+
+    // a key sequence (or prefix) within the window its shortcuts apply to;
+    // scope is nullptr for application-wide shortcuts
+    struct Key {
+        const QObject *scope;
+        quint64 chords01;
+        quint64 chords23;
+        bool operator==(const Key &other) const
+        {
+            return scope == other.scope && chords01 == other.chords01 && chords23 == other.chords23;
+        }
+    };
+    friend uint qHash(const Key &key, uint seed);
+
+    struct Registration {
+        const QObject *scope;
+        QVector<QKeySequence> sequences;
+    };
+
+    static Key makeKey(const QObject *scope, const QKeySequence &sequence, int chords);
+    static QKeySequence prefix(const QKeySequence &sequence, int chords);
+    static const QObject *scopeOf(const QAction *action);
+    void insert(QAction *action, const Registration &registration);
+    void remove(QAction *action, const Registration &registration);
+    void check(QAction *action, const QObject *scope, const QKeySequence &sequence);
+    bool isValid(const Conflict &conflict) const;
+    void addConflict(ConflictKind kind, const QKeySequence &sequence, const QKeySequence &other,
+                     QAction *action, QAction *otherAction);
+
+    bool m_enabled;
+    QHash<QAction*, Registration> m_actions;
+    // complete sequences and proper prefixes of sequences
+    QHash<Key, QVector<QAction*> > m_sequences;
+    QHash<Key, QVector<QAction*> > m_prefixes;
+    // the sequences in all scopes together, to check application-wide shortcuts
+    QHash<Key, QVector<QAction*> > m_allScopes;
+    mutable QVector<Conflict> m_conflicts;
+    int m_ambiguousCount;
+    QHash<QString, int> m_ambiguousSequences;
+};
+
+Q_DECLARE_METATYPE(QQShortcutRegistry::Conflict)
+
+#endif
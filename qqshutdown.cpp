@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include "qqshutdown.h"
+#include "qqlogging.h"
+
+#include <QApplication>
+#include <QEvent>
+#include <QJsonArray>
+#include <QWidget>
+#include <QDebug>
+
+#include <cstdio>
+
+QQShutdownSequence::QQShutdownSequence(QObject *parent)
+    : QObject(parent)
+    , m_stage(IdleStage)
+    , m_signal(0)
+    , m_deadline(3000)
+    , m_expired(false)
+    , m_quitOnLastWindowClosed(true)
+{
+    m_deadlineTimer.setSingleShot(true);
+    connect(&m_deadlineTimer, &QTimer::timeout, this, &QQShutdownSequence::expire);
+}
+
+void QQShutdownSequence::setDeadline(int msecs)
+{
+    m_deadline = qMax(0, msecs);
+}
+
+QString QQShutdownSequence::stageName(Stage stage)
+{
+    switch (stage) {
+        case IdleStage:
+            return QStringLiteral("idle");
+        case NotifyStage:
+            return QStringLiteral("notify");
+        case FlushStage:
+            return QStringLiteral("flush");
+        case CloseStage:
+            return QStringLiteral("close");
+        case FinalStage:
+            return QStringLiteral("final");
+    }
+    return QString();
+}
+
+void QQShutdownSequence::start(int sig)
+{
+    if (isRunning()) {
+        return;
+    }
+    m_signal = sig;
+    m_expired = false;
+    m_timings.clear();
+    // closing the last window must not end the event loop before we're done
+    m_quitOnLastWindowClosed = QApplication::quitOnLastWindowClosed();
+    QApplication::setQuitOnLastWindowClosed(false);
+    m_deadlineTimer.start(m_deadline);
+    enterStage(NotifyStage);
+}
+
+void QQShutdownSequence::enterStage(Stage stage)
+{
+    if (m_stage != IdleStage) {
+        const qint64 elapsed = m_stageTimer.nsecsElapsed();
+        m_timings.append(qMakePair(m_stage, elapsed));
+        qqCDebug(lcSignals) << "shutdown stage" << stageName(m_stage) << "took" << elapsed / 1e6 << "ms";
+        emit stageFinished(m_stage, elapsed);
+    }
+    m_stage = stage;
+    m_stageTimer.start();
+    switch (stage) {
+        case NotifyStage:
+            emit aboutToShutdown(m_signal);
+            break;
+        case FlushStage:
+            emit flushRequested(m_signal);
+            QCoreApplication::sendPostedEvents();
+            fflush(nullptr);
+            break;
+        case CloseStage:
+            closeWindows();
+            // advance() is called when the last window has gone
+            return;
+        case FinalStage: {
+            m_deadlineTimer.stop();
+            m_stage = IdleStage;
+            foreach (const QPointer<QWidget> &w, m_closing) {
+                if (w) {
+                    w->removeEventFilter(this);
+                    disconnect(w, &QObject::destroyed, this, &QQShutdownSequence::windowGone);
+                }
+            }
+            m_closing.clear();
+            QApplication::setQuitOnLastWindowClosed(m_quitOnLastWindowClosed);
+            emit finished(m_signal, m_expired);
+            return;
+        }
+        case IdleStage:
+            return;
+    }
+    // let the event loop run between the stages
+    QMetaObject::invokeMethod(this, "advance", Qt::QueuedConnection);
+}
+
+void QQShutdownSequence::advance()
+{
+    switch (m_stage) {
+        case NotifyStage:
+            enterStage(FlushStage);
+            break;
+        case FlushStage:
+            enterStage(CloseStage);
+            break;
+        case CloseStage:
+            enterStage(FinalStage);
+            break;
+        default:
+            break;
+    }
+}
+
+void QQShutdownSequence::expire()
+{
+    if (isRunning()) {
+        qCritical() << "shutdown deadline of" << m_deadline << "ms expired in stage" << stageName(m_stage);
+        m_expired = true;
+        enterStage(FinalStage);
+    }
+}
+
+void QQShutdownSequence::closeWindows()
+{
+    m_closing.clear();
+    foreach (QWidget *w, QApplication::topLevelWidgets()) {
+        if (w->isVisible() && w->isWindow()) {
+            m_closing.append(w);
+            w->installEventFilter(this);
+            connect(w, &QObject::destroyed, this, &QQShutdownSequence::windowGone, Qt::UniqueConnection);
+            // each close gets its own event loop iteration, so a slow window
+            // doesn't hold up the others or the event loop
+            QMetaObject::invokeMethod(w, "close", Qt::QueuedConnection);
+        }
+    }
+    if (m_closing.isEmpty()) {
+        QMetaObject::invokeMethod(this, "advance", Qt::QueuedConnection);
+    }
+}
+
+void QQShutdownSequence::windowGone(QObject *window)
+{
+    if (m_stage != CloseStage) {
+        return;
+    }
+    for (int i = m_closing.count() - 1; i >= 0; --i) {
+        if (!m_closing.at(i) || m_closing.at(i) == window) {
+            m_closing.remove(i);
+        }
+    }
+    if (m_closing.isEmpty()) {
+        advance();
+    }
+}
+
+bool QQShutdownSequence::eventFilter(QObject *watched, QEvent *event)
+{
+    if (event->type() == QEvent::Hide && m_stage == CloseStage) {
+        watched->removeEventFilter(this);
+        disconnect(watched, &QObject::destroyed, this, &QQShutdownSequence::windowGone);
+        windowGone(watched);
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+QJsonObject QQShutdownSequence::timings() const
+{
+    QJsonObject obj;
+    obj.insert(QStringLiteral("signal"), m_signal);
+    obj.insert(QStringLiteral("deadline_ms"), m_deadline);
+    obj.insert(QStringLiteral("expired"), m_expired);
+    QJsonArray stages;
+    qint64 total = 0;
+    for (int i = 0; i < m_timings.count(); ++i) {
+        QJsonObject stage;
+        stage.insert(QStringLiteral("stage"), stageName(m_timings.at(i).first));
+        stage.insert(QStringLiteral("ns"), double(m_timings.at(i).second));
+        stages.append(stage);
+        total += m_timings.at(i).second;
+    }
+    obj.insert(QStringLiteral("stages"), stages);
+    obj.insert(QStringLiteral("total_ns"), double(total));
+    return obj;
+}
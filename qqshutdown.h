@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#ifndef QQSHUTDOWN_H
+#define QQSHUTDOWN_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QWidget;
+QT_END_NAMESPACE
+
+/**
+ * QQShutdownSequence : a staged, asynchronous application shutdown.
+ *
+ * The sequence runs from the event loop, which remains responsive throughout:
+ * - Notify: aboutToShutdown() is emitted, for work that must precede closing
+ *   the windows (the application dismisses popups and its prewarmed windows);
+ * - Flush: flushRequested() is emitted, posted events are delivered and stdio is
+ *   flushed (the application writes its requested reports here, as a
+ *   terminating signal never returns from main());
+ * - Close: all visible top-level windows are asked to close, each from its own
+ *   event loop iteration, and the stage ends as soon as they have all been hidden;
+ * - Final: finished() is emitted.
+ * When the deadline expires the remaining stages are skipped and finished()
+ * is emitted with @p expired set. The duration of each stage is available
+ * through timings().
+ */
+class QQShutdownSequence : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stage {
+        IdleStage,
+        NotifyStage,
+        FlushStage,
+        CloseStage,
+        FinalStage
+    };
+    Q_ENUM(Stage)
+
+    explicit QQShutdownSequence(QObject *parent = nullptr);
+
+    /**
+     * The time (in ms) the sequence may take before it is cut short.
+     */
+    void setDeadline(int msecs);
+    int deadline() const
+    {
+        return m_deadline;
+    }
+
+    bool isRunning() const
+    {
+        return m_stage != IdleStage;
+    }
+    Stage stage() const
+    {
+        return m_stage;
+    }
+
+    /**
+     * The stage durations of the last (or current) run, as a JSON object
+     * with the signal, the deadline, whether it expired and a list of
+     * {stage, ns} entries.
+     */
+    QJsonObject timings() const;
+
+    static QString stageName(Stage stage);
+
+public Q_SLOTS:
+    /**
+     * Start the sequence for signal @p sig; does nothing if it is already running.
+     */
+    void start(int sig);
+
+Q_SIGNALS:
+    void aboutToShutdown(int sig);
+    void flushRequested(int sig);
+    void stageFinished(QQShutdownSequence::Stage stage, qint64 nsecs);
+    void finished(int sig, bool expired);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void advance();
+    void expire();
+
+private:
+    void enterStage(Stage stage);
+    void closeWindows();
+    void windowGone(QObject *window);
+
+    Stage m_stage;
+    int m_signal;
+    int m_deadline;
+    bool m_expired;
+    bool m_quitOnLastWindowClosed;
+    QTimer m_deadlineTimer;
+    QElapsedTimer m_stageTimer;
+    QVector<QPair<Stage,qint64> > m_timings;
+    QVector<QPointer<QWidget> > m_closing;
+};
+
+#endif
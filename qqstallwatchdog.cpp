@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "qqstallwatchdog.h"
+#include "qqnativesemaphore.h"
+
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QJsonArray>
+#include <QThread>
+#include <QDebug>
+
+#if defined(Q_OS_LINUX) || defined(Q_OS_MACOS)
+#define QQSTALLWATCHDOG_BACKTRACE
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstdlib>
+#endif
+
+class QQStallWatchdogThread : public QThread
+{
+public:
+    explicit QQStallWatchdogThread(QQStallWatchdog *watchdog)
+        : m_watchdog(watchdog)
+    {
+        setObjectName(QStringLiteral("QQStallWatchdog"));
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        m_watchdog->watch();
+    }
+
+private:
+    QQStallWatchdog *m_watchdog;
+};
+
+static const int maxStalls = 64;
+
+#ifdef QQSTALLWATCHDOG_BACKTRACE
+static const int maxFrames = 64;
+static pthread_t s_guiThread;
+static void *s_frames[maxFrames];
+static std::atomic_int s_frameCount(-1);
+
+// runs on the GUI thread, interrupting whatever it is stuck in
+static void captureHandler(int)
+{
+    const int savedErrno = errno;
+    s_frameCount.store(backtrace(s_frames, maxFrames));
+    errno = savedErrno;
+}
+#endif
+
+QQStallWatchdog::QQStallWatchdog(QObject *parent)
+    : QObject(parent)
+    , m_interval(100)
+    , m_threshold(250)
+    , m_running(false)
+    , m_thread(nullptr)
+    , m_heartbeat(nullptr)
+    , m_started(0)
+    , m_sequence(0)
+    , m_answered(0)
+    , m_lag(QStringLiteral("event loop lag"))
+    , m_stallCount(0)
+{
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &QQStallWatchdog::aboutToQuit);
+}
+
+QQStallWatchdog::~QQStallWatchdog()
+{
+    stop();
+}
+
+QQStallWatchdog *QQStallWatchdog::instance()
+{
+    static QQStallWatchdog *watchdog = nullptr;
+    if (!watchdog) {
+        watchdog = new QQStallWatchdog(qApp);
+    }
+    return watchdog;
+}
+
+void QQStallWatchdog::setInterval(int msecs)
+{
+    m_interval = qMax(1, msecs);
+}
+
+void QQStallWatchdog::setThreshold(int msecs)
+{
+    m_threshold = qMax(1, msecs);
+}
+
+bool QQStallWatchdog::start()
+{
+    if (m_running) {
+        return true;
+    }
+    m_heartbeat = new QQNativeSemaphore(true, true, 0, this);
+    if (!m_heartbeat->isValid()) {
+        qWarning() << Q_FUNC_INFO << "cannot create the heartbeat semaphore";
+        delete m_heartbeat;
+        m_heartbeat = nullptr;
+        return false;
+    }
+#ifdef QQSTALLWATCHDOG_BACKTRACE
+    s_guiThread = pthread_self();
+    // the first call can load libgcc, which must not happen in the handler
+    backtrace(s_frames, maxFrames);
+    struct sigaction action;
+    action.sa_handler = captureHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+#endif
+    m_started = QQBenchmark::now();
+    m_sequence = 0;
+    m_answered = 0;
+    m_running = true;
+    m_thread = new QQStallWatchdogThread(this);
+    m_thread->start();
+    return true;
+}
+
+void QQStallWatchdog::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    // wake the watchdog thread
+    m_heartbeat->trigger();
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    delete m_heartbeat;
+    m_heartbeat = nullptr;
+#ifdef QQSTALLWATCHDOG_BACKTRACE
+    signal(SIGUSR2, SIG_DFL);
+#endif
+}
+
+void QQStallWatchdog::watch()
+{
+    while (m_running) {
+        // drop the posts of pongs that came in after we stopped waiting for
+        // them, so they can't cut the next wait short
+        while (m_heartbeat->timedWait(0)) {
+        }
+        const quint64 sequence = ++m_sequence;
+        const qint64 sent = QQBenchmark::now();
+        QMetaObject::invokeMethod(this, "pong", Qt::QueuedConnection,
+                                  Q_ARG(quint64, sequence), Q_ARG(qint64, sent));
+        bool stalled = false;
+        while (m_running && m_answered < sequence) {
+            const qint64 waited = QQBenchmark::now() - sent;
+            const qint64 timeOut = stalled ? m_interval * 1000000LL
+                                           : qMax(m_threshold * 1000000LL - waited, 0LL);
+            m_heartbeat->timedWait(timeOut * 1e-9);
+            if (!stalled && m_answered < sequence && QQBenchmark::now() - sent >= m_threshold * 1000000LL) {
+                stalled = true;
+                beginStall(sent);
+            }
+        }
+        if (stalled) {
+            endStall(sent);
+        }
+        // the pause between pings; only stop() triggers the semaphore now
+        if (m_running) {
+            m_heartbeat->timedWait(m_interval * 1e-3);
+        }
+    }
+}
+
+void QQStallWatchdog::pong(quint64 sequence, qint64 sent)
+{
+    m_lag.record(QQBenchmark::now() - sent);
+    m_answered = sequence;
+    if (m_heartbeat) {
+        m_heartbeat->trigger();
+    }
+}
+
+void QQStallWatchdog::beginStall(qint64 sent)
+{
+    Stall stall;
+    stall.startNs = sent - m_started;
+    stall.durationNs = -1;
+    stall.stack = captureGuiStack();
+    m_stallCount += 1;
+    qWarning().noquote() << "GUI thread stalled for more than" << m_threshold << "ms, at:\n   "
+        << stall.stack.join(QStringLiteral("\n    "));
+    QMutexLocker lock(&m_stallsLock);
+    if (m_stalls.count() == maxStalls) {
+        m_stalls.removeFirst();
+    }
+    m_stalls.append(stall);
+}
+
+void QQStallWatchdog::endStall(qint64 sent)
+{
+    const qint64 duration = QQBenchmark::now() - sent;
+    qWarning() << "GUI thread stall ended after" << qPrintable(QQBenchmark::formatNsecs(duration));
+    QMutexLocker lock(&m_stallsLock);
+    if (!m_stalls.isEmpty()) {
+        m_stalls.last().durationNs = duration;
+    }
+}
+
+QStringList QQStallWatchdog::captureGuiStack()
+{
+    QStringList stack;
+#ifdef QQSTALLWATCHDOG_BACKTRACE
+    s_frameCount = -1;
+    if (pthread_kill(s_guiThread, SIGUSR2) == 0) {
+        for (int i = 0; i < 1000 && s_frameCount < 0; ++i) {
+            QThread::usleep(100);
+        }
+    }
+    const int n = s_frameCount;
+    if (n > 0) {
+        // skip the handler and the signal trampoline
+        if (char **symbols = backtrace_symbols(s_frames, n)) {
+            for (int i = 2; i < n; ++i) {
+                stack << QString::fromLocal8Bit(symbols[i]);
+            }
+            free(symbols);
+        }
+    } else {
+        stack << QStringLiteral("(the GUI thread did not handle the stack capture signal)");
+    }
+#else
+    stack << QStringLiteral("(stack capture is not available on this platform)");
+#endif
+    return stack;
+}
+
+QVector<QQStallWatchdog::Stall> QQStallWatchdog::stalls() const
+{
+    QMutexLocker lock(&m_stallsLock);
+    return m_stalls;
+}
+
+QStringList QQStallWatchdog::report() const
+{
+    QStringList lines;
+    lines << QStringLiteral("Event loop watchdog (ping every %1ms, stall threshold %2ms)")
+        .arg(m_interval).arg(m_threshold);
+    lines << QStringLiteral("  ") + m_lag.summary();
+    lines << QStringLiteral("  stalls: %1").arg(m_stallCount.load());
+    foreach (const Stall &stall, stalls()) {
+        lines << QStringLiteral("  stall at %1 lasting %2")
+            .arg(QQBenchmark::formatNsecs(stall.startNs))
+            .arg(stall.durationNs >= 0 ? QQBenchmark::formatNsecs(stall.durationNs) : QStringLiteral("(ongoing)"));
+        foreach (const QString &frame, stall.stack) {
+            lines << QStringLiteral("      ") + frame;
+        }
+    }
+    return lines;
+}
+
+QJsonObject QQStallWatchdog::toJson() const
+{
+    QJsonObject json;
+    json.insert(QStringLiteral("interval_ms"), m_interval);
+    json.insert(QStringLiteral("threshold_ms"), m_threshold);
+    json.insert(QStringLiteral("lag"), m_lag.toJson(true));
+    json.insert(QStringLiteral("stallCount"), m_stallCount.load());
+    QJsonArray stallList;
+    foreach (const Stall &stall, stalls()) {
+        QJsonObject obj;
+        obj.insert(QStringLiteral("start_ns"), double(stall.startNs));
+        obj.insert(QStringLiteral("duration_ns"), double(stall.durationNs));
+        obj.insert(QStringLiteral("stack"), QJsonArray::fromStringList(stall.stack));
+        stallList.append(obj);
+    }
+    json.insert(QStringLiteral("stalls"), stallList);
+    return json;
+}
+
+void QQStallWatchdog::dump()
+{
+    foreach (const QString &line, report()) {
+        qWarning() << qPrintable(line);
+    }
+}
+
+void QQStallWatchdog::aboutToQuit()
+{
+    if (m_running) {
+        stop();
+        dump();
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 René J.V. Bertin <rjvbertin@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public License
+ * along with this library; see the file COPYING.LIB.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef QQSTALLWATCHDOG_H
+#define QQSTALLWATCHDOG_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+
+#include "qqbenchmark.h"
+
+class QQNativeSemaphore;
+class QQStallWatchdogThread;
+
+/**
+ * QQStallWatchdog : notices when the GUI thread stops processing events.
+ *
+ * A watchdog thread queues a ping to the GUI thread every interval() ms and
+ * waits for the answer on a native-mode QQNativeSemaphore, with
+ * QQNativeSemaphore::timedWait(). The GUI thread records the time the ping
+ * spent in the queue, i.e. the event loop lag, in an HDR histogram. When no
+ * answer has come after threshold() ms, the watchdog records a stall and
+ * captures the stack of the GUI thread, by having it call backtrace() from
+ * a SIGUSR2 handler (Linux and Mac). That can cut a sleep in the GUI
+ * thread short, much like a profiler's sampling signal does. The stall
+ * ends, and gets its duration, when the GUI thread answers.
+ *
+ * The report can be printed on demand with dump(), and is printed when the
+ * application is about to quit.
+ */
+class QQStallWatchdog : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stall {
+        // when the late ping was sent, relative to start()
+        qint64 startNs;
+        // -1 while the GUI thread has not answered
+        qint64 durationNs;
+        QStringList stack;
+    };
+
+    static QQStallWatchdog *instance();
+
+    void setInterval(int msecs);
+    int interval() const
+    {
+        return m_interval;
+    }
+    void setThreshold(int msecs);
+    int threshold() const
+    {
+        return m_threshold;
+    }
+
+    /**
+     * Starts the watchdog thread; has to be called from the GUI thread.
+     */
+    bool start();
+    void stop();
+    bool isRunning() const
+    {
+        return m_running;
+    }
+
+    const QQLatencyHistogram &lag() const
+    {
+        return m_lag;
+    }
+    int stallCount() const
+    {
+        return m_stallCount;
+    }
+    /**
+     * The most recent stalls (at most 64), oldest first.
+     */
+    QVector<Stall> stalls() const;
+
+    QStringList report() const;
+    QJsonObject toJson() const;
+
+public Q_SLOTS:
+    /**
+     * Prints the report with qWarning().
+     */
+    void dump();
+
+private Q_SLOTS:
+    void pong(quint64 sequence, qint64 sent);
+    void aboutToQuit();
+
+private:
+    explicit QQStallWatchdog(QObject *parent);
+    ~QQStallWatchdog();
+
+    friend class QQStallWatchdogThread;
+    // the watchdog thread
+    void watch();
+    void beginStall(qint64 sent);
+    void endStall(qint64 sent);
+    static QStringList captureGuiStack();
+
+    int m_interval;
+    int m_threshold;
+    std::atomic_bool m_running;
+    QQStallWatchdogThread *m_thread;
+    QQNativeSemaphore *m_heartbeat;
+    qint64 m_started;
+    std::atomic<quint64> m_sequence;
+    std::atomic<quint64> m_answered;
+    QQLatencyHistogram m_lag;
+    std::atomic_int m_stallCount;
+    mutable QMutex m_stallsLock;
+    QVector<Stall> m_stalls;
+};
+
+#endif
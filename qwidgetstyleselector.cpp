@@ -29,8 +29,21 @@
 #include <QStyle>
 #include <QStyleFactory>
 #include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QStandardPaths>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QLibrary>
+#include <QPluginLoader>
+#include <QTimer>
+#include <QtConcurrent>
 #include <QDebug>
 
+#include "qqlogging.h"
+
 static QString getDefaultStyle(const char *fallback=Q_NULLPTR)
 {
     // TODO: implement a default setting
@@ -53,6 +66,224 @@ static QString getDefaultStyle(const char *fallback=Q_NULLPTR)
     return fallback;
 }
 
+QWidgetStyleCache::QWidgetStyleCache(QObject *parent)
+    : QObject(parent)
+    , m_enabled(true)
+    , m_keyCacheEnabled(true)
+{
+    connect(&m_preloadWatcher, &QFutureWatcher<void>::finished, this, &QWidgetStyleCache::instantiatePending);
+}
+
+QWidgetStyleCache *QWidgetStyleCache::instance()
+{
+    static QPointer<QWidgetStyleCache> cache;
+    if (!cache) {
+        // owned by the application, like the current style
+        cache = new QWidgetStyleCache(qApp);
+    }
+    return cache;
+}
+
+void QWidgetStyleCache::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool QWidgetStyleCache::contains(const QString &styleName) const
+{
+    return !m_styles.value(styleName.toLower()).isNull();
+}
+
+QStyle *QWidgetStyleCache::style(const QString &styleName)
+{
+    const QString key = styleName.toLower();
+    QStyle *style = m_styles.value(key);
+    if (!style) {
+        style = QStyleFactory::create(styleName);
+        if (style) {
+            qqCDebug(lcStyles) << Q_FUNC_INFO << "created" << style << "for" << styleName;
+            style->setParent(this);
+            m_styles.insert(key, style);
+        }
+    }
+    return style;
+}
+
+void QWidgetStyleCache::keep(QStyle *style)
+{
+    // take the style from the application before setStyle() deletes it
+    if (style && style->parent() == qApp) {
+        style->setParent(this);
+        m_styles.insert(style->objectName().toLower(), style);
+    }
+}
+
+bool QWidgetStyleCache::activate(const QString &styleName)
+{
+    QStyle *current = QApplication::style();
+    QStyle *next = m_enabled ? style(styleName) : QStyleFactory::create(styleName);
+    if (!next) {
+        qWarning() << Q_FUNC_INFO << "unknown style" << styleName;
+        return false;
+    }
+    if (next == current) {
+        return true;
+    }
+    if (m_enabled) {
+        keep(current);
+    }
+    QApplication::setStyle(next);
+    return true;
+}
+
+void QWidgetStyleCache::clear()
+{
+    QStyle *current = QApplication::style();
+    foreach (const QPointer<QStyle> &style, m_styles) {
+        if (style && style != current) {
+            delete style.data();
+        }
+    }
+    m_styles.clear();
+}
+
+void QWidgetStyleCache::setKeyCacheEnabled(bool enabled)
+{
+    m_keyCacheEnabled = enabled;
+}
+
+QString QWidgetStyleCache::keyCacheFile()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    return dir.isEmpty() ? QString() : dir + QStringLiteral("/stylekeys.json");
+}
+
+// the modification times of the style plugin directories and the modification
+// times and sizes of the files in them (a plugin can be updated in place without
+// touching its directory); only stat()s them, nothing is loaded
+static QJsonObject pluginDirState()
+{
+    QJsonObject dirs;
+    foreach (const QString &path, QCoreApplication::libraryPaths()) {
+        const QFileInfo info(path + QStringLiteral("/styles"));
+        QJsonObject dir;
+        dir.insert(QStringLiteral("mtime"), info.exists() ? double(info.lastModified().toMSecsSinceEpoch()) : -1.0);
+        if (info.isDir()) {
+            QJsonObject files;
+            foreach (const QFileInfo &file, QDir(info.absoluteFilePath()).entryInfoList(QDir::Files)) {
+                QJsonArray stat;
+                stat.append(double(file.lastModified().toMSecsSinceEpoch()));
+                stat.append(double(file.size()));
+                files.insert(file.fileName(), stat);
+            }
+            dir.insert(QStringLiteral("files"), files);
+        }
+        dirs.insert(info.absoluteFilePath(), dir);
+    }
+    return dirs;
+}
+
+QStringList QWidgetStyleCache::styleKeys()
+{
+    if (!m_keys.isEmpty()) {
+        return m_keys;
+    }
+    const QString fileName = m_keyCacheEnabled ? keyCacheFile() : QString();
+    QJsonObject state;
+    if (!fileName.isEmpty()) {
+        state.insert(QStringLiteral("qtVersion"), QLatin1String(qVersion()));
+        state.insert(QStringLiteral("pluginDirs"), pluginDirState());
+        QFile file(fileName);
+        if (file.open(QIODevice::ReadOnly)) {
+            const QJsonObject cached = QJsonDocument::fromJson(file.readAll()).object();
+            if (cached.value(QStringLiteral("qtVersion")) == state.value(QStringLiteral("qtVersion"))
+                    && cached.value(QStringLiteral("pluginDirs")) == state.value(QStringLiteral("pluginDirs"))) {
+                foreach (const QJsonValue &key, cached.value(QStringLiteral("keys")).toArray()) {
+                    m_keys.append(key.toString());
+                }
+                qqCDebug(lcStyles) << Q_FUNC_INFO << "read" << m_keys << "from" << fileName;
+            }
+        }
+    }
+    if (m_keys.isEmpty()) {
+        m_keys = QStyleFactory::keys();
+        if (!fileName.isEmpty()) {
+            QDir().mkpath(QFileInfo(fileName).absolutePath());
+            QFile file(fileName);
+            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                state.insert(QStringLiteral("keys"), QJsonArray::fromStringList(m_keys));
+                file.write(QJsonDocument(state).toJson());
+            }
+        }
+    }
+    return m_keys;
+}
+
+// runs in a worker thread: load the libraries of the style plugins that provide
+// one of @p keys, without instantiating anything.
+static void loadStylePlugins(const QStringList &keys)
+{
+    foreach (const QString &path, QCoreApplication::libraryPaths()) {
+        const QDir dir(path + QStringLiteral("/styles"));
+        foreach (const QString &fileName, dir.entryList(QDir::Files)) {
+            const QString file = dir.absoluteFilePath(fileName);
+            if (!QLibrary::isLibrary(file)) {
+                continue;
+            }
+            QPluginLoader loader(file);
+            const QJsonArray pluginKeys = loader.metaData().value(QStringLiteral("MetaData")).toObject()
+                .value(QStringLiteral("Keys")).toArray();
+            foreach (const QJsonValue &key, pluginKeys) {
+                if (keys.contains(key.toString(), Qt::CaseInsensitive)) {
+                    // QLibrary doesn't unload on destruction, so this keeps the
+                    // library mapped for QStyleFactory
+                    QLibrary library(file);
+                    library.load();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void QWidgetStyleCache::preload(const QStringList &styleNames)
+{
+    if (m_preloadWatcher.isRunning()) {
+        return;
+    }
+    const QStringList keys = styleNames.isEmpty() ? styleKeys() : styleNames;
+    foreach (const QString &key, keys) {
+        if (!contains(key) && !m_pending.contains(key, Qt::CaseInsensitive)) {
+            m_pending.append(key);
+        }
+    }
+    if (m_pending.isEmpty()) {
+        emit preloadFinished();
+        return;
+    }
+    qqCDebug(lcStyles) << Q_FUNC_INFO << "preloading" << m_pending;
+    m_preloadWatcher.setFuture(QtConcurrent::run(loadStylePlugins, m_pending));
+}
+
+void QWidgetStyleCache::instantiatePending()
+{
+    if (m_pending.isEmpty()) {
+        emit preloadFinished();
+        return;
+    }
+    // one style per event loop iteration, so user input isn't held up
+    style(m_pending.takeFirst());
+    QTimer::singleShot(0, this, SLOT(instantiatePending()));
+}
+
+bool QWidgetStyleSelector::s_shareActions = false;
+QPointer<QActionGroup> QWidgetStyleSelector::s_sharedGroup;
+
+void QWidgetStyleSelector::setShareActions(bool share)
+{
+    s_shareActions = share;
+}
+
 QWidgetStyleSelector::QWidgetStyleSelector(QWidget *parent)
     : QWidget(parent)
     , m_widgetStyle(QString())
@@ -77,35 +308,80 @@ WidgetStyleMenu *QWidgetStyleSelector::createStyleSelectionMenu(const QIcon &ico
         stylesAction->setIcon(icon);
     }
     stylesAction->setStatusTip(tr("Select the application widget style"));
-    QActionGroup *stylesGroup = new QActionGroup(stylesAction);
+    stylesAction->setObjectName(QStringLiteral("widgetStyleMenu"));
 
-    QStringList availableStyles = QStyleFactory::keys();
     QString desktopStyle = QApplication::style()->objectName();
     QString defaultStyle = getDefaultStyle();
 
-    // Add default style action
-    QAction *defaultStyleAction = new QAction(tr("Default"), stylesGroup);
-    defaultStyleAction->setCheckable(true);
-    // without a settings store we can only treat the Default entry
-    // as "select the default style for this platform".
-    // (see also the defaultStyleAction->setData() call below.
-    defaultStyleAction->setStatusTip(tr("Default widget style for this platform: %1").arg(getDefaultStyle()));
+    // with shared actions, all the menus after the first reuse its action group
+    QActionGroup *stylesGroup = s_shareActions ? s_sharedGroup.data() : nullptr;
+    const bool newGroup = !stylesGroup;
+    QAction *defaultStyleAction;
+    if (newGroup) {
+        stylesGroup = new QActionGroup(s_shareActions ? static_cast<QObject*>(QWidgetStyleCache::instance()) : stylesAction);
+        // Add default style action
+        defaultStyleAction = new QAction(tr("Default"), stylesGroup);
+        defaultStyleAction->setCheckable(true);
+        // without a settings store we can only treat the Default entry
+        // as "select the default style for this platform".
+        // (see also the defaultStyleAction->setData() call in populateStyleActions().
+        defaultStyleAction->setStatusTip(tr("Default widget style for this platform: %1").arg(getDefaultStyle()));
+        if (s_shareActions) {
+            s_sharedGroup = stylesGroup;
+        }
+    } else {
+        defaultStyleAction = stylesGroup->actions().first();
+    }
 
     stylesAction->addAction(defaultStyleAction);
     m_widgetStyle = selectedStyleName;
-    bool setStyle = false;
     if (m_widgetStyle.isEmpty()) {
-        if (desktopStyle.compare(defaultStyle, Qt::CaseInsensitive) == 0) {
+        if (!newGroup) {
+            m_widgetStyle = desktopStyle;
+        } else if (desktopStyle.compare(defaultStyle, Qt::CaseInsensitive) == 0) {
             defaultStyleAction->setChecked(true);
             m_widgetStyle = defaultStyleAction->text();
         } else {
             m_widgetStyle = desktopStyle;
         }
     } else if (selectedStyleName.compare(desktopStyle, Qt::CaseInsensitive)) {
-        setStyle = true;
+        // selectedStyleName was not empty: activate it, or stay with the
+        // current style if it doesn't exist (any more).
+        m_widgetStyle = desktopStyle;
+        activateStyle(selectedStyleName);
+    }
+
+    // The actions for the individual styles are only created when the menu
+    // is first shown, which keeps the style plugin scan off the startup path.
+    QQMenuSections::sections(stylesAction)->addSection([=]() -> QList<QAction*> {
+        if (stylesGroup->actions().count() == 1) {
+            populateStyleActions(stylesGroup, defaultStyleAction);
+        }
+        return stylesGroup->actions().mid(1);
+    });
+    if (!newGroup) {
+        return stylesAction;
+    }
+    if (s_shareActions) {
+        // the group outlives the window that created it
+        connect(stylesGroup, &QActionGroup::triggered, stylesGroup, [](QAction *a) {
+            qqCDebug(lcStyles) << Q_FUNC_INFO << a << "; activating shared style" << a->data();
+            const QString style = a->data().toString();
+            QWidgetStyleCache::instance()->activate(style.isEmpty() ? getDefaultStyle() : style);
+        });
+    } else {
+        connect(stylesGroup, &QActionGroup::triggered, this, [&](QAction *a) {
+            qqCDebug(lcStyles) << Q_FUNC_INFO << a << "; activating style" << a->data();
+            activateStyle(a->data().toString());
+        });
     }
+    return stylesAction;
+}
 
-    foreach(const QString &style, availableStyles) {
+void QWidgetStyleSelector::populateStyleActions(QActionGroup *stylesGroup, QAction *defaultStyleAction)
+{
+    const QString defaultStyle = getDefaultStyle();
+    foreach(const QString &style, QWidgetStyleCache::instance()->styleKeys()) {
         QAction *a = new QAction(style, stylesGroup);
         a->setCheckable(true);
         a->setData(style);
@@ -118,19 +394,8 @@ WidgetStyleMenu *QWidgetStyleSelector::createStyleSelectionMenu(const QIcon &ico
         }
         if (m_widgetStyle.compare(style, Qt::CaseInsensitive) == 0) {
             a->setChecked(true);
-            if (setStyle) {
-                // selectedStyleName was not empty and the
-                // the style exists: activate it.
-                activateStyle(style);
-            }
         }
-        stylesAction->addAction(a);
     }
-    connect(stylesGroup, &QActionGroup::triggered, this, [&](QAction *a) {
-        qWarning() << Q_FUNC_INFO << a << "; activating style" << a->data();
-        activateStyle(a->data().toString());
-    });
-    return stylesAction;
 }
 
 WidgetStyleMenu *QWidgetStyleSelector::createStyleSelectionMenu(const QString &text,
@@ -144,16 +409,24 @@ WidgetStyleMenu *QWidgetStyleSelector::createStyleSelectionMenu(const QString &s
     return createStyleSelectionMenu(QIcon(), tr("Style"), selectedStyleName, parent);
 }
 
-QString QWidgetStyleSelector::currentStyle() const
+// the style behind @p styleName, which can also be empty or "Default"
+static QString effectiveStyle(const QString &styleName)
 {
-    if (m_widgetStyle.isEmpty() || m_widgetStyle == QStringLiteral("Default")) {
+    if (styleName.isEmpty() || styleName == QStringLiteral("Default")) {
         return getDefaultStyle();
     }
-    return m_widgetStyle;
+    return styleName;
+}
+
+QString QWidgetStyleSelector::currentStyle() const
+{
+    return effectiveStyle(m_widgetStyle);
 }
 
 void QWidgetStyleSelector::activateStyle(const QString &styleName)
 {
-    m_widgetStyle = styleName;
-    QApplication::setStyle(QStyleFactory::create(currentStyle()));
+    // an unknown (e.g. stale) name must not become the selected style
+    if (QWidgetStyleCache::instance()->activate(effectiveStyle(styleName))) {
+        m_widgetStyle = styleName;
+    }
 }
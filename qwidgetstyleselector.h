@@ -21,6 +21,10 @@
 
 
 #include <QWidget>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
+#include <QFutureWatcher>
 #include "qqmenu.h"
 
 using WidgetStyleMenu = QQMenu;
@@ -28,6 +32,94 @@ using WidgetStyleMenu = QQMenu;
 class QString;
 class QIcon;
 class QAction;
+class QActionGroup;
+class QStyle;
+
+/**
+ * QWidgetStyleCache : keeps the QStyle instances the application has used
+ * alive, so switching back to a style doesn't construct it again.
+ *
+ * QApplication::setStyle() deletes the outgoing style when it is owned by
+ * the application; the cache takes the outgoing style over before it can.
+ *
+ * preload() can prepare a list of styles ahead of their first use: a worker
+ * thread (QtConcurrent) reads the metadata of the style plugins and loads the
+ * matching libraries, which is thread-safe, after which the styles themselves
+ * (QObjects that belong in the GUI thread) are constructed one at a time when
+ * the GUI thread is idle.
+ */
+class QWidgetStyleCache : public QObject
+{
+    Q_OBJECT
+public:
+    static QWidgetStyleCache *instance();
+
+    /**
+     * With the cache disabled, activate() creates a new style each time and
+     * QApplication deletes the outgoing one, as before.
+     */
+    void setEnabled(bool enabled);
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    bool contains(const QString &styleName) const;
+    /**
+     * Returns the cached instance of @p styleName, creating (and caching) it
+     * if needed. Returns nullptr for unknown styles.
+     */
+    QStyle *style(const QString &styleName);
+    /**
+     * Make @p styleName the application style, keeping the current one in the cache.
+     */
+    bool activate(const QString &styleName);
+    /**
+     * The available style keys, like QStyleFactory::keys(). These are read
+     * from an on-disk cache (keyCacheFile()) that remains valid as long as
+     * the Qt version, the modification times of the style plugin directories
+     * and the modification time and size of each plugin file in them don't
+     * change, which avoids loading the plugins.
+     */
+    QStringList styleKeys();
+    void setKeyCacheEnabled(bool enabled);
+    bool keyCacheEnabled() const
+    {
+        return m_keyCacheEnabled;
+    }
+    static QString keyCacheFile();
+
+    /**
+     * Deletes all cached styles except the current application style.
+     */
+    void clear();
+
+    /**
+     * Prepare @p styleNames (default: all known styles) in the background.
+     */
+    void preload(const QStringList &styleNames = QStringList());
+    bool isPreloading() const
+    {
+        return !m_pending.isEmpty() || m_preloadWatcher.isRunning();
+    }
+
+Q_SIGNALS:
+    void preloadFinished();
+
+private Q_SLOTS:
+    void instantiatePending();
+
+private:
+    explicit QWidgetStyleCache(QObject *parent = nullptr);
+    void keep(QStyle *style);
+
+    bool m_enabled;
+    bool m_keyCacheEnabled;
+    QStringList m_keys;
+    QHash<QString, QPointer<QStyle> > m_styles;
+    QStringList m_pending;
+    QFutureWatcher<void> m_preloadWatcher;
+};
 
 class /*KCONFIGWIDGETS_EXPORT*/ QWidgetStyleSelector : public QWidget
 {
@@ -42,12 +134,28 @@ public:
 
     QString currentStyle() const;
 
+    /**
+     * When set, the menus created afterwards by all selectors share a single
+     * group of style actions, owned by the application, instead of each
+     * having their own.
+     */
+    static void setShareActions(bool share);
+    static bool shareActions()
+    {
+        return s_shareActions;
+    }
+
 public Q_SLOTS:
     void activateStyle(const QString &styleName);
 
 private:
+    void populateStyleActions(QActionGroup *stylesGroup, QAction *defaultStyleAction);
+
     QString m_widgetStyle;
     QWidget *m_parent;
+
+    static bool s_shareActions;
+    static QPointer<QActionGroup> s_sharedGroup;
 };
 
 #define QWIDGETSTYLESELECTOR_H
@@ -0,0 +1,7 @@
+# builds the menus application and the QQNativeSemaphore benchmarks
+TEMPLATE      = subdirs
+
+SUBDIRS       = menus \
+                qqsemaphorebench
+menus.file    = menus.pro
+qqsemaphorebench.file = qqsemaphorebench.pro